@@ -6,12 +6,15 @@
 #include "core/input.h"
 #include "core/ecs/ecs.h"
 #include "core/platform/platform.h"
+#include "core/platform/memory_pool.h"
+#include "core/platform/block_allocator.h"
 #include "rendering/vulkan/vulkan.h"
 #include "math/linear.h"
 #include "math/transform.h"
 #include "core/ecs/entity.h"
 #include "tools/array.h"
 #include "tools/pool.h"
+#include "tools/inline_array.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tinyobjloader/tiny_obj_loader.h>
@@ -26,16 +29,18 @@ Ice::RendererVulkan* renderer;
 b8 isRunning;
 
 // Rendering =====
-Ice::CompactPool<Ice::Shader> shaders;
-Ice::CompactPool<Ice::Material> materials;
-Ice::CompactPool<Ice::MaterialSettings> materialSettings;
-Ice::CompactPool<Ice::MeshInformation> meshes;
-Ice::CompactPool<Ice::Image> textures;
+Ice::CompactPool<Ice::Shader> shaders(1, false, Ice::Memory_Tag_Renderer);
+Ice::CompactPool<Ice::Material> materials(1, false, Ice::Memory_Tag_Renderer);
+Ice::CompactPool<Ice::MaterialSettings> materialSettings(1, false, Ice::Memory_Tag_Renderer);
+Ice::CompactPool<Ice::MeshInformation> meshes(1, false, Ice::Memory_Tag_Asset);
+Ice::CompactPool<Ice::Image> textures(1, false, Ice::Memory_Tag_Asset);
 
 Ice::FrameInformation frameInfo{};
 
 Ice::Buffer transformsBuffer;
 
+Ice::MemoryPool Ice::frameMemory;
+
 //=========================
 // Time
 //=========================
@@ -44,15 +49,19 @@ Ice::TimeStruct Ice::time;
 // Setup time =====
 std::chrono::steady_clock::time_point realtimeStart, frameStart, frameEnd;
 const float microToSecond = 0.000001f;
+// Elapsed time not yet consumed by fixed-length simulation ticks
+f32 fixedUpdateAccumulator = 0.0f;
 
 void InitTime()
 {
   Ice::time.deltaTime = 0.0f;
   Ice::time.timeSinceStart = 0.0f;
   Ice::time.frameCount = 0;
+  Ice::time.interpolationAlpha = 1.0f;
 
   realtimeStart = std::chrono::steady_clock::now();
   frameStart = frameEnd = realtimeStart;
+  fixedUpdateAccumulator = 0.0f;
 
   Ice::time.deltaTime = 0.0f;
 }
@@ -69,6 +78,37 @@ void UpdateTime()
   frameStart = frameEnd;
 }
 
+// Runs as many fixed-length simulation ticks as the elapsed time covers
+b8 RunFixedUpdates()
+{
+  const f32 step = Ice::time.fixedDeltaTime;
+
+  fixedUpdateAccumulator += Ice::time.deltaTime;
+
+  u32 stepCount = 0;
+  while (fixedUpdateAccumulator >= step && stepCount < appSettings.maxFixedUpdateSteps)
+  {
+    for (Ice::Transform& t : Ice::GetComponentArray<Ice::Transform>())
+    {
+      t.StorePreviousState();
+    }
+
+    ICE_ATTEMPT(appSettings.GameUpdate(step));
+
+    fixedUpdateAccumulator -= step;
+    stepCount++;
+  }
+
+  // Drop whole ticks that could not be caught up on to avoid spiraling after a long frame
+  if (fixedUpdateAccumulator >= step)
+  {
+    fixedUpdateAccumulator = fmodf(fixedUpdateAccumulator, step);
+  }
+
+  Ice::time.interpolationAlpha = fixedUpdateAccumulator / step;
+  return true;
+}
+
 //=========================
 // Application
 //=========================
@@ -81,10 +121,24 @@ b8 IceApplicationInitialize(Ice::ApplicationSettings _settings)
   InitTime();
   appSettings = _settings;
 
+  if (_settings.fixedUpdateRate > 0.0f)
+  {
+    Ice::time.fixedDeltaTime = 1.0f / _settings.fixedUpdateRate;
+  }
+
+  Ice::LoggerInitialize(_settings.logger);
+
+  // Memory =====
+  if (!Ice::frameMemory.Initialize(_settings.frameMemorySize, Ice::Memory_Tag_Frame))
+  {
+    IceLogFatalIn(Ice::Log_Category_Memory, "Failed to initialize the frame memory pool");
+    return false;
+  }
+
   // Platform =====
   if (!Ice::platform.CreateNewWindow(_settings.window))
   {
-    IceLogFatal("Failed to initialize the renderer");
+    IceLogFatalIn(Ice::Log_Category_Renderer, "Failed to initialize the renderer");
     return false;
   }
   Ice::input.Initialize();
@@ -98,14 +152,14 @@ b8 IceApplicationInitialize(Ice::ApplicationSettings _settings)
   } break;
   default:
   {
-    IceLogFatal("Selected rendering API not supported");
+    IceLogFatalIn(Ice::Log_Category_Renderer, "Selected rendering API not supported");
     return false;
   } break;
   }
 
   if (!renderer->Init(_settings.rendererCore, _settings.window.title, _settings.version))
   {
-    IceLogFatal("Failed to initialize the renderer");
+    IceLogFatalIn(Ice::Log_Category_Renderer, "Failed to initialize the renderer");
     return false;
   }
 
@@ -122,17 +176,8 @@ b8 IceApplicationInitialize(Ice::ApplicationSettings _settings)
               &transformsBuffer,
               sizeof(Ice::mat4),
               Ice::GetComponentArray<Ice::Transform>().GetAllocatedSize(),
-              Ice::Buffer_Memory_Shader_Read
-              | Ice::Buffer_Memory_Transfer_Src
-              | Ice::Buffer_Memory_Transfer_Dst));
-
-  // Initialize transforms =====
-  Ice::Transform* transforms = Ice::GetComponentArray<Ice::Transform>().GetArray();
-  u32 transformCount = Ice::GetComponentArray<Ice::Transform>().GetAllocatedSize();
-  for (u32 i = 0; i < transformCount; i++)
-  {
-    transforms[i] = Ice::Transform();
-  }
+              Ice::Buffer_Memory_Shader_Storage,
+              Ice::Buffer_Memory_Hint_Per_Frame));
 
   // Game =====
   ICE_ATTEMPT(_settings.GameInit());
@@ -155,16 +200,34 @@ b8 IceApplicationUpdate()
   frameInfo.renderables = &Ice::GetComponentArray<Ice::RenderComponent>();
   frameInfo.meshes = &meshes;
   frameInfo.materials = &materials;
+  frameInfo.transforms = &transformsBuffer;
 
   while (isRunning && Ice::platform.Update())
   {
-    ICE_ATTEMPT(appSettings.GameUpdate(Ice::time.deltaTime));
+    Ice::frameMemory.Reset();
+    Ice::MemoryBeginFrame();
+
+    if (Ice::time.fixedDeltaTime > 0.0f)
+    {
+      ICE_ATTEMPT(RunFixedUpdates());
+    }
+    else
+    {
+      ICE_ATTEMPT(appSettings.GameUpdate(Ice::time.deltaTime));
+    }
 
     globalDescriptorData[0] = Ice::time.timeSinceStart;
     renderer->PushDataToGlobalDescriptors(&globalDescriptorData);
 
     ICE_ATTEMPT(Ice::UpdateTransforms());
 
+    if (appSettings.DebugOverlay != nullptr)
+    {
+      Ice::GpuMemoryStats memoryStats;
+      renderer->GetMemoryStats(&memoryStats);
+      appSettings.DebugOverlay(memoryStats);
+    }
+
     ICE_ATTEMPT(renderer->RenderFrame(&frameInfo));
 
     Ice::input.Update();
@@ -217,6 +280,19 @@ b8 IceApplicationShutdown()
   Ice::CloseWindow();
   Ice::platform.Shutdown();
 
+  Ice::frameMemory.Shutdown();
+
+  // Component storage, the main thread's scratch pool, and block slabs are released at exit
+  // The logger's queue is released once the report has been written
+  Ice::MemoryPrintStats();
+  Ice::BlockAllocatorPrintStats();
+  Ice::MemoryReportLeaks((1 << Ice::Memory_Tag_Ecs)
+                         | (1 << Ice::Memory_Tag_Scratch)
+                         | (1 << Ice::Memory_Tag_Block_Allocator)
+                         | (1 << Ice::Memory_Tag_Logger));
+
+  Ice::LoggerShutdown();
+
   return true;
 }
 
@@ -308,10 +384,11 @@ b8 CreateMesh(const char* _directory, Ice::Mesh* _mesh)
                           &loadErrors,
                           _directory))
     {
-      IceLogError("Failed to load mesh '%s'\n> tinyobj warnings: '%s'\n> tinyobj errors: '%s'",
-                  _directory,
-                  loadWarnings.c_str(),
-                  loadErrors.c_str());
+      IceLogErrorIn(Ice::Log_Category_Asset,
+                    "Failed to load mesh '%s'\n> tinyobj warnings: '%s'\n> tinyobj errors: '%s'",
+                    _directory,
+                    loadWarnings.c_str(),
+                    loadErrors.c_str());
     }
   }
 
@@ -368,7 +445,8 @@ b8 CreateMesh(const char* _directory, Ice::Mesh* _mesh)
                                              (sizeof(Ice::Vertex) * vertices.size() +
                                               (sizeof(u32) * indices.size())),
                                              1,
-                                             Ice::Buffer_Memory_Vertex | Ice::Buffer_Memory_Index));
+                                             Ice::Buffer_Memory_Vertex | Ice::Buffer_Memory_Index,
+                                             Ice::Buffer_Memory_Hint_Gpu_Only));
 
     newMesh.vertexBuffer.buffer = &newMesh.buffer;
     newMesh.vertexBuffer.offset = 0;
@@ -376,7 +454,7 @@ b8 CreateMesh(const char* _directory, Ice::Mesh* _mesh)
     newMesh.vertexBuffer.count = 1;
     if (!renderer->PushDataToBuffer(vertices.data(), newMesh.vertexBuffer))
     {
-      IceLogError("Failed to push vertex data to its buffer");
+      IceLogErrorIn(Ice::Log_Category_Asset, "Failed to push vertex data to its buffer");
       renderer->DestroyBufferMemory(&newMesh.buffer);
       return false;
     }
@@ -387,7 +465,7 @@ b8 CreateMesh(const char* _directory, Ice::Mesh* _mesh)
     newMesh.indexBuffer.count = 1;
     if (!renderer->PushDataToBuffer(indices.data(), newMesh.indexBuffer))
     {
-      IceLogError("Failed to push index data to its buffer");
+      IceLogErrorIn(Ice::Log_Category_Asset, "Failed to push index data to its buffer");
       renderer->DestroyBufferMemory(&newMesh.buffer);
       return false;
     }
@@ -399,7 +477,7 @@ b8 CreateMesh(const char* _directory, Ice::Mesh* _mesh)
 b8 Ice::GetMesh(const char* _directory, u32* _mesh)
 {
   u32 meshIndex = 0;
-  for (Ice::MeshInformation m : meshes)
+  for (const Ice::MeshInformation& m : meshes)
   {
     if (m.fileName.compare(_directory) == 0)
     {
@@ -428,13 +506,15 @@ b8 Ice::CreateMaterial(Ice::MaterialSettings _settings, u32* _material /*= nullp
 
   if (materials.Size() == appSettings.maxMaterialCount)
   {
-    IceLogError("Maximum material count (%u) reached", appSettings.maxMaterialCount);
+    IceLogErrorIn(Ice::Log_Category_Asset,
+                  "Maximum material count (%u) reached",
+                  appSettings.maxMaterialCount);
     return false;
   }
 
   // Get shaders' info =====
   b8 shaderFound = false;
-  std::vector<u32> shaderIndices;
+  Ice::InlineArray<u32, 4> shaderIndices;
 
   for (u32 i = 0; i < _settings.shaderSettings.size(); i++)
   {
@@ -452,7 +532,7 @@ b8 Ice::CreateMaterial(Ice::MaterialSettings _settings, u32* _material /*= nullp
           && _settings.shaderSettings[i].type == oldShader.settings.type)
       {
         shaderFound = true;
-        shaderIndices.push_back(index);
+        shaderIndices.PushBack(index);
         index++;
         break;
       }
@@ -464,39 +544,40 @@ b8 Ice::CreateMaterial(Ice::MaterialSettings _settings, u32* _material /*= nullp
     {
       if (shaders.Size() == appSettings.maxShaderCount)
       {
-        IceLogError("Maximum shader count (%u) reached", appSettings.maxShaderCount);
+        IceLogErrorIn(Ice::Log_Category_Asset,
+                      "Maximum shader count (%u) reached",
+                      appSettings.maxShaderCount);
         return false;
       }
 
       Ice::Shader& newshader = shaders.GetNewElement();
       if (!renderer->CreateShader(_settings.shaderSettings[i], &newshader))
       {
-        IceLogError("Failed to create a shader\n> '%s'", newshader.settings.fileDirectory.c_str());
+        IceLogErrorIn(Ice::Log_Category_Asset,
+                      "Failed to create a shader\n> '%s'",
+                      newshader.settings.fileDirectory.c_str());
         return false;
       }
 
-      shaderIndices.push_back(index);
+      shaderIndices.PushBack(index);
       index++;
     }
   }
 
-  std::vector<Ice::Shader*> shaderPointers;
-  for (u32 i : shaderIndices)
-  {
-    shaderPointers.push_back(&shaders[i]);
-  }
-
   materialSettings.GetNewElement() = _settings;
 
   // Create material =====
   Ice::Material& newmaterial = materials.GetNewElement(_material);
   newmaterial.subpassIndex = _settings.subpassIndex;
-  newmaterial.shaders = shaderPointers;
+  for (u32 i : shaderIndices)
+  {
+    newmaterial.shaders.PushBack(&shaders[i]);
+  }
   if (!renderer->CreateMaterial(&newmaterial))
   {
     materials.ReturnElement(*_material);
     *_material = Ice::null32;
-    IceLogError("Failed to create material");
+    IceLogErrorIn(Ice::Log_Category_Asset, "Failed to create material");
     return false;
   }
 
@@ -542,7 +623,7 @@ b8 Ice::RecreateAllMaterials()
 
 b8 Ice::ReloadMaterial(Material* _material)
 {
-  for (u32 i = 0; i < _material->shaders.size(); i++)
+  for (u32 i = 0; i < _material->shaders.Size(); i++)
   {
     ICE_ATTEMPT(ReloadShader(_material->shaders[i]));
   }
@@ -569,6 +650,26 @@ b8 Ice::LoadTexture(Ice::Image* _texture, const char* _directory)
   return true;
 }
 
+b8 Ice::IsTextureUploaded(const Ice::Image* _texture)
+{
+  return renderer->IsTextureUploaded(_texture);
+}
+
+b8 Ice::FinishUploads()
+{
+  return renderer->FinishUploads();
+}
+
+void Ice::GetGpuMemoryStats(Ice::GpuMemoryStats* _stats)
+{
+  renderer->GetMemoryStats(_stats);
+}
+
+void Ice::GetUploadStats(Ice::RendererUploadStats* _lastFrame, Ice::RendererUploadStats* _total)
+{
+  renderer->GetUploadStats(_lastFrame, _total);
+}
+
 void Ice::SetTexture(Ice::Material* _material, u32 _inputIndex, const char* _directory)
 {
   Ice::Image& newTexture = textures.GetNewElement();
@@ -614,15 +715,7 @@ Ice::Entity Ice::CreateRenderedEntity(const char* _meshDir /*= nullptr*/,
 
   if (Ice::GetComponentArray<Ice::Transform>().GetAllocatedSize() > transformsBuffer.count)
   {
-    Ice::CompactArray<Ice::Transform>& transformCompact = Ice::GetComponentArray<Ice::Transform>();
-    renderer->ResizeBufferMemory(&transformsBuffer, transformCompact.GetAllocatedSize());
-
-    for (Ice::Entity e : Ice::SceneView<Ice::RenderComponent, Ice::Transform>())
-    {
-      transformCompact[e].bufferSegment.buffer = &transformsBuffer;
-      renderer->UpdateRenderComponent(e.GetComponent<Ice::RenderComponent>(),
-                                      transformCompact[e].bufferSegment);
-    }
+    renderer->ResizeBufferMemory(&transformsBuffer, Ice::GetComponentArray<Ice::Transform>().GetAllocatedSize());
   }
 
   Ice::RenderComponent* r = e.AddComponent<Ice::RenderComponent>();
@@ -651,39 +744,39 @@ b8 Ice::UpdateTransforms()
   if (transformCompact.GetAllocatedSize() > transformsBuffer.count)
   {
     renderer->ResizeBufferMemory(&transformsBuffer, transformCompact.GetAllocatedSize());
-
-    for (Ice::Entity e : Ice::SceneView<Ice::RenderComponent, Ice::Transform>())
-    {
-      transformCompact[e].bufferSegment.buffer = &transformsBuffer;
-      renderer->UpdateRenderComponent(e.GetComponent<Ice::RenderComponent>(),
-                                      transformCompact[e].bufferSegment);
-    }
   }
 
-  std::vector<Ice::Entity> camEntities;
+  Ice::FrameVector<Ice::Entity> camEntities;
   for (Ice::Entity e : Ice::SceneView<Ice::Transform, Ice::CameraComponent>())
   {
     camEntities.push_back(e);
   }
 
+  // Render between the previous and current simulation ticks when using a fixed timestep
+  const b8 interpolate = Ice::time.fixedDeltaTime > 0.0f;
+  const f32 alpha = Ice::time.interpolationAlpha;
+
   u32 count = 0;
   Ice::Transform* transforms = transformCompact.GetArray(&count);
   Ice::mat4 m(1.0f);
   for (u32 i = 0, j = 0; i < count; i++)
   {
-    if (transforms[i].GetDirty()) // TODO : Separate static & dynamic transforms
+    // TODO : Separate static & dynamic transforms
+    if (transforms[i].GetDirty() || (interpolate && transforms[i].IsInterpolating()))
     {
+      m = interpolate ? transforms[i].GetInterpolatedMatrix(alpha) : transforms[i].GetMatrix();
+
       if (j < camEntities.size() && i == transformCompact.GetMappedIndex(camEntities[j].id))
       {
         Ice::CameraData* cd = camEntities[j].GetComponent<Ice::CameraData>();
         Ice::CameraComponent* cc = camEntities[j].GetComponent<Ice::CameraComponent>();
 
-        Ice::vec3 v = transforms[i].GetPosition();
-        cd->position = Ice::vec4(v.x, v.y, v.z, 1.0f);
-        v = transforms[i].ForwardVector();
+        cd->position = Ice::vec4(m.elements[12], m.elements[13], m.elements[14], 1.0f);
+        // -Z of the same (interpolated) matrix the position and view come from
+        Ice::vec3 v = Ice::vec3(-m.elements[8], -m.elements[9], -m.elements[10]).Normal();
         cd->forward = Ice::vec4(v.x, v.y, v.z, 1.0f);
 
-        cd->viewProjectionMatrix = transforms[i].GetMatrix().Inverse() * cc->projectionMatrix;
+        cd->viewProjectionMatrix = m.Inverse() * cc->projectionMatrix;
 
         Ice::BufferSegment segment {};
         segment.buffer = &cc->buffer;
@@ -697,7 +790,6 @@ b8 Ice::UpdateTransforms()
       }
       else
       {
-        m = transforms[i].GetMatrix();
         renderer->PushDataToBuffer(&m, transforms[i].bufferSegment);
       }
     }
@@ -53,6 +53,15 @@ b8 RecreateMaterial(Ice::Material* _material);
 b8 RecreateAllMaterials();
 
 b8 LoadTexture(Ice::Image* _texture, const char* _directory);
+// True once the GPU has finished writing the texture's data
+b8 IsTextureUploaded(const Ice::Image* _texture);
+// Submits every queued upload and blocks until they complete
+b8 FinishUploads();
+
+// Device memory by heap, memory type, and category
+void GetGpuMemoryStats(Ice::GpuMemoryStats* _stats);
+// Data uploaded through the staging memory in the last frame submitted, and since initialization
+void GetUploadStats(Ice::RendererUploadStats* _lastFrame, Ice::RendererUploadStats* _total);
 void SetTexture(Ice::Material* _material, u32 _inputIndex, const char* _image);
 //void SetTexture(Ice::Material* _material, u32 inputIndex, Ice::Image* _image);
 
@@ -22,9 +22,23 @@ struct ApplicationSettings
   b8(*GameUpdate)(f32 _delta);
   b8(*GameShutdown)();
 
+  // Simulation ticks per second. GameUpdate receives the fixed step and transforms are
+  //   interpolated between ticks when rendering. 0 ticks once per rendered frame.
+  f32 fixedUpdateRate = 0.0f;
+  // Maximum ticks simulated in one frame before dropping the remaining time
+  u32 maxFixedUpdateSteps = 5;
+
+  // Bytes reserved for allocations that only live until the end of the frame
+  u64 frameMemorySize = 4 * 1024 * 1024;
+
+  Ice::LoggerSettings logger;
+
   Ice::RendererSettingsCore rendererCore;
   Ice::WindowSettings window;
 
+  // Called every frame before rendering with the latest device memory statistics, when set
+  void(*DebugOverlay)(const Ice::GpuMemoryStats& _stats) = nullptr;
+
   // I don't really like this.
   u32 maxShaderCount = 200;   // Number of unique shaders
   u32 maxMaterialCount = 100; // Number of unique materials
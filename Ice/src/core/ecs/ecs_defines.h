@@ -23,7 +23,7 @@ u32 GetComponentId()
 template<typename T>
 Ice::CompactArray<T>& GetComponentArray()
 {
-  static Ice::CompactArray<T> thisCompact(2);
+  static Ice::CompactArray<T> thisCompact(2, Ice::Memory_Tag_Ecs);
   return thisCompact;
 }
 
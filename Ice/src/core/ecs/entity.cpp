@@ -8,7 +8,7 @@
 #include <vector>
 
 u32 Ice::componentCount = 0;
-Ice::CompactArray<Ice::Entity> Ice::activeEntities(2);
+Ice::CompactArray<Ice::Entity> Ice::activeEntities(2, Ice::Memory_Tag_Ecs);
 std::vector<Ice::Entity> Ice::availableEntities(0);
 
 Ice::Entity Ice::CreateEntity()
@@ -28,7 +28,7 @@ Ice::Entity Ice::CreateEntity()
   // Can only hit limit if available is empty
   //if (activeEntities.size() >= maxEntities)
   //{
-  //  IceLogError("Max entity count reached : %u", maxEntities);
+  //  IceLogErrorIn(Ice::Log_Category_Ecs, "Max entity count reached : %u", maxEntities);
   //  return nullEntity;
   //}
 
@@ -0,0 +1,446 @@
+
+#include "defines.h"
+
+#include "core/platform/block_allocator.h"
+#include "core/platform/platform.h"
+#include "tools/logger.h"
+
+#include <array>
+#include <atomic>
+
+//=========================
+// Size classes
+//=========================
+// 16-byte steps up to 128, then four classes per doubling (at most 25% rounding waste)
+
+constexpr u32 blockClassCount = 40;
+
+constexpr u64 BlockClassSize(u32 _classIndex)
+{
+  if (_classIndex < 8)
+    return (u64)(_classIndex + 1) * 16;
+
+  u64 base = 128ull << ((_classIndex - 8) / 4);
+  return base + ((_classIndex - 8) % 4 + 1) * (base / 4);
+}
+
+static_assert(BlockClassSize(blockClassCount - 1) == ICE_BLOCK_MAX_SIZE, "Block classes must end at ICE_BLOCK_MAX_SIZE");
+
+// Maps (size + 15) / 16 to the smallest class that fits it
+constexpr std::array<u8, ICE_BLOCK_MAX_SIZE / 16 + 1> BuildBlockClassLookup()
+{
+  std::array<u8, ICE_BLOCK_MAX_SIZE / 16 + 1> lookup {};
+  u32 classIndex = 0;
+  for (u32 i = 0; i < lookup.size(); i++)
+  {
+    while (BlockClassSize(classIndex) < (u64)i * 16)
+      classIndex++;
+    lookup[i] = (u8)classIndex;
+  }
+  return lookup;
+}
+
+constexpr std::array<u8, ICE_BLOCK_MAX_SIZE / 16 + 1> blockClassLookup = BuildBlockClassLookup();
+
+inline u32 BlockClassIndex(u64 _size)
+{
+  return blockClassLookup[(_size + 15) / 16];
+}
+
+// At least 64KB and 16 blocks per slab
+constexpr u64 BlockSlabSize(u32 _classIndex)
+{
+  return max(64ull * 1024, BlockClassSize(_classIndex) * 16);
+}
+
+//=========================
+// Shared state
+//=========================
+// Trivially destructible so blocks can still be released by static destructors at exit
+
+struct BlockFreeNode
+{
+  BlockFreeNode* next;
+};
+
+struct BlockClass
+{
+  std::atomic_flag lock;
+  BlockFreeNode* freeList;
+
+  // Unused tail of the newest slab; blocks are carved from it on demand
+  u8* slabCursor;
+  u8* slabEnd;
+
+  std::atomic<u64> slabCount;
+  std::atomic<u64> blockCount;
+  std::atomic<u64> usedCount;
+  std::atomic<u64> requestedBytes;
+};
+
+BlockClass blockClasses[blockClassCount];
+
+inline void BlockLock(BlockClass& _class)
+{
+  while (_class.lock.test_and_set(std::memory_order_acquire))
+  {
+    _class.lock.wait(true, std::memory_order_relaxed);
+  }
+}
+
+inline void BlockUnlock(BlockClass& _class)
+{
+  _class.lock.clear(std::memory_order_release);
+  _class.lock.notify_one();
+}
+
+// Cuts a new block from the class's newest slab, starting a slab if needed
+// Returns nullptr if a new slab can't be allocated
+// Must be called with the class locked
+void* BlockCarveLocked(u32 _classIndex)
+{
+  BlockClass& c = blockClasses[_classIndex];
+  const u64 blockSize = BlockClassSize(_classIndex);
+
+  if (c.slabCursor == nullptr || c.slabCursor + blockSize > c.slabEnd)
+  {
+    const u64 slabSize = BlockSlabSize(_classIndex);
+    u8* slab = (u8*)Ice::MemoryAllocate(slabSize, Ice::Memory_Tag_Block_Allocator);
+    if (slab == nullptr)
+      return nullptr;
+
+    c.slabCursor = slab;
+    c.slabEnd = slab + (slabSize / blockSize) * blockSize;
+    c.slabCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void* block = c.slabCursor;
+  c.slabCursor += blockSize;
+  c.blockCount.fetch_add(1, std::memory_order_relaxed);
+  return block;
+}
+
+// Takes up to _count blocks from the class, preferring recycled blocks
+// Returns the number taken, fewer than _count only if a new slab can't be allocated
+// Must be called with the class locked
+u32 BlockTakeLocked(u32 _classIndex, void** _out, u32 _count)
+{
+  BlockClass& c = blockClasses[_classIndex];
+
+  u32 taken = 0;
+  while (taken < _count && c.freeList != nullptr)
+  {
+    _out[taken++] = c.freeList;
+    c.freeList = c.freeList->next;
+  }
+
+  while (taken < _count)
+  {
+    void* block = BlockCarveLocked(_classIndex);
+    if (block == nullptr)
+      break;
+
+    _out[taken++] = block;
+  }
+
+  return taken;
+}
+
+void BlockGiveLocked(u32 _classIndex, void** _blocks, u32 _count)
+{
+  BlockClass& c = blockClasses[_classIndex];
+  for (u32 i = 0; i < _count; i++)
+  {
+    BlockFreeNode* node = (BlockFreeNode*)_blocks[i];
+    node->next = c.freeList;
+    c.freeList = node;
+  }
+}
+
+//=========================
+// Thread caches
+//=========================
+
+#define ICE_BLOCK_CACHE_CAPACITY 32
+#define ICE_BLOCK_CACHE_BATCH 16
+
+// Plain data so it remains usable after the thread's destructors have run
+struct BlockThreadCache
+{
+  void* blocks[blockClassCount][ICE_BLOCK_CACHE_CAPACITY];
+  u32 counts[blockClassCount];
+  b8 retired; // Set once the thread has flushed; later calls use the shared lists directly
+};
+
+thread_local BlockThreadCache blockCache;
+
+// Returns a thread's cached blocks to the shared lists when it exits
+struct BlockThreadCacheFlusher
+{
+  b8 registered;
+
+  BlockThreadCacheFlusher() : registered(true) {}
+
+  ~BlockThreadCacheFlusher()
+  {
+    for (u32 i = 0; i < blockClassCount; i++)
+    {
+      if (blockCache.counts[i] == 0)
+        continue;
+
+      BlockLock(blockClasses[i]);
+      BlockGiveLocked(i, blockCache.blocks[i], blockCache.counts[i]);
+      BlockUnlock(blockClasses[i]);
+      blockCache.counts[i] = 0;
+    }
+
+    blockCache.retired = true;
+  }
+};
+
+thread_local BlockThreadCacheFlusher blockCacheFlusher;
+
+void* BlockAcquire(u32 _classIndex)
+{
+  BlockThreadCache& cache = blockCache;
+  if (cache.retired)
+  {
+    void* block = nullptr;
+    BlockLock(blockClasses[_classIndex]);
+    BlockTakeLocked(_classIndex, &block, 1);
+    BlockUnlock(blockClasses[_classIndex]);
+    return block;
+  }
+
+  if (cache.counts[_classIndex] == 0)
+  {
+    (void)blockCacheFlusher.registered; // Ensures this thread's cache is flushed when it exits
+
+    BlockLock(blockClasses[_classIndex]);
+    cache.counts[_classIndex] = BlockTakeLocked(_classIndex, cache.blocks[_classIndex], ICE_BLOCK_CACHE_BATCH);
+    BlockUnlock(blockClasses[_classIndex]);
+
+    if (cache.counts[_classIndex] == 0)
+      return nullptr;
+  }
+
+  cache.counts[_classIndex]--;
+  return cache.blocks[_classIndex][cache.counts[_classIndex]];
+}
+
+void BlockRelease(u32 _classIndex, void* _block)
+{
+  BlockThreadCache& cache = blockCache;
+  if (cache.retired)
+  {
+    BlockLock(blockClasses[_classIndex]);
+    BlockGiveLocked(_classIndex, &_block, 1);
+    BlockUnlock(blockClasses[_classIndex]);
+    return;
+  }
+
+  if (cache.counts[_classIndex] == ICE_BLOCK_CACHE_CAPACITY)
+  {
+    // Return the oldest half so the most recently used (cache-warm) blocks stay local
+    BlockLock(blockClasses[_classIndex]);
+    BlockGiveLocked(_classIndex, cache.blocks[_classIndex], ICE_BLOCK_CACHE_BATCH);
+    BlockUnlock(blockClasses[_classIndex]);
+
+    u32 remaining = ICE_BLOCK_CACHE_CAPACITY - ICE_BLOCK_CACHE_BATCH;
+    for (u32 i = 0; i < remaining; i++)
+    {
+      cache.blocks[_classIndex][i] = cache.blocks[_classIndex][ICE_BLOCK_CACHE_BATCH + i];
+    }
+    cache.counts[_classIndex] = remaining;
+  }
+
+  cache.blocks[_classIndex][cache.counts[_classIndex]++] = _block;
+}
+
+//=========================
+// Interface
+//=========================
+
+void* Ice::BlockAllocate(u64 _size, Ice::MemoryTags _tag /*= Memory_Tag_Unknown*/)
+{
+  if (_size == 0)
+    return nullptr;
+
+  if (_size > ICE_BLOCK_MAX_SIZE)
+    return Ice::MemoryAllocate(_size, _tag);
+
+  u32 classIndex = BlockClassIndex(_size);
+  void* block = BlockAcquire(classIndex);
+  if (block == nullptr)
+    return nullptr;
+
+  blockClasses[classIndex].usedCount.fetch_add(1, std::memory_order_relaxed);
+  blockClasses[classIndex].requestedBytes.fetch_add(_size, std::memory_order_relaxed);
+  Ice::MemoryTrackAllocation(_size, _tag);
+
+  return block;
+}
+
+void Ice::BlockFree(void* _block, u64 _size, Ice::MemoryTags _tag /*= Memory_Tag_Unknown*/)
+{
+  if (_block == nullptr)
+    return;
+
+  if (_size > ICE_BLOCK_MAX_SIZE)
+  {
+    Ice::MemoryFree(_block);
+    return;
+  }
+
+  u32 classIndex = BlockClassIndex(_size);
+  BlockRelease(classIndex, _block);
+
+  blockClasses[classIndex].usedCount.fetch_sub(1, std::memory_order_relaxed);
+  blockClasses[classIndex].requestedBytes.fetch_sub(_size, std::memory_order_relaxed);
+  Ice::MemoryTrackFree(_size, _tag);
+}
+
+b8 Ice::BlockResizeInPlace(void* _block,
+                          u64 _oldSize,
+                          u64 _newSize,
+                          Ice::MemoryTags _tag /*= Memory_Tag_Unknown*/)
+{
+  if (_block == nullptr || _newSize == 0)
+    return false;
+
+  // Large allocations may have reserved room to grow into
+  if (_oldSize > ICE_BLOCK_MAX_SIZE)
+    return _newSize > ICE_BLOCK_MAX_SIZE && Ice::MemoryResizeInPlace(_block, _newSize);
+
+  // Stay in place when both sizes map to the same block
+  if (_newSize > ICE_BLOCK_MAX_SIZE || BlockClassIndex(_oldSize) != BlockClassIndex(_newSize))
+    return false;
+
+  u32 classIndex = BlockClassIndex(_oldSize);
+  blockClasses[classIndex].requestedBytes.fetch_add(_newSize - _oldSize, std::memory_order_relaxed);
+  Ice::MemoryTrackFree(_oldSize, _tag);
+  Ice::MemoryTrackAllocation(_newSize, _tag);
+  return true;
+}
+
+void* Ice::BlockReallocate(void* _block,
+                           u64 _oldSize,
+                           u64 _newSize,
+                           Ice::MemoryTags _tag /*= Memory_Tag_Unknown*/)
+{
+  if (_block == nullptr)
+    return BlockAllocate(_newSize, _tag);
+
+  if (BlockResizeInPlace(_block, _oldSize, _newSize, _tag))
+    return _block;
+
+  // Like realloc, the old block stays valid when a new one can't be allocated
+  void* newBlock = BlockAllocate(_newSize, _tag);
+  if (newBlock == nullptr)
+    return nullptr;
+
+  Ice::MemoryCopy(_block, newBlock, min(_oldSize, _newSize));
+  BlockFree(_block, _oldSize, _tag);
+
+  return newBlock;
+}
+
+void Ice::BlockReserve(u64 _size, u32 _count)
+{
+  if (_size == 0 || _size > ICE_BLOCK_MAX_SIZE)
+    return;
+
+  u32 classIndex = BlockClassIndex(_size);
+  BlockClass& c = blockClasses[classIndex];
+
+  // Carve fresh blocks now and park them on the free list
+  BlockLock(c);
+  for (u32 i = 0; i < _count; i++)
+  {
+    void* block = BlockCarveLocked(classIndex);
+    if (block == nullptr)
+      break;
+
+    BlockGiveLocked(classIndex, &block, 1);
+  }
+  BlockUnlock(c);
+}
+
+u64 Ice::BlockSizeFor(u64 _size)
+{
+  if (_size == 0 || _size > ICE_BLOCK_MAX_SIZE)
+    return _size;
+
+  return BlockClassSize(BlockClassIndex(_size));
+}
+
+//=========================
+// Statistics
+//=========================
+
+u32 Ice::GetBlockClassCount()
+{
+  return blockClassCount;
+}
+
+Ice::BlockClassStats Ice::GetBlockClassStats(u32 _classIndex)
+{
+  const BlockClass& c = blockClasses[_classIndex];
+
+  Ice::BlockClassStats stats;
+  stats.blockSize = BlockClassSize(_classIndex);
+  stats.slabCount = c.slabCount.load(std::memory_order_relaxed);
+  stats.blockCount = c.blockCount.load(std::memory_order_relaxed);
+  stats.usedCount = c.usedCount.load(std::memory_order_relaxed);
+  stats.requestedBytes = c.requestedBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+Ice::BlockAllocatorStats Ice::GetBlockAllocatorStats()
+{
+  Ice::BlockAllocatorStats stats {};
+
+  for (u32 i = 0; i < blockClassCount; i++)
+  {
+    Ice::BlockClassStats c = GetBlockClassStats(i);
+    stats.reservedBytes += c.slabCount * BlockSlabSize(i);
+    stats.usedBytes += c.usedCount * c.blockSize;
+    stats.requestedBytes += c.requestedBytes;
+  }
+
+  stats.internalFragmentation = stats.usedBytes - stats.requestedBytes;
+  stats.freeBytes = stats.reservedBytes - stats.usedBytes;
+  stats.fragmentationRatio = (stats.reservedBytes == 0) ? 0.0f
+    : 1.0f - ((f32)stats.requestedBytes / (f32)stats.reservedBytes);
+
+  return stats;
+}
+
+void Ice::BlockAllocatorPrintStats()
+{
+  Ice::BlockAllocatorStats total = GetBlockAllocatorStats();
+
+  IceLogInfoIn(Ice::Log_Category_Memory,
+               "Block allocator : %llu reserved, %llu used, %llu requested, %llu free, %llu rounding (%.1f%% fragmented)",
+               total.reservedBytes,
+               total.usedBytes,
+               total.requestedBytes,
+               total.freeBytes,
+               total.internalFragmentation,
+               total.fragmentationRatio * 100.0f);
+
+  for (u32 i = 0; i < blockClassCount; i++)
+  {
+    Ice::BlockClassStats c = GetBlockClassStats(i);
+    if (c.slabCount == 0)
+      continue;
+
+    IceLogInfoIn(Ice::Log_Category_Memory,
+                 "  %6llu B : %4llu slabs, %7llu / %7llu blocks used, %10llu requested",
+                 c.blockSize,
+                 c.slabCount,
+                 c.usedCount,
+                 c.blockCount,
+                 c.requestedBytes);
+  }
+}
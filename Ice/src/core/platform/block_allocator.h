@@ -0,0 +1,91 @@
+
+#ifndef ICE_PLATFORM_BLOCK_ALLOCATOR_H_
+#define ICE_PLATFORM_BLOCK_ALLOCATOR_H_
+
+#include "defines.h"
+
+#include "core/platform/platform.h"
+
+namespace Ice {
+
+//=========================
+// Block allocator
+//=========================
+// Serves small allocations from fixed-size blocks grouped into size classes.
+// Each class carves blocks out of large slabs and recycles them through a free list, so
+//   allocation and release are constant-time pops and pushes once a class has warmed up.
+// Each thread keeps a small cache per class, refilled from and flushed to the shared free
+//   lists in batches, so most calls never touch shared state.
+// Slabs are kept for the lifetime of the process.
+
+// Requests larger than this bypass the size classes and go to the system heap
+#define ICE_BLOCK_MAX_SIZE (32 * 1024)
+// Every block is aligned to at least this many bytes
+#define ICE_BLOCK_ALIGNMENT 16
+
+// Returns memory for at least _size bytes, or nullptr if _size is 0 or the memory can't be allocated
+// _tag : Subsystem credited with the allocation in the memory statistics
+void* BlockAllocate(u64 _size, Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown);
+
+inline void* BlockAllocateZero(u64 _size, Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown)
+{
+  void* block = BlockAllocate(_size, _tag);
+  if (block != nullptr)
+  {
+    Ice::MemoryZero(block, _size);
+  }
+  return block;
+}
+
+// _size and _tag must match the values given to BlockAllocate
+void BlockFree(void* _block, u64 _size, Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown);
+// Resizes a block only if it can be done without moving it (same size class, or a large
+//   allocation growing within its reservation). Returns false, leaving the block untouched, otherwise
+b8 BlockResizeInPlace(void* _block,
+                      u64 _oldSize,
+                      u64 _newSize,
+                      Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown);
+// Resizes a block, copying min(_oldSize, _newSize) bytes when the block must move
+// Returns nullptr, leaving the old block valid, if the new block can't be allocated
+void* BlockReallocate(void* _block,
+                      u64 _oldSize,
+                      u64 _newSize,
+                      Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown);
+
+// Pre-allocates slabs so that _count blocks of _size are available without creating slabs later
+void BlockReserve(u64 _size, u32 _count);
+
+// Size of the block that would serve a _size byte request (or _size if it bypasses the classes)
+u64 BlockSizeFor(u64 _size);
+
+struct BlockClassStats
+{
+  u64 blockSize;
+  u64 slabCount;
+  u64 blockCount;     // Blocks carved from this class's slabs
+  u64 usedCount;      // Blocks currently handed out
+  u64 requestedBytes; // Bytes requested by the blocks currently handed out
+};
+
+struct BlockAllocatorStats
+{
+  u64 reservedBytes; // Bytes held in slabs
+  u64 usedBytes;     // Bytes in blocks currently handed out
+  u64 requestedBytes;
+
+  // Bytes lost to rounding requests up to their block size
+  u64 internalFragmentation;
+  // Bytes in slabs not currently handed out
+  u64 freeBytes;
+  // Share of reserved bytes not holding requested data [0, 1]
+  f32 fragmentationRatio;
+};
+
+u32 GetBlockClassCount();
+Ice::BlockClassStats GetBlockClassStats(u32 _classIndex);
+Ice::BlockAllocatorStats GetBlockAllocatorStats();
+void BlockAllocatorPrintStats();
+
+} // namespace Ice
+
+#endif // !ICE_PLATFORM_BLOCK_ALLOCATOR_H_
@@ -5,32 +5,260 @@
 #include "defines.h"
 
 #include "core/platform/platform.h"
+#include "tools/logger.h"
+
+#include <vector>
 
 namespace Ice {
 
+//=========================
+// Memory pool
+//=========================
+// Linear (bump) arena
+// Allocations advance an offset into one block and are never individually freed.
+// Memory is reclaimed by rolling back to a marker, or all at once with Reset.
+// Not thread-safe; each pool should be owned by a single thread.
+
 class MemoryPool
 {
 private:
-  u32 poolSize = 0;
-  void* data = nullptr;
+  u64 poolSize = 0;
+  u64 offset = 0;
+  u64 peakOffset = 0;
+  u8* data = nullptr;
+  Ice::MemoryTags memoryTag = Ice::Memory_Tag_Unknown;
 
 public:
+  MemoryPool() {}
+
   // _size : Size of the pool in bytes
-  MemoryPool(u64 _size)
+  MemoryPool(u64 _size, Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown)
   {
-    poolSize = _size;
-    data = Ice::MemoryAllocate(_size);
+    Initialize(_size, _tag);
   }
 
   ~MemoryPool()
   {
-    Ice::MemoryFree(data);
+    Shutdown();
+  }
+
+  MemoryPool(const MemoryPool&) = delete;
+  MemoryPool& operator=(const MemoryPool&) = delete;
+
+  // _size : Size of the pool in bytes
+  b8 Initialize(u64 _size, Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown)
+  {
+    Shutdown();
+
+    memoryTag = _tag;
+    data = (u8*)Ice::MemoryAllocate(_size, memoryTag);
+    if (data == nullptr)
+    {
+      IceLogErrorIn(Ice::Log_Category_Memory, "Failed to allocate a %llu byte memory pool", _size);
+      return false;
+    }
+
+    poolSize = _size;
+    offset = 0;
+    peakOffset = 0;
+    return true;
+  }
+
+  void Shutdown()
+  {
+    if (data != nullptr)
+    {
+      Ice::MemoryFree(data);
+    }
+
+    data = nullptr;
+    poolSize = 0;
+    offset = 0;
+    peakOffset = 0;
+  }
+
+  // Returns nullptr if the pool cannot fit the allocation
+  // _alignment : Must be a power of two
+  void* Allocate(u64 _size, u64 _alignment = 16)
+  {
+    ICE_ASSERT((_alignment & (_alignment - 1)) == 0);
+
+    u64 base = (u64)data;
+    u64 aligned = (base + offset + _alignment - 1) & ~(_alignment - 1);
+    u64 newOffset = aligned - base + _size;
+
+    if (data == nullptr || newOffset > poolSize)
+    {
+      return nullptr;
+    }
+
+    offset = newOffset;
+    peakOffset = (offset > peakOffset) ? offset : peakOffset;
+    return (void*)aligned;
+  }
+
+  // Uninitialized storage for _count elements of T
+  template<typename T>
+  T* Allocate(u64 _count = 1)
+  {
+    return (T*)Allocate(sizeof(T) * _count, alignof(T));
+  }
+
+  // Captures the current position to later roll back to with FreeToMarker
+  u64 GetMarker() const
+  {
+    return offset;
+  }
+
+  // Releases every allocation made since _marker was captured
+  void FreeToMarker(u64 _marker)
+  {
+    ICE_ASSERT(_marker <= offset);
+    offset = _marker;
+  }
+
+  // Releases every allocation
+  void Reset()
+  {
+    offset = 0;
+  }
+
+  b8 Owns(const void* _pointer) const
+  {
+    return (const u8*)_pointer >= data && (const u8*)_pointer < data + poolSize;
+  }
+
+  Ice::MemoryTags GetMemoryTag() const { return memoryTag; }
+  u64 GetSize() const { return poolSize; }
+  u64 GetUsedSize() const { return offset; }
+  u64 GetPeakUsedSize() const { return peakOffset; }
+};
+
+// Reset at the start of every frame; anything allocated from it only lives until the next frame
+extern Ice::MemoryPool frameMemory;
+
+//=========================
+// Scratch memory
+//=========================
+
+#ifndef ICE_THREAD_SCRATCH_SIZE
+#define ICE_THREAD_SCRATCH_SIZE (1024 * 1024)
+#endif // !ICE_THREAD_SCRATCH_SIZE
+
+// Per-thread stack for temporaries that do not outlive the function using them
+// Every use should be enclosed in a ScratchScope so the memory is returned on exit
+inline Ice::MemoryPool& GetThreadScratch()
+{
+  thread_local Ice::MemoryPool scratch(ICE_THREAD_SCRATCH_SIZE, Ice::Memory_Tag_Scratch);
+  return scratch;
+}
+
+// Rolls a pool back to where it was when the scope was entered
+class ScratchScope
+{
+private:
+  Ice::MemoryPool* pool;
+  u64 marker;
+
+public:
+  ScratchScope(Ice::MemoryPool* _pool = &Ice::GetThreadScratch())
+  {
+    pool = _pool;
+    marker = pool->GetMarker();
   }
 
+  ~ScratchScope()
+  {
+    pool->FreeToMarker(marker);
+  }
+
+  ScratchScope(const ScratchScope&) = delete;
+  ScratchScope& operator=(const ScratchScope&) = delete;
+};
+
+//=========================
+// STL adaptors
+//=========================
+
+// Allocates from a MemoryPool, falling back to the system heap once the pool is exhausted
+// Deallocation is a no-op for pool memory; it is reclaimed when the pool is reset
+template<typename T>
+class PoolAllocator
+{
+public:
+  using value_type = T;
+
+  Ice::MemoryPool* pool = nullptr;
 
+  PoolAllocator(Ice::MemoryPool* _pool) : pool(_pool) {}
 
+  template<typename U>
+  PoolAllocator(const PoolAllocator<U>& _other) : pool(_other.pool) {}
+
+  T* allocate(size_t _count)
+  {
+    void* memory = pool->Allocate(sizeof(T) * _count, alignof(T));
+    if (memory == nullptr)
+    {
+      memory = Ice::MemoryAllocate(sizeof(T) * _count, pool->GetMemoryTag());
+      ICE_ASSERT(memory != nullptr);
+    }
+
+    return (T*)memory;
+  }
+
+  void deallocate(T* _pointer, size_t _count)
+  {
+    if (!pool->Owns(_pointer))
+    {
+      Ice::MemoryFree(_pointer);
+    }
+  }
+
+  template<typename U>
+  bool operator==(const PoolAllocator<U>& _other) const { return pool == _other.pool; }
+  template<typename U>
+  bool operator!=(const PoolAllocator<U>& _other) const { return pool != _other.pool; }
+};
+
+// Allocates from the per-frame pool
+template<typename T>
+class FrameAllocator : public PoolAllocator<T>
+{
+public:
+  template<typename U>
+  struct rebind { using other = FrameAllocator<U>; };
+
+  FrameAllocator() : PoolAllocator<T>(&Ice::frameMemory) {}
+
+  template<typename U>
+  FrameAllocator(const FrameAllocator<U>& _other) : PoolAllocator<T>(_other.pool) {}
+};
+
+// A vector whose storage is released when the frame ends
+// Must not be held across frames
+template<typename T>
+using FrameVector = std::vector<T, Ice::FrameAllocator<T>>;
+
+// Allocates from the calling thread's scratch pool
+template<typename T>
+class ScratchAllocator : public PoolAllocator<T>
+{
+public:
+  template<typename U>
+  struct rebind { using other = ScratchAllocator<U>; };
+
+  ScratchAllocator() : PoolAllocator<T>(&Ice::GetThreadScratch()) {}
+
+  template<typename U>
+  ScratchAllocator(const ScratchAllocator<U>& _other) : PoolAllocator<T>(_other.pool) {}
 };
 
+// A vector whose storage is released by the enclosing ScratchScope
+// Must be destroyed before that scope ends
+template<typename T>
+using ScratchVector = std::vector<T, Ice::ScratchAllocator<T>>;
+
 } // namespace Ice
 
 #endif // !ICE_PLATFORM_MEMORY_POOL_H_
@@ -21,20 +21,55 @@ namespace Ice {
   //=========================
   // Memory
   //=========================
-  void* MemoryAllocate(u64 _size);
+  // Every allocation is attributed to _tag in the memory statistics
+  void* MemoryAllocate(u64 _size, Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown);
   void MemorySet(void* _data, u64 _size, u8 _value);
   void MemoryCopy(void* _source, void* _destination, u64 _size);
   void MemoryFree(void* _data);
+  // The reallocated memory keeps its original tag
   void* MemoryReallocate(void* _data, u64 _newSize);
+  // Resizes an allocation only if it can be done without moving it
+  // Returns false (leaving the allocation untouched) otherwise
+  b8 MemoryResizeInPlace(void* _data, u64 _newSize);
 
   inline void MemoryZero(void* _data, u64 _size) { MemorySet(_data, _size, 0); }
-  inline void* MemoryAllocZero(u64 _size)
+  inline void* MemoryAllocZero(u64 _size, Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown)
   {
-    void* m = MemoryAllocate(_size);
+    void* m = MemoryAllocate(_size, _tag);
     MemoryZero(m, _size);
     return m;
   }
 
+  // Large allocations =====
+  // Reserves _reserveSize bytes of address space and commits the first _size
+  // The allocation can later grow up to _reserveSize without moving (MemoryResizeInPlace or
+  //   MemoryReallocate) and is released with MemoryFree
+  void* MemoryAllocateLarge(u64 _size,
+                            u64 _reserveSize,
+                            Ice::MemoryTags _tag = Ice::Memory_Tag_Unknown,
+                            Ice::MemoryLargeFlags _flags = 0);
+  // Hints how a range will be used
+  // Will_Need covers every page the range touches, Dont_Need only pages entirely within it
+  void MemoryAdvise(void* _data, u64 _size, Ice::MemoryAdvice _advice);
+
+  // Statistics =====
+  // Credits memory handed out by sub-allocators (which draw from their own tagged reserves) to _tag
+  void MemoryTrackAllocation(u64 _size, Ice::MemoryTags _tag);
+  void MemoryTrackFree(u64 _size, Ice::MemoryTags _tag);
+
+  const char* MemoryTagName(Ice::MemoryTags _tag);
+  Ice::MemoryTagStats GetMemoryStats(Ice::MemoryTags _tag);
+  // Sums the statistics of every tag except Memory_Tag_Block_Allocator, whose slabs are
+  //   already counted through the tags of the blocks within them
+  Ice::MemoryTagStats GetMemoryStatsTotal();
+  // Begins a new frame for the per-frame allocation counts
+  void MemoryBeginFrame();
+  void MemoryPrintStats();
+  // Logs every tag with live allocations and the tags allocating most often
+  // _ignoredTags : Mask of (1 << tag) for tags whose memory is expected to outlive the report
+  // Returns false if any non-ignored allocations are still live
+  b8 MemoryReportLeaks(u32 _ignoredTags = 0);
+
   //=========================
   // Console
   //=========================
@@ -14,6 +14,55 @@
 
 namespace Ice {
 
+//=========================
+// Memory
+//=========================
+
+// Identifies the subsystem that owns an allocation for memory statistics
+enum MemoryTags
+{
+  Memory_Tag_Unknown,
+  Memory_Tag_Platform,
+  Memory_Tag_Logger,
+  Memory_Tag_Ecs,
+  Memory_Tag_Container,
+  Memory_Tag_Renderer,
+  Memory_Tag_Asset,
+  Memory_Tag_Frame,
+  Memory_Tag_Scratch,
+  Memory_Tag_Block_Allocator, // Slabs reserved by the block allocator, whose blocks are counted by their users' tags
+  Memory_Tag_Count
+};
+
+struct MemoryTagStats
+{
+  u64 liveBytes;       // Bytes currently allocated
+  u64 peakBytes;       // Highest liveBytes has reached
+  u64 liveCount;       // Allocations not yet freed
+  u64 totalCount;      // Allocations made since startup
+  u64 frameCount;      // Allocations made since the start of the frame
+  u64 peakFrameCount;  // Highest frameCount has reached in a single frame
+};
+
+// Requests of at least this size get their own reserved range of virtual memory
+#define ICE_MEMORY_LARGE_THRESHOLD (1024 * 1024)
+// Large allocations made through MemoryAllocate reserve this many times their size to grow into
+#define ICE_MEMORY_LARGE_RESERVE_FACTOR 8
+
+enum MemoryLargeFlagBits
+{
+  // Back the range with large pages when the process holds the lock-pages privilege
+  // Large pages are committed up front for the whole reservation and cannot be paged out
+  Memory_Large_Pages = 0x01,
+};
+typedef u32 MemoryLargeFlags;
+
+enum MemoryAdvice
+{
+  Memory_Advice_Will_Need, // Fault the range in ahead of use
+  Memory_Advice_Dont_Need, // Contents may be discarded; the range stays committed and usable
+};
+
 //=========================
 // Window
 //=========================
@@ -2,15 +2,19 @@
 #include "defines.h"
 #include "core/platform/platform.h"
 #include "core/platform/platform_defines.h"
+#include "core/platform/block_allocator.h"
 #include "core/input.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+#include <atomic>
 #include <vector>
 #include <fstream>
 #include <string>
 #include <stdlib.h>
+#include <malloc.h>
+#include <stddef.h>
 #include <windows.h>
 #include <windowsx.h>
 
@@ -18,11 +22,277 @@
 // Memory
 //=========================
 
-void* Ice::MemoryAllocate(u64 _size)
+enum MemorySources
 {
-  if (_size > 0)
-    return malloc(_size);
-  return nullptr;
+  Memory_Source_Heap,
+  Memory_Source_Blocks,
+  Memory_Source_Virtual, // A reserved range of its own, led by a MemoryLargeHeader
+};
+
+// Precedes every allocation so it can be un-counted from the right tag when freed
+// 16 bytes keeps the returned memory at malloc's (and the block allocator's) alignment
+struct MemoryHeader
+{
+  u64 size;
+  u32 tag;
+  u32 source;
+};
+
+// Starts the range of a large allocation, directly followed by its MemoryHeader
+struct MemoryLargeHeader
+{
+  u64 reservedSize;  // Bytes of address space, including both headers
+  u64 committedSize; // Bytes committed from the start of the range
+  u32 flags;
+  u32 padding[3];
+  MemoryHeader header;
+};
+static_assert(sizeof(MemoryLargeHeader) % 16 == 0, "Large allocations must stay 16-byte aligned");
+
+// Bytes credited to an allocation's tag : the requested size and its MemoryHeader
+// Matches what the block allocator counts for the allocations it serves, so every source compares
+inline u64 MemoryCountedSize(u64 _size)
+{
+  return sizeof(MemoryHeader) + _size;
+}
+
+struct MemoryTagCounters
+{
+  std::atomic<u64> liveBytes;
+  std::atomic<u64> peakBytes;
+  std::atomic<u64> liveCount;
+  std::atomic<u64> totalCount;
+  std::atomic<u64> frameCount;
+  std::atomic<u64> peakFrameCount;
+};
+
+// Lock-free and zero-initialized before any static constructor can allocate
+MemoryTagCounters memoryCounters[Ice::Memory_Tag_Count];
+
+void AtomicMax(std::atomic<u64>& _value, u64 _candidate)
+{
+  u64 current = _value.load(std::memory_order_relaxed);
+  while (_candidate > current
+         && !_value.compare_exchange_weak(current, _candidate, std::memory_order_relaxed))
+  {}
+}
+
+void MemoryCountAllocation(u32 _tag, u64 _size, b8 _isNew)
+{
+  MemoryTagCounters& counters = memoryCounters[_tag];
+
+  u64 live = counters.liveBytes.fetch_add(_size, std::memory_order_relaxed) + _size;
+  AtomicMax(counters.peakBytes, live);
+
+  if (_isNew)
+  {
+    counters.liveCount.fetch_add(1, std::memory_order_relaxed);
+  }
+  counters.totalCount.fetch_add(1, std::memory_order_relaxed);
+  counters.frameCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryCountFree(u32 _tag, u64 _size, b8 _isReleased)
+{
+  MemoryTagCounters& counters = memoryCounters[_tag];
+
+  counters.liveBytes.fetch_sub(_size, std::memory_order_relaxed);
+  if (_isReleased)
+  {
+    counters.liveCount.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+// Small allocations are served by the block allocator, which does its own tag accounting
+inline b8 MemoryUsesBlocks(u64 _size)
+{
+  return sizeof(MemoryHeader) + _size <= ICE_BLOCK_MAX_SIZE;
+}
+
+// _alignment must be a power of two
+inline u64 MemoryRoundUp(u64 _value, u64 _alignment)
+{
+  return (_value + _alignment - 1) & ~(_alignment - 1);
+}
+
+u64 MemoryQueryPageSize()
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (u64)info.dwPageSize;
+}
+
+u64 MemoryPageSize()
+{
+  static const u64 pageSize = MemoryQueryPageSize();
+  return pageSize;
+}
+
+// Large pages need the lock-pages privilege enabled on the process token
+// Returns the large page size, or 0 if they are unavailable
+u64 MemoryEnableLargePages()
+{
+  HANDLE token;
+  if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+    return 0;
+
+  TOKEN_PRIVILEGES privileges {};
+  privileges.PrivilegeCount = 1;
+  privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+  // AdjustTokenPrivileges succeeds without enabling anything if the account lacks the privilege
+  b8 enabled = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid)
+               && AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+               && GetLastError() == ERROR_SUCCESS;
+  CloseHandle(token);
+
+  if (!enabled)
+  {
+    IceLogWarningIn(Ice::Log_Category_Memory,
+                    "Large pages unavailable (lock-pages privilege not held) -- using regular pages");
+    return 0;
+  }
+
+  return (u64)GetLargePageMinimum();
+}
+
+u64 MemoryLargePageSize()
+{
+  static const u64 largePageSize = MemoryEnableLargePages();
+  return largePageSize;
+}
+
+MemoryLargeHeader* MemoryGetLargeHeader(MemoryHeader* _header)
+{
+  return (MemoryLargeHeader*)((u8*)_header - offsetof(MemoryLargeHeader, header));
+}
+
+// Commits or decommits the tail of a large allocation's range to fit _newSize
+b8 MemoryResizeLarge(MemoryLargeHeader* _large, u64 _newSize)
+{
+  u64 requiredSize = MemoryRoundUp(sizeof(MemoryLargeHeader) + _newSize, MemoryPageSize());
+  if (requiredSize > _large->reservedSize)
+    return false;
+
+  // Large pages are committed for the whole reservation up front
+  if (!(_large->flags & Ice::Memory_Large_Pages))
+  {
+    u8* base = (u8*)_large;
+    if (requiredSize > _large->committedSize)
+    {
+      if (VirtualAlloc(base + _large->committedSize,
+                       requiredSize - _large->committedSize,
+                       MEM_COMMIT,
+                       PAGE_READWRITE) == nullptr)
+      {
+        return false;
+      }
+    }
+    else if (requiredSize < _large->committedSize)
+    {
+      VirtualFree(base + requiredSize, _large->committedSize - requiredSize, MEM_DECOMMIT);
+    }
+    _large->committedSize = requiredSize;
+  }
+
+  MemoryHeader& header = _large->header;
+  MemoryCountFree(header.tag, MemoryCountedSize(header.size), false);
+  MemoryCountAllocation(header.tag, MemoryCountedSize(_newSize), false);
+  header.size = _newSize;
+
+  return true;
+}
+
+void* Ice::MemoryAllocate(u64 _size, Ice::MemoryTags _tag /*= Memory_Tag_Unknown*/)
+{
+  if (_size == 0)
+    return nullptr;
+
+  MemoryHeader* header;
+  if (MemoryUsesBlocks(_size))
+  {
+    header = (MemoryHeader*)Ice::BlockAllocate(MemoryCountedSize(_size), _tag);
+    if (header == nullptr)
+      return nullptr;
+
+    header->source = Memory_Source_Blocks;
+  }
+  else if (_size >= ICE_MEMORY_LARGE_THRESHOLD)
+  {
+    return MemoryAllocateLarge(_size, _size * ICE_MEMORY_LARGE_RESERVE_FACTOR, _tag);
+  }
+  else
+  {
+    header = (MemoryHeader*)malloc(sizeof(MemoryHeader) + _size);
+    if (header == nullptr)
+      return nullptr;
+
+    header->source = Memory_Source_Heap;
+    MemoryCountAllocation((u32)_tag, MemoryCountedSize(_size), true);
+  }
+
+  header->size = _size;
+  header->tag = (u32)_tag;
+
+  return header + 1;
+}
+
+void* Ice::MemoryAllocateLarge(u64 _size,
+                               u64 _reserveSize,
+                               Ice::MemoryTags _tag /*= Memory_Tag_Unknown*/,
+                               Ice::MemoryLargeFlags _flags /*= 0*/)
+{
+  if (_size == 0)
+    return nullptr;
+
+  u64 pageSize = MemoryPageSize();
+  u64 commitSize = MemoryRoundUp(sizeof(MemoryLargeHeader) + _size, pageSize);
+  u64 reserveSize = MemoryRoundUp(sizeof(MemoryLargeHeader) + max(_size, _reserveSize), pageSize);
+
+  MemoryLargeHeader* large = nullptr;
+  if (_flags & Memory_Large_Pages)
+  {
+    u64 largePageSize = MemoryLargePageSize();
+    if (largePageSize != 0)
+    {
+      reserveSize = MemoryRoundUp(reserveSize, largePageSize);
+      large = (MemoryLargeHeader*)VirtualAlloc(nullptr,
+                                               reserveSize,
+                                               MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                               PAGE_READWRITE);
+      commitSize = reserveSize;
+    }
+
+    // Physical memory may be too fragmented to find contiguous large pages
+    if (large == nullptr)
+    {
+      _flags &= ~Memory_Large_Pages;
+      commitSize = MemoryRoundUp(sizeof(MemoryLargeHeader) + _size, pageSize);
+    }
+  }
+
+  if (large == nullptr)
+  {
+    large = (MemoryLargeHeader*)VirtualAlloc(nullptr, reserveSize, MEM_RESERVE, PAGE_NOACCESS);
+    if (large == nullptr)
+      return nullptr;
+
+    if (VirtualAlloc(large, commitSize, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+    {
+      VirtualFree(large, 0, MEM_RELEASE);
+      return nullptr;
+    }
+  }
+
+  large->reservedSize = reserveSize;
+  large->committedSize = commitSize;
+  large->flags = _flags;
+  large->header.size = _size;
+  large->header.tag = (u32)_tag;
+  large->header.source = Memory_Source_Virtual;
+  MemoryCountAllocation((u32)_tag, MemoryCountedSize(_size), true);
+
+  return &large->header + 1;
 }
 
 void Ice::MemorySet(void* _data, u64 _size, u8 _value)
@@ -37,15 +307,283 @@ void Ice::MemoryCopy(void* _source, void* _destination, u64 _size)
 
 void Ice::MemoryFree(void* _data)
 {
-  if (_data != nullptr)
-    free(_data);
+  if (_data == nullptr)
+    return;
+
+  MemoryHeader* header = (MemoryHeader*)_data - 1;
+  switch (header->source)
+  {
+  case Memory_Source_Blocks:
+  {
+    Ice::BlockFree(header, MemoryCountedSize(header->size), (Ice::MemoryTags)header->tag);
+  } break;
+  case Memory_Source_Virtual:
+  {
+    MemoryCountFree(header->tag, MemoryCountedSize(header->size), true);
+    VirtualFree(MemoryGetLargeHeader(header), 0, MEM_RELEASE);
+  } break;
+  default:
+  {
+    MemoryCountFree(header->tag, MemoryCountedSize(header->size), true);
+    free(header);
+  } break;
+  }
+}
+
+b8 Ice::MemoryResizeInPlace(void* _data, u64 _newSize)
+{
+  if (_data == nullptr || _newSize == 0)
+    return false;
+
+  MemoryHeader* header = (MemoryHeader*)_data - 1;
+  u64 oldSize = header->size;
+
+  switch (header->source)
+  {
+  case Memory_Source_Blocks:
+  {
+    if (!MemoryUsesBlocks(_newSize)
+        || !Ice::BlockResizeInPlace(header,
+                                    MemoryCountedSize(oldSize),
+                                    MemoryCountedSize(_newSize),
+                                    (Ice::MemoryTags)header->tag))
+    {
+      return false;
+    }
+
+    header->size = _newSize;
+    return true;
+  }
+  case Memory_Source_Virtual:
+  {
+    return MemoryResizeLarge(MemoryGetLargeHeader(header), _newSize);
+  }
+  default:
+  {
+    if (MemoryUsesBlocks(_newSize) || _expand(header, sizeof(MemoryHeader) + _newSize) == nullptr)
+      return false;
+
+    header->size = _newSize;
+    MemoryCountFree(header->tag, MemoryCountedSize(oldSize), false);
+    MemoryCountAllocation(header->tag, MemoryCountedSize(_newSize), false);
+    return true;
+  }
+  }
 }
 
 void* Ice::MemoryReallocate(void* _data, u64 _newSize)
 {
-  if (_newSize > 0)
-    return realloc(_data, _newSize);
-  return _data;
+  if (_newSize == 0)
+    return _data;
+  if (_data == nullptr)
+    return MemoryAllocate(_newSize);
+
+  if (MemoryResizeInPlace(_data, _newSize))
+    return _data;
+
+  MemoryHeader* header = (MemoryHeader*)_data - 1;
+  u64 oldSize = header->size;
+
+  if (header->source != Memory_Source_Heap
+      || MemoryUsesBlocks(_newSize)
+      || _newSize >= ICE_MEMORY_LARGE_THRESHOLD)
+  {
+    void* newData = MemoryAllocate(_newSize, (Ice::MemoryTags)header->tag);
+    if (newData == nullptr)
+      return nullptr;
+
+    MemoryCopy(_data, newData, min(oldSize, _newSize));
+    MemoryFree(_data);
+    return newData;
+  }
+
+  header = (MemoryHeader*)realloc(header, sizeof(MemoryHeader) + _newSize);
+  if (header == nullptr)
+    return nullptr; // The original allocation is untouched
+
+  header->size = _newSize;
+  MemoryCountFree(header->tag, MemoryCountedSize(oldSize), false);
+  MemoryCountAllocation(header->tag, MemoryCountedSize(_newSize), false);
+
+  return header + 1;
+}
+
+void Ice::MemoryAdvise(void* _data, u64 _size, Ice::MemoryAdvice _advice)
+{
+  u64 pageSize = MemoryPageSize();
+
+  switch (_advice)
+  {
+  case Memory_Advice_Will_Need:
+  {
+    // Every page touching the range
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = (void*)((u64)_data & ~(pageSize - 1));
+    range.NumberOfBytes = MemoryRoundUp((u64)_data + _size, pageSize) - (u64)range.VirtualAddress;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+  } break;
+  case Memory_Advice_Dont_Need:
+  {
+    // Only pages entirely within the range, as neighbouring data may share the edge pages
+    u64 start = MemoryRoundUp((u64)_data, pageSize);
+    u64 end = ((u64)_data + _size) & ~(pageSize - 1);
+    if (end > start)
+    {
+      DiscardVirtualMemory((void*)start, end - start);
+    }
+  } break;
+  default: break;
+  }
+}
+
+void Ice::MemoryTrackAllocation(u64 _size, Ice::MemoryTags _tag)
+{
+  MemoryCountAllocation((u32)_tag, _size, true);
+}
+
+void Ice::MemoryTrackFree(u64 _size, Ice::MemoryTags _tag)
+{
+  MemoryCountFree((u32)_tag, _size, true);
+}
+
+const char* Ice::MemoryTagName(Ice::MemoryTags _tag)
+{
+  switch (_tag)
+  {
+  case Memory_Tag_Unknown: return "Unknown";
+  case Memory_Tag_Platform: return "Platform";
+  case Memory_Tag_Logger: return "Logger";
+  case Memory_Tag_Ecs: return "Ecs";
+  case Memory_Tag_Container: return "Container";
+  case Memory_Tag_Renderer: return "Renderer";
+  case Memory_Tag_Asset: return "Asset";
+  case Memory_Tag_Frame: return "Frame";
+  case Memory_Tag_Scratch: return "Scratch";
+  case Memory_Tag_Block_Allocator: return "Blocks";
+  default: return "Invalid";
+  }
+}
+
+Ice::MemoryTagStats Ice::GetMemoryStats(Ice::MemoryTags _tag)
+{
+  const MemoryTagCounters& counters = memoryCounters[_tag];
+
+  Ice::MemoryTagStats stats;
+  stats.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+  stats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+  stats.liveCount = counters.liveCount.load(std::memory_order_relaxed);
+  stats.totalCount = counters.totalCount.load(std::memory_order_relaxed);
+  stats.frameCount = counters.frameCount.load(std::memory_order_relaxed);
+  stats.peakFrameCount = max(counters.peakFrameCount.load(std::memory_order_relaxed), stats.frameCount);
+  return stats;
+}
+
+Ice::MemoryTagStats Ice::GetMemoryStatsTotal()
+{
+  Ice::MemoryTagStats total {};
+  for (u32 i = 0; i < Memory_Tag_Count; i++)
+  {
+    if (i == Memory_Tag_Block_Allocator)
+      continue;
+
+    Ice::MemoryTagStats stats = GetMemoryStats((Ice::MemoryTags)i);
+    total.liveBytes += stats.liveBytes;
+    total.peakBytes += stats.peakBytes; // Upper bound; tags do not necessarily peak together
+    total.liveCount += stats.liveCount;
+    total.totalCount += stats.totalCount;
+    total.frameCount += stats.frameCount;
+    total.peakFrameCount += stats.peakFrameCount;
+  }
+  return total;
+}
+
+void Ice::MemoryBeginFrame()
+{
+  for (u32 i = 0; i < Memory_Tag_Count; i++)
+  {
+    AtomicMax(memoryCounters[i].peakFrameCount,
+              memoryCounters[i].frameCount.exchange(0, std::memory_order_relaxed));
+  }
+}
+
+void Ice::MemoryPrintStats()
+{
+  // Snapshot before logging so the logger's own allocations don't skew the output
+  Ice::MemoryTagStats stats[Memory_Tag_Count];
+  for (u32 i = 0; i < Memory_Tag_Count; i++)
+  {
+    stats[i] = GetMemoryStats((Ice::MemoryTags)i);
+  }
+
+  IceLogInfoIn(Ice::Log_Category_Memory,
+               "Memory usage :\n%-10s %14s %14s %10s %12s %12s",
+               "Tag", "Live bytes", "Peak bytes", "Live", "Total", "Peak/frame");
+  for (u32 i = 0; i < Memory_Tag_Count; i++)
+  {
+    IceLogInfoIn(Ice::Log_Category_Memory,
+                 "%-10s %14llu %14llu %10llu %12llu %12llu",
+                 MemoryTagName((Ice::MemoryTags)i),
+                 stats[i].liveBytes,
+                 stats[i].peakBytes,
+                 stats[i].liveCount,
+                 stats[i].totalCount,
+                 stats[i].peakFrameCount);
+  }
+}
+
+b8 Ice::MemoryReportLeaks(u32 _ignoredTags /*= 0*/)
+{
+  Ice::MemoryTagStats stats[Memory_Tag_Count];
+  for (u32 i = 0; i < Memory_Tag_Count; i++)
+  {
+    stats[i] = GetMemoryStats((Ice::MemoryTags)i);
+  }
+
+  // Leaks =====
+  b8 clean = true;
+  for (u32 i = 0; i < Memory_Tag_Count; i++)
+  {
+    if (stats[i].liveCount > 0 && !(_ignoredTags & (1 << i)))
+    {
+      IceLogWarningIn(Ice::Log_Category_Memory,
+                      "Memory leak : %s has %llu live allocations (%llu bytes)",
+                      MemoryTagName((Ice::MemoryTags)i),
+                      stats[i].liveCount,
+                      stats[i].liveBytes);
+      clean = false;
+    }
+  }
+
+  // Hotspots =====
+  // The tags responsible for the most heap traffic, busiest first
+  const u32 hotspotCount = 3;
+  b8 reported[Memory_Tag_Count] = {};
+  for (u32 rank = 0; rank < hotspotCount; rank++)
+  {
+    u32 busiest = Memory_Tag_Count;
+    for (u32 i = 0; i < Memory_Tag_Count; i++)
+    {
+      if (!reported[i] && stats[i].totalCount > 0
+          && (busiest == Memory_Tag_Count || stats[i].totalCount > stats[busiest].totalCount))
+      {
+        busiest = i;
+      }
+    }
+
+    if (busiest == Memory_Tag_Count)
+      break;
+
+    reported[busiest] = true;
+    IceLogInfoIn(Ice::Log_Category_Memory,
+                 "Memory hotspot %u : %s -- %llu allocations, peak %llu in one frame, peak %llu bytes",
+                 rank + 1,
+                 MemoryTagName((Ice::MemoryTags)busiest),
+                 stats[busiest].totalCount,
+                 stats[busiest].peakFrameCount,
+                 stats[busiest].peakBytes);
+  }
+
+  return clean;
 }
 
 //=========================
@@ -77,7 +615,7 @@ std::vector<char> Ice::LoadFile(const char* _directory)
   inFile.open(_directory, std::ios::ate | std::ios::binary);
   if (!inFile)
   {
-    IceLogWarning("Failed to load file\n> '%s'", _directory);
+    IceLogWarningIn(Ice::Log_Category_Asset, "Failed to load file\n> '%s'", _directory);
     return {};
   }
 
@@ -159,7 +697,7 @@ b8 Ice::Platform::CreateNewWindow(Ice::WindowSettings _settings)
 
   if (!RegisterWindow(&window))
   {
-    IceLogError("Failed to register the window");
+    IceLogErrorIn(Ice::Log_Category_Platform, "Failed to register the window");
     return false;
   }
   PlatformAdjustWindowForBorder(&window);
@@ -180,7 +718,7 @@ b8 Ice::Platform::CreateNewWindow(Ice::WindowSettings _settings)
 
   if (window.platformData.hwnd == 0)
   {
-    IceLogFatal("Failed to create the window");
+    IceLogFatalIn(Ice::Log_Category_Platform, "Failed to create the window");
     return false;
   }
 
@@ -197,7 +735,7 @@ b8 Ice::Platform::CreateNewWindow(Ice::WindowSettings _settings)
   Rid.dwFlags = RIDEV_INPUTSINK;
   Rid.hwndTarget = window.platformData.hwnd;
   ICE_ATTEMPT(RegisterRawInputDevices(&Rid, 1, sizeof(Rid)));
-  IceLogInfo("mouse registerd");
+  IceLogInfoIn(Ice::Log_Category_Platform, "mouse registerd");
 
   // Show the window
   b32 shouldActivate = 1;
@@ -226,7 +764,7 @@ b8 RegisterWindow(Ice::Window* _window)
 
   if (!RegisterClassA(&wc))
   {
-    IceLogFatal("Window registration failed");
+    IceLogFatalIn(Ice::Log_Category_Platform, "Window registration failed");
     return false;
   }
 
@@ -53,6 +53,9 @@ struct TimeStruct
   f32 timeSinceStart;    // wall-time in seconds since the application started
   f32 deltaTime;  // Time in seconds taken by the previous tick
   u32 frameCount; // Number of frames rendered before this tick
+
+  f32 fixedDeltaTime;     // Time in seconds simulated by each fixed tick (0 when ticking per frame)
+  f32 interpolationAlpha; // Fraction of a fixed tick left unsimulated at render time
 };
 extern Ice::TimeStruct time;
 
@@ -7,6 +7,7 @@
 #include "math/matrix.hpp"
 
 #include "math.h"
+#include <xmmintrin.h>
 
 namespace Ice {
 
@@ -241,8 +242,31 @@ typedef struct quaternion
     return *this;
   }
 
+  // Normalizes with an approximate reciprocal square root refined by one Newton-Raphson step
+  // Intended for renormalizing quaternions that have only slightly drifted from unit length
+  quaternion& FastNormalize()
+  {
+    f32 lengthSq = x * x + y * y + z * z + w * w;
+    f32 r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(lengthSq)));
+    r *= 1.5f - 0.5f * lengthSq * r * r;
+    return *this *= r;
+  }
+
 } quaternion;
 
+// Normalized linear blend from _from to _to along the shortest arc
+inline quaternion Nlerp(quaternion _from, quaternion _to, f32 _t)
+{
+  // Negate the target when the quaternions are in opposite hemispheres to avoid the long way round
+  f32 sign = (_from.Dot(_to) < 0.0f) ? -1.0f : 1.0f;
+
+  quaternion q = { _from.x + (_to.x * sign - _from.x) * _t,
+                   _from.y + (_to.y * sign - _from.y) * _t,
+                   _from.z + (_to.z * sign - _from.z) * _t,
+                   _from.w + (_to.w * sign - _from.w) * _t };
+  return q.Normalize();
+}
+
 } // namespace Ice
 
 #endif // !define ICE_MATH_QUATERNION_H_
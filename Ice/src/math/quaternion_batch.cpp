@@ -0,0 +1,347 @@
+
+#include "defines.h"
+
+#include "math/quaternion_batch.h"
+
+#include <immintrin.h>
+
+//=========================
+// Lane helpers
+//=========================
+// Quaternions are stored xyzw in memory; kernels operate on four of them at once with
+//   each component transposed into its own register
+
+struct QuaternionLanes
+{
+  __m128 x;
+  __m128 y;
+  __m128 z;
+  __m128 w;
+};
+
+struct Vec3Lanes
+{
+  __m128 x;
+  __m128 y;
+  __m128 z;
+};
+
+static inline QuaternionLanes LoadQuaternionLanes(const Ice::quaternion* _q)
+{
+  const f32* f = &_q->x;
+  QuaternionLanes lanes = { _mm_loadu_ps(f), _mm_loadu_ps(f + 4), _mm_loadu_ps(f + 8), _mm_loadu_ps(f + 12) };
+  _MM_TRANSPOSE4_PS(lanes.x, lanes.y, lanes.z, lanes.w);
+  return lanes;
+}
+
+static inline void StoreQuaternionLanes(QuaternionLanes _lanes, Ice::quaternion* _q)
+{
+  _MM_TRANSPOSE4_PS(_lanes.x, _lanes.y, _lanes.z, _lanes.w);
+  f32* f = &_q->x;
+  _mm_storeu_ps(f, _lanes.x);
+  _mm_storeu_ps(f + 4, _lanes.y);
+  _mm_storeu_ps(f + 8, _lanes.z);
+  _mm_storeu_ps(f + 12, _lanes.w);
+}
+
+static inline Vec3Lanes LoadVec3Lanes(const Ice::vec3* _v)
+{
+  return { _mm_setr_ps(_v[0].x, _v[1].x, _v[2].x, _v[3].x),
+           _mm_setr_ps(_v[0].y, _v[1].y, _v[2].y, _v[3].y),
+           _mm_setr_ps(_v[0].z, _v[1].z, _v[2].z, _v[3].z) };
+}
+
+static inline void StoreVec3Lanes(const Vec3Lanes& _lanes, Ice::vec3* _v)
+{
+  alignas(16) f32 x[4], y[4], z[4];
+  _mm_store_ps(x, _lanes.x);
+  _mm_store_ps(y, _lanes.y);
+  _mm_store_ps(z, _lanes.z);
+
+  for (u32 i = 0; i < 4; i++)
+  {
+    _v[i].x = x[i];
+    _v[i].y = y[i];
+    _v[i].z = z[i];
+  }
+}
+
+static inline __m128 Dot4(const QuaternionLanes& _a, const QuaternionLanes& _b)
+{
+  __m128 d = _mm_mul_ps(_a.x, _b.x);
+  d = _mm_add_ps(d, _mm_mul_ps(_a.y, _b.y));
+  d = _mm_add_ps(d, _mm_mul_ps(_a.z, _b.z));
+  return _mm_add_ps(d, _mm_mul_ps(_a.w, _b.w));
+}
+
+// Approximate 1/sqrt(x) refined by one Newton-Raphson step : y' = y * (1.5 - 0.5 * x * y * y)
+static inline __m128 ReciprocalSqrt(__m128 _x)
+{
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 threeHalves = _mm_set1_ps(1.5f);
+
+  __m128 y = _mm_rsqrt_ps(_x);
+  __m128 xyy = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_x, half), y), y);
+  return _mm_mul_ps(y, _mm_sub_ps(threeHalves, xyy));
+}
+
+static inline QuaternionLanes NormalizeLanes(const QuaternionLanes& _q)
+{
+  __m128 scale = ReciprocalSqrt(Dot4(_q, _q));
+  return { _mm_mul_ps(_q.x, scale), _mm_mul_ps(_q.y, scale), _mm_mul_ps(_q.z, scale), _mm_mul_ps(_q.w, scale) };
+}
+
+// Lerps _from toward _to by _t after flipping _to onto _from's hemisphere
+//   Returns the un-normalized blend
+static inline QuaternionLanes BlendLanes(const QuaternionLanes& _from, QuaternionLanes _to, __m128 _t)
+{
+  __m128 dot = Dot4(_from, _to);
+  __m128 sign = _mm_and_ps(dot, _mm_set1_ps(-0.0f));
+  _to.x = _mm_xor_ps(_to.x, sign);
+  _to.y = _mm_xor_ps(_to.y, sign);
+  _to.z = _mm_xor_ps(_to.z, sign);
+  _to.w = _mm_xor_ps(_to.w, sign);
+
+  return { _mm_add_ps(_from.x, _mm_mul_ps(_mm_sub_ps(_to.x, _from.x), _t)),
+           _mm_add_ps(_from.y, _mm_mul_ps(_mm_sub_ps(_to.y, _from.y), _t)),
+           _mm_add_ps(_from.z, _mm_mul_ps(_mm_sub_ps(_to.z, _from.z), _t)),
+           _mm_add_ps(_from.w, _mm_mul_ps(_mm_sub_ps(_to.w, _from.w), _t)) };
+}
+
+//=========================
+// Four-wide blocks
+//=========================
+
+static void NlerpBlock(const Ice::quaternion* _from,
+                       const Ice::quaternion* _to,
+                       const f32* _t,
+                       Ice::quaternion* _out)
+{
+  QuaternionLanes from = LoadQuaternionLanes(_from);
+  QuaternionLanes to = LoadQuaternionLanes(_to);
+  __m128 t = _mm_loadu_ps(_t);
+
+  StoreQuaternionLanes(NormalizeLanes(BlendLanes(from, to, t)), _out);
+}
+
+static void SlerpBlock(const Ice::quaternion* _from,
+                       const Ice::quaternion* _to,
+                       const f32* _t,
+                       Ice::quaternion* _out)
+{
+  QuaternionLanes from = LoadQuaternionLanes(_from);
+  QuaternionLanes to = LoadQuaternionLanes(_to);
+  __m128 t = _mm_loadu_ps(_t);
+
+  // Nlerp moves fastest mid-blend; warp t with a cubic whose strength is fit against the
+  //   quaternions' angle so the blended rotation advances at a near-constant rate
+  __m128 d = _mm_andnot_ps(_mm_set1_ps(-0.0f), Dot4(from, to));
+
+  __m128 a = _mm_add_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(d, _mm_set1_ps(-1.43519f)));
+  a = _mm_add_ps(_mm_set1_ps(-3.2452f), _mm_mul_ps(d, a));
+  a = _mm_add_ps(_mm_set1_ps(1.0904f), _mm_mul_ps(d, a));
+
+  __m128 b = _mm_add_ps(_mm_set1_ps(-1.06021f), _mm_mul_ps(d, _mm_set1_ps(0.215638f)));
+  b = _mm_add_ps(_mm_set1_ps(0.848013f), _mm_mul_ps(d, b));
+
+  __m128 tHalf = _mm_sub_ps(t, _mm_set1_ps(0.5f));
+  __m128 k = _mm_add_ps(_mm_mul_ps(a, _mm_mul_ps(tHalf, tHalf)), b);
+  __m128 correction = _mm_mul_ps(_mm_mul_ps(t, tHalf), _mm_sub_ps(t, _mm_set1_ps(1.0f)));
+  __m128 warpedT = _mm_add_ps(t, _mm_mul_ps(correction, k));
+
+  StoreQuaternionLanes(NormalizeLanes(BlendLanes(from, to, warpedT)), _out);
+}
+
+static void NormalizeBlock(const Ice::quaternion* _in, Ice::quaternion* _out)
+{
+  StoreQuaternionLanes(NormalizeLanes(LoadQuaternionLanes(_in)), _out);
+}
+
+static void MultiplyBlock(const Ice::quaternion* _a, const Ice::quaternion* _b, Ice::quaternion* _out)
+{
+  QuaternionLanes a = LoadQuaternionLanes(_a);
+  QuaternionLanes b = LoadQuaternionLanes(_b);
+  QuaternionLanes r;
+
+  // Matches quaternion::operator*(quaternion)
+  r.x = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a.w, b.x), _mm_mul_ps(a.x, b.w)), _mm_mul_ps(a.y, b.z)), _mm_mul_ps(a.z, b.y));
+  r.y = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a.w, b.y), _mm_mul_ps(a.y, b.w)), _mm_mul_ps(a.z, b.x)), _mm_mul_ps(a.x, b.z));
+  r.z = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a.w, b.z), _mm_mul_ps(a.z, b.w)), _mm_mul_ps(a.x, b.y)), _mm_mul_ps(a.y, b.x));
+  r.w = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(a.w, b.w), _mm_mul_ps(a.x, b.x)), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+
+  StoreQuaternionLanes(r, _out);
+}
+
+static void RotateBlock(const Ice::quaternion* _rotations, const Ice::vec3* _vectors, Ice::vec3* _out)
+{
+  QuaternionLanes q = LoadQuaternionLanes(_rotations);
+  Vec3Lanes v = LoadVec3Lanes(_vectors);
+
+  // t = 2 * (q.xyz x v)
+  // v' = v + q.w * t + (q.xyz x t)
+  __m128 two = _mm_set1_ps(2.0f);
+  __m128 tx = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(q.y, v.z), _mm_mul_ps(q.z, v.y)));
+  __m128 ty = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(q.z, v.x), _mm_mul_ps(q.x, v.z)));
+  __m128 tz = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(q.x, v.y), _mm_mul_ps(q.y, v.x)));
+
+  Vec3Lanes r;
+  r.x = _mm_add_ps(_mm_add_ps(v.x, _mm_mul_ps(q.w, tx)), _mm_sub_ps(_mm_mul_ps(q.y, tz), _mm_mul_ps(q.z, ty)));
+  r.y = _mm_add_ps(_mm_add_ps(v.y, _mm_mul_ps(q.w, ty)), _mm_sub_ps(_mm_mul_ps(q.z, tx), _mm_mul_ps(q.x, tz)));
+  r.z = _mm_add_ps(_mm_add_ps(v.z, _mm_mul_ps(q.w, tz)), _mm_sub_ps(_mm_mul_ps(q.x, ty), _mm_mul_ps(q.y, tx)));
+
+  StoreVec3Lanes(r, _out);
+}
+
+//=========================
+// Array kernels
+//=========================
+// Full blocks of four run straight from the caller's buffers
+// The remaining 1-3 elements are copied into identity-padded locals so the same block code handles them
+
+void Ice::QuaternionNlerpArray(const quaternion* _from,
+                               const quaternion* _to,
+                               const f32* _t,
+                               quaternion* _out,
+                               u32 _count)
+{
+  u32 i = 0;
+  for (; i + 4 <= _count; i += 4)
+  {
+    NlerpBlock(_from + i, _to + i, _t + i, _out + i);
+  }
+
+  if (i < _count)
+  {
+    quaternion from[4], to[4], out[4];
+    f32 t[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    u32 remaining = _count - i;
+    for (u32 j = 0; j < remaining; j++)
+    {
+      from[j] = _from[i + j];
+      to[j] = _to[i + j];
+      t[j] = _t[i + j];
+    }
+
+    NlerpBlock(from, to, t, out);
+    for (u32 j = 0; j < remaining; j++)
+    {
+      _out[i + j] = out[j];
+    }
+  }
+}
+
+void Ice::QuaternionSlerpArray(const quaternion* _from,
+                               const quaternion* _to,
+                               const f32* _t,
+                               quaternion* _out,
+                               u32 _count)
+{
+  u32 i = 0;
+  for (; i + 4 <= _count; i += 4)
+  {
+    SlerpBlock(_from + i, _to + i, _t + i, _out + i);
+  }
+
+  if (i < _count)
+  {
+    quaternion from[4], to[4], out[4];
+    f32 t[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    u32 remaining = _count - i;
+    for (u32 j = 0; j < remaining; j++)
+    {
+      from[j] = _from[i + j];
+      to[j] = _to[i + j];
+      t[j] = _t[i + j];
+    }
+
+    SlerpBlock(from, to, t, out);
+    for (u32 j = 0; j < remaining; j++)
+    {
+      _out[i + j] = out[j];
+    }
+  }
+}
+
+void Ice::QuaternionNormalizeArray(const quaternion* _in, quaternion* _out, u32 _count)
+{
+  u32 i = 0;
+  for (; i + 4 <= _count; i += 4)
+  {
+    NormalizeBlock(_in + i, _out + i);
+  }
+
+  if (i < _count)
+  {
+    quaternion in[4], out[4];
+    u32 remaining = _count - i;
+    for (u32 j = 0; j < remaining; j++)
+    {
+      in[j] = _in[i + j];
+    }
+
+    NormalizeBlock(in, out);
+    for (u32 j = 0; j < remaining; j++)
+    {
+      _out[i + j] = out[j];
+    }
+  }
+}
+
+void Ice::QuaternionMultiplyArray(const quaternion* _a,
+                                  const quaternion* _b,
+                                  quaternion* _out,
+                                  u32 _count)
+{
+  u32 i = 0;
+  for (; i + 4 <= _count; i += 4)
+  {
+    MultiplyBlock(_a + i, _b + i, _out + i);
+  }
+
+  if (i < _count)
+  {
+    quaternion a[4], b[4], out[4];
+    u32 remaining = _count - i;
+    for (u32 j = 0; j < remaining; j++)
+    {
+      a[j] = _a[i + j];
+      b[j] = _b[i + j];
+    }
+
+    MultiplyBlock(a, b, out);
+    for (u32 j = 0; j < remaining; j++)
+    {
+      _out[i + j] = out[j];
+    }
+  }
+}
+
+void Ice::QuaternionRotateArray(const quaternion* _rotations,
+                                const vec3* _vectors,
+                                vec3* _out,
+                                u32 _count)
+{
+  u32 i = 0;
+  for (; i + 4 <= _count; i += 4)
+  {
+    RotateBlock(_rotations + i, _vectors + i, _out + i);
+  }
+
+  if (i < _count)
+  {
+    quaternion rotations[4];
+    vec3 vectors[4] = {}, out[4];
+    u32 remaining = _count - i;
+    for (u32 j = 0; j < remaining; j++)
+    {
+      rotations[j] = _rotations[i + j];
+      vectors[j] = _vectors[i + j];
+    }
+
+    RotateBlock(rotations, vectors, out);
+    for (u32 j = 0; j < remaining; j++)
+    {
+      _out[i + j] = out[j];
+    }
+  }
+}
@@ -0,0 +1,50 @@
+
+#ifndef ICE_MATH_QUATERNION_BATCH_H_
+#define ICE_MATH_QUATERNION_BATCH_H_
+
+#include "defines.h"
+
+#include "math/vector.h"
+#include "math/quaternion.hpp"
+
+namespace Ice {
+
+//=========================
+// Batched quaternion kernels
+//=========================
+// Each kernel processes _count contiguous elements, four at a time
+// Output arrays may alias input arrays
+
+// Normalized linear blend from _from[i] to _to[i] by _t[i] along the shortest arc
+void QuaternionNlerpArray(const quaternion* _from,
+                          const quaternion* _to,
+                          const f32* _t,
+                          quaternion* _out,
+                          u32 _count);
+
+// Approximate spherical blend from _from[i] to _to[i] by _t[i] along the shortest arc
+// Corrects the nlerp blend factor to approach constant angular velocity without any trig
+void QuaternionSlerpArray(const quaternion* _from,
+                          const quaternion* _to,
+                          const f32* _t,
+                          quaternion* _out,
+                          u32 _count);
+
+// Normalizes with an approximate reciprocal square root refined by one Newton-Raphson step
+void QuaternionNormalizeArray(const quaternion* _in, quaternion* _out, u32 _count);
+
+// _out[i] = _a[i] * _b[i] (Rotates by _b[i], then by _a[i])
+void QuaternionMultiplyArray(const quaternion* _a,
+                             const quaternion* _b,
+                             quaternion* _out,
+                             u32 _count);
+
+// Rotates _vectors[i] by the unit quaternion _rotations[i]
+void QuaternionRotateArray(const quaternion* _rotations,
+                           const vec3* _vectors,
+                           vec3* _out,
+                           u32 _count);
+
+} // namespace Ice
+
+#endif // !ICE_MATH_QUATERNION_BATCH_H_
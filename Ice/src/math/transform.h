@@ -34,11 +34,43 @@ private:
   Ice::quaternion rotation;
   Ice::vec3 scale;
 
+  // State at the start of the most recent simulation tick, used for render interpolation
+  Ice::vec3 previousPosition;
+  Ice::quaternion previousRotation;
+  Ice::vec3 previousScale;
+  b8 hasPreviousState = false; // Transforms created mid-tick snap to their current state
+  b8 changedLastTick = false; // Keeps the settled state uploading for one tick after movement stops
+
   mat4 matrix;
   Ice::Entity parent = Ice::nullEntity;
 
   b8 dirty = false;
 
+  static mat4 ComposeMatrix(Ice::vec3 p, quaternion q, Ice::vec3 s)
+  {
+    return Ice::mat4(
+      s.x * (1 - 2 * (q.y * q.y + q.z * q.z)), s.x * (2 * (q.x * q.y + q.w * q.z))    , s.x * (2 * (q.x * q.z - q.w * q.y))    , 0,
+      s.y * (2 * (q.x * q.y - q.w * q.z))    , s.y * (1 - 2 * (q.x * q.x + q.z * q.z)), s.y * (2 * (q.y * q.z + q.w * q.x))    , 0,
+      s.z * (2 * (q.x * q.z + q.w * q.y))    , s.z * (2 * (q.y * q.z - q.w * q.x))    , s.z * (1 - 2 * (q.x * q.x + q.y * q.y)), 0,
+      p.x                                    , p.y                                    , p.z                                    , 1
+    );
+  }
+
+  b8 ChangedThisTick() const
+  {
+    return hasPreviousState &&
+           !(previousPosition == position && previousRotation == rotation && previousScale == scale);
+  }
+
+  void RefreshMatrix()
+  {
+    if (dirty)
+    {
+      dirty = false;
+      matrix = ComposeMatrix(position, rotation, scale);
+    }
+  }
+
 public:
 
   Ice::BufferSegment bufferSegment;
@@ -127,7 +159,7 @@ public:
     rotation *= _rotation; // Rotates roll->pitch->yaw
     //rotation = _rotation * rotation; // Rotates around world-space axes
 
-    rotation.Normalize();
+    rotation.FastNormalize();
     return rotation;
   }
 
@@ -182,28 +214,58 @@ public:
 
   mat4 GetMatrix(b8 _includeParents = true)
   {
-    if (dirty)
+    RefreshMatrix();
+
+    if (_includeParents && parent.IsValid())
     {
-      dirty = false;
+      return Ice::GetComponentArray<Ice::Transform>()[parent].GetMatrix() * matrix;
+    }
+
+    return matrix;
+  }
+
+  // Interpolation =====
+
+  // Marks the current state as the start of the next simulation tick
+  void StorePreviousState()
+  {
+    changedLastTick = ChangedThisTick();
+    previousPosition = position;
+    previousRotation = rotation;
+    previousScale = scale;
+    hasPreviousState = true;
+  }
 
-      Ice::vec3 p = position;
-      quaternion q = rotation;
-      Ice::vec3 s = scale;
+  // True if the transform changed during the most recent simulation tick, or the one before it
+  // The extra tick lets the final pose be drawn once movement stops, rather than the last blend
+  b8 IsInterpolating()
+  {
+    return changedLastTick || ChangedThisTick();
+  }
 
-      matrix = Ice::mat4(
-        s.x * (1 - 2 * (q.y * q.y + q.z * q.z)), s.x * (2 * (q.x * q.y + q.w * q.z))    , s.x * (2 * (q.x * q.z - q.w * q.y))    , 0,
-        s.y * (2 * (q.x * q.y - q.w * q.z))    , s.y * (1 - 2 * (q.x * q.x + q.z * q.z)), s.y * (2 * (q.y * q.z + q.w * q.x))    , 0,
-        s.z * (2 * (q.x * q.z + q.w * q.y))    , s.z * (2 * (q.y * q.z - q.w * q.x))    , s.z * (1 - 2 * (q.x * q.x + q.y * q.y)), 0,
-        p.x                                    , p.y                                    , p.z                                    , 1
-      );
+  // Blends the previous and current tick states
+  // _alpha : 0 = state at the start of the tick, 1 = state at the end of the tick
+  mat4 GetInterpolatedMatrix(f32 _alpha, b8 _includeParents = true)
+  {
+    RefreshMatrix();
+
+    if (!hasPreviousState)
+    {
+      return GetMatrix(_includeParents);
     }
 
+    Ice::vec3 p = previousPosition + (position - previousPosition) * _alpha;
+    Ice::vec3 s = previousScale + (scale - previousScale) * _alpha;
+    quaternion q = Ice::Nlerp(previousRotation, rotation, _alpha);
+
+    mat4 interpolated = ComposeMatrix(p, q, s);
+
     if (_includeParents && parent.IsValid())
     {
-      return Ice::GetComponentArray<Ice::Transform>()[parent].GetMatrix() * matrix;
+      return Ice::GetComponentArray<Ice::Transform>()[parent].GetInterpolatedMatrix(_alpha) * interpolated;
     }
 
-    return matrix;
+    return interpolated;
   }
 
   constexpr void SetParentAs(Ice::Entity _newParent)
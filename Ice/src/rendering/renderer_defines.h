@@ -9,6 +9,7 @@
 #include "math/matrix.hpp"
 #include "tools/compact_array.h"
 #include "tools/pool.h"
+#include "tools/inline_array.h"
 
 #include <vulkan/vulkan.h>
 #include <vector>
@@ -28,10 +29,23 @@ enum BufferMemoryUsageBits
   Buffer_Memory_Vertex = 0x02,
   Buffer_Memory_Index = 0x04,
   Buffer_Memory_Transfer_Src = 0x08,
-  Buffer_Memory_Transfer_Dst = 0x10
+  Buffer_Memory_Transfer_Dst = 0x10,
+  Buffer_Memory_Shader_Storage = 0x20 // Elements are tightly packed, to be indexed as one array
 };
 typedef Ice::Flag BufferMemoryUsageFlags;
 
+// Where a buffer's memory lives and how the CPU accesses it
+enum BufferMemoryHints
+{
+  Buffer_Memory_Hint_Upload,   // Host-visible, written by the CPU and read by the GPU
+  Buffer_Memory_Hint_Gpu_Only, // Device-local, filled through a staging copy
+  Buffer_Memory_Hint_Readback, // Host-visible (cached when available), written by the GPU for the CPU
+  Buffer_Memory_Hint_Per_Frame, // Host memory, copied into the frame's uniform ring when it is drawn
+  // Host-visible and cached when available, for buffers the CPU reads or writes sparsely
+  // Without coherence, written ranges are flushed together before the next frame is submitted
+  Buffer_Memory_Hint_Upload_Cached,
+};
+
 struct Buffer;
 
 struct BufferSegment
@@ -52,6 +66,7 @@ struct Buffer
   u64 padElementSize = 0; // Bytes, a multiple of an alignment value (API dependent)
   u32 count = 1; // Number of elements
   BufferMemoryUsageFlags usage;
+  BufferMemoryHints hint = Buffer_Memory_Hint_Upload;
 
   union
   {
@@ -130,7 +145,7 @@ struct ShaderSettings
 struct Shader
 {
   ShaderSettings settings;
-  std::vector<ShaderInputElement> input;
+  Ice::InlineArray<ShaderInputElement, 8> input;
 
   union
   {
@@ -154,8 +169,8 @@ struct MaterialSettings
 
 struct Material
 {
-  std::vector<Ice::Shader*> shaders;
-  std::vector<ShaderInputElement> input;
+  Ice::InlineArray<Ice::Shader*, 4> shaders;
+  Ice::InlineArray<ShaderInputElement, 8> input;
   Ice::Buffer buffer;
   u32 subpassIndex;
 
@@ -235,14 +250,8 @@ struct CameraSettings
 struct CameraComponent
 {
   Ice::mat4 projectionMatrix;
-  Ice::Buffer buffer;
+  Ice::Buffer buffer; // Per-frame, holds the camera's Ice::CameraData
   Ice::CameraSettings settings;
-
-  union
-  {
-    void* apiData0;
-    Ice::IvkObjectData vulkan;
-  };
 };
 
 struct CameraData
@@ -256,12 +265,7 @@ struct RenderComponent
 {
   u32 material;
   u32 mesh;
-
-  union
-  {
-    void* apiData0;
-    Ice::IvkObjectData vulkan;
-  };
+  u32 transformIndex; // Element of FrameInformation::transforms holding the object's matrix
 };
 
 // The contents of this struct are currently in flux.
@@ -272,8 +276,84 @@ struct FrameInformation
   Ice::CompactArray<Ice::RenderComponent>* renderables;
   Ice::CompactPool<Ice::MeshInformation>* meshes;
   Ice::CompactPool<Ice::Material>* materials;
+  Ice::Buffer* transforms; // Per-frame
+};
+
+// Data copied into device-local resources through the renderer's staging memory
+struct RendererUploadStats
+{
+  u64 bytes = 0;      // Copied into staging memory
+  u32 writeCount = 0; // Buffer and image writes requested
+  u32 copyCount = 0;  // Copy regions recorded once adjacent writes are merged
+  u32 submitCount = 0;
 };
 
+// =====
+// Memory statistics
+// =====
+
+#define ICE_GPU_MAX_MEMORY_HEAPS 16
+#define ICE_GPU_MAX_MEMORY_TYPES 32
+
+// What device memory was allocated for
+enum GpuMemoryCategories
+{
+  Gpu_Memory_Mesh,       // Vertex and index buffers
+  Gpu_Memory_Texture,
+  Gpu_Memory_Uniform,    // Buffers read by shaders
+  Gpu_Memory_Staging,    // Sources of uploads
+  Gpu_Memory_Attachment, // Depth and other render targets
+  Gpu_Memory_Other,
+  Gpu_Memory_Category_Count
+};
+
+struct GpuMemoryCategoryStats
+{
+  u64 liveBytes;
+  u64 peakBytes; // Highest liveBytes has reached
+  u64 liveCount; // Allocations not yet freed
+};
+
+struct GpuMemoryHeapStats
+{
+  u64 size;
+  b8 deviceLocal;
+
+  // Without driver-reported budgets these are the heap size and the renderer's own allocations
+  u64 budget; // Bytes the process can allocate from the heap before it is over-committed
+  u64 usage;  // Bytes the process has allocated from the heap, including other APIs and the driver
+
+  u64 allocatedBytes; // Device memory allocated by the renderer
+  u64 usedBytes;      // Bytes of allocatedBytes held by resources
+};
+
+struct GpuMemoryTypeStats
+{
+  u32 heap;
+  b8 deviceLocal;
+  b8 hostVisible;
+  b8 hostCached;
+
+  u64 allocatedBytes;
+  u64 usedBytes;
+  u32 blockCount;
+  u32 dedicatedCount; // Allocations too large to share a block
+};
+
+struct GpuMemoryStats
+{
+  b8 budgetReported; // Heap budgets and usage come from the driver
+
+  u32 heapCount;
+  Ice::GpuMemoryHeapStats heaps[ICE_GPU_MAX_MEMORY_HEAPS];
+  u32 typeCount;
+  Ice::GpuMemoryTypeStats types[ICE_GPU_MAX_MEMORY_TYPES];
+
+  Ice::GpuMemoryCategoryStats categories[Ice::Gpu_Memory_Category_Count];
+};
+
+const char* GpuMemoryCategoryName(Ice::GpuMemoryCategories _category);
+
 enum RenderingApi
 {
   RenderApiUnknown = 0,
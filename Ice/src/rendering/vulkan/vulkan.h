@@ -6,6 +6,9 @@
 
 #include "rendering/renderer.h"
 #include "rendering/renderer_defines.h"
+#include "rendering/vulkan/vulkan_memory.h"
+#include "core/platform/memory_pool.h"
+#include "tools/fixed_array.h"
 
 #include <vulkan/vulkan.h>
 
@@ -13,6 +16,108 @@
 
 namespace Ice {
 
+#define ICE_VULKAN_STAGING_RING_SIZE (16ull * 1024 * 1024)
+#define ICE_VULKAN_STAGING_SUBMISSION_COUNT 4
+
+// Host-visible ring that device-local buffers are filled through
+// Positions only ever grow; a position's byte in the ring is the position modulo the capacity
+struct IvkStagingRing
+{
+  struct Submission
+  {
+    VkCommandBuffer command;
+    VkFence fence;
+    VkSemaphore complete; // Waited on by the graphics submission that follows
+    u64 end;              // Ring position after the last byte read by this submission
+    u64 serial;           // Submissions are numbered from 1 in the order they are made
+    b8 pending;
+  };
+
+  Ice::Buffer buffer;
+  u64 capacity = 0;
+  u64 head = 0; // Position of the next byte written
+  u64 tail = 0; // Position of the oldest byte still read by a pending submission
+
+  Submission submissions[ICE_VULKAN_STAGING_SUBMISSION_COUNT];
+  u32 current = 0; // Submission being recorded into
+  u32 oldest = 0;  // Oldest submission that may still be pending
+  b8 recording = false;
+
+  u64 submittedSerial = 0; // Serial of the last submission made
+  u64 completedSerial = 0; // Every submission up to this serial has completed
+
+  struct ImageWrite
+  {
+    VkImage image;
+    VkBufferImageCopy region;
+    b8 first; // Transition to transfer-dst before the copy
+    b8 last;  // Transition to shader-read (and release to graphics) after the copy
+  };
+
+  // Writes queued since the last flush, recorded together
+  // Consecutive regions with the same destination are copied by one command
+  std::vector<VkBuffer> bufferDestinations;
+  std::vector<VkBufferCopy> bufferRegions;
+  std::vector<ImageWrite> imageWrites;
+  u64 batch = 0; // Incremented by every flush that records writes
+
+  // Ownership acquisitions for images released by flushed writes, recorded by the next frame
+  std::vector<VkImageMemoryBarrier> imageAcquires;
+
+  Ice::RendererUploadStats frameStats;
+  Ice::RendererUploadStats lastFrameStats;
+  Ice::RendererUploadStats totalStats;
+};
+
+// Initial bytes of each flight slot's region, doubled whenever a frame needs more
+#define ICE_VULKAN_FRAME_UNIFORM_REGION_SIZE (256ull * 1024)
+
+// Linear ring for uniform data rewritten every frame, with one region per flight slot
+// A frame only writes its own region, which the GPU finished reading when the slot's fence signaled,
+//   and binds what it wrote with dynamic offsets
+struct IvkFrameUniformRing
+{
+  Ice::Buffer buffer;
+  u64 regionSize = 0;
+  u64 alignment = 0; // Of every dynamic offset handed out
+  u64 regionStart = 0;
+  u64 head = 0; // Bytes used in the current region
+};
+
+// Passes a draw can be queued for, the most significant field of its sort key
+enum IvkDrawPasses
+{
+  Ivk_Draw_Pass_Forward,
+
+  Ivk_Draw_Pass_Count
+};
+
+// Renderables sharing a mesh and material, drawn by one instanced call
+// Their transforms are gathered contiguously into the frame uniform ring in group order, so each
+//   instance's gl_InstanceIndex selects its own matrix
+struct IvkInstanceGroup
+{
+  u32 material;
+  u32 mesh;
+  u32 firstInstance; // Element of the gathered transforms holding the group's first matrix
+  u32 instanceCount;
+};
+
+// Handles frames in flight may still use, destroyed once the GPU finishes the frame they were
+//   retired before
+// Any combination of handles may be set; null handles are skipped
+struct IvkRetiredResource
+{
+  u64 frame = 0; // Index of the first frame submitted after retirement
+
+  Ice::IvkBuffer buffer{};
+  Ice::IvkImage image{};
+  VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+};
+
 struct VulkanContext
 {
   VkAllocationCallbacks* alloc = nullptr;
@@ -27,10 +132,15 @@ struct VulkanContext
   VkQueue presentQueue;
   VkQueue transientQueue;
 
+  Ice::IvkMemoryAllocator memory;
+
   VkDescriptorPool descriptorPool;
   VkCommandPool graphicsCommandPool;
   VkCommandPool transientCommandPool;
 
+  Ice::IvkStagingRing staging;
+  Ice::IvkFrameUniformRing frameUniforms;
+
   // Swapchain =====
   VkPresentModeKHR presentMode;
   VkSwapchainKHR swapchain;
@@ -48,14 +158,21 @@ struct VulkanContext
   std::vector<VkSemaphore> imageAvailableSemaphores;
   u32 currentFlightIndex = 0;
 #define ICE_MAX_FLIGHT_IMAGE_COUNT 3
+  u64 submittedFrameCount = 0;
+  u64 completedFrameCount = 0; // Frames the GPU is known to have finished
+
+  // Oldest first
+  std::vector<Ice::IvkRetiredResource> retiredResources;
 
   // Renderpasses =====
+  // Sets 0, 1, and 3 each use one dynamic uniform buffer in the frame uniform ring
   VkDescriptorSet globalDescriptorSet;
   VkDescriptorSetLayout globalDescriptorLayout;
   VkPipelineLayout globalPipelineLayout;
-  Ice::Buffer globalDescriptorBuffer;
+  Ice::Buffer globalDescriptorBuffer; // Per-frame
 
   VkDescriptorSetLayout cameraDescriptorLayout;
+  VkDescriptorSet cameraDescriptorSet;
   VkDescriptorSetLayout objectDescriptorLayout;
   VkDescriptorSet objectDescriptorSet;
 
@@ -126,10 +243,20 @@ private:
   // Commands
   //=========================
 
-  VkCommandBuffer BeginSingleTimeCommand(VkCommandPool _pool);
-  b8 EndSingleTimeCommand(VkCommandBuffer& _command, VkCommandPool _pool, VkQueue _queue);
   b8 RecordCommandBuffer(u32 _commandIndex, Ice::FrameInformation* _data);
 
+  //=========================
+  // Retirement
+  //=========================
+
+  // Queues _resource for destruction once every frame submitted so far has completed
+  void Retire(Ice::IvkRetiredResource _resource);
+  // Destroys the retired resources the GPU has finished with (or all of them when _all is set)
+  void ReleaseRetiredResources(b8 _all = false);
+
+  // Logs every heap's budget and every category's usage
+  void LogMemoryStats();
+
   //=========================
   // Image
   //=========================
@@ -137,7 +264,8 @@ private:
   b8 CreateImage(Ice::IvkImage* _image,
                  VkExtent2D _extents,
                  VkFormat _format,
-                 VkImageUsageFlags _usage);
+                 VkImageUsageFlags _usage,
+                 Ice::IvkMemoryPools _pool = Ice::Ivk_Memory_Pool_General);
 
   b8 CreateImageView(VkImageView* _view,
                      VkImage _image,
@@ -146,11 +274,6 @@ private:
 
   b8 CreateImageSampler(Ice::Image* _image);
 
-  void TransitionImageLayout(Ice::Image* _image,
-                             b8 _toWritable,
-                             VkPipelineStageFlagBits _shaderStage);
-  void CopyBufferToImage(Ice::Buffer* _buffer, Ice::Image* _image);
-
   b8 DestroyImage(Ice::IvkImage* _image);
 
   //=========================
@@ -162,30 +285,77 @@ private:
   b8 CreateShaderModule(Ice::Shader* _shader);
   // Attempts to read the shader's descriptor file
   // Shader descriptors are optional so this can not fail
-  std::vector<ShaderInputElement> LoadShaderDescriptors(Ice::Shader* _shader);
+  Ice::InlineArray<ShaderInputElement, 8> LoadShaderDescriptors(Ice::Shader* _shader);
   b8 AssembleMaterialDescriptorBindings(Ice::Material* _material,
-                                        std::vector<VkDescriptorSetLayoutBinding>& _bindings);
-  b8 CreateDescriptorLayoutAndSet(std::vector<VkDescriptorSetLayoutBinding>* bindings,
+                                        Ice::ScratchVector<VkDescriptorSetLayoutBinding>& _bindings);
+  b8 CreateDescriptorLayoutAndSet(const VkDescriptorSetLayoutBinding* _bindings,
+                                  u32 _bindingCount,
                                   VkDescriptorSetLayout* _layout,
                                   VkDescriptorSet* _set);
-  b8 CreateDescriptorLayout(std::vector<VkDescriptorSetLayoutBinding>* _bindings,
+  b8 CreateDescriptorLayout(const VkDescriptorSetLayoutBinding* _bindings,
+                            u32 _bindingCount,
                             VkDescriptorSetLayout* _layout);
   b8 CreateDescriptorSet(VkDescriptorSetLayout* _layout, VkDescriptorSet* _set);
   // Collects the descriptors for all shaders to create the material's layout/set
   b8 CreateDescriptorLayoutAndSet(Ice::Material* _material);
+  // _set must not be in use by frames in flight
   void UpdateDescriptorSet(VkDescriptorSet* _set,
-                           const std::vector<Ice::ShaderInputElement>& _bindings);
-  b8 CreatePipelineLayout(const std::vector<VkDescriptorSetLayout>& _setLayouts,
+                           const Ice::ShaderInputElement* _inputs,
+                           u32 _inputCount);
+  b8 CreatePipelineLayout(const Ice::FixedArray<VkDescriptorSetLayout, 4>& _setLayouts,
                           VkPipelineLayout* _pipelineLayout);
   b8 CreatePipeline(Ice::Material* _material);
+  // Retires the material's set, layouts, and pipeline
+  void RetireMaterialObjects(Ice::Material* _material);
 
   //=========================
   // Buffer
   //=========================
 
+  // Records every queued write into the staging command buffer, without submitting it
   b8 FlushBufferQueue();
+
+  // Retires the buffer's handles, leaving it empty
+  void RetireBuffer(Ice::Buffer* _buffer);
   u64 PadBufferSize(u64 _inSize, Ice::BufferMemoryUsageFlags _usage);
 
+  // Returns the staging command buffer, beginning it if nothing has been recorded since the last submit
+  VkCommandBuffer GetStagingCommand();
+  b8 CreateStagingRing();
+  void DestroyStagingRing();
+  // Reserves _size contiguous bytes of the ring, returning their offset into the ring's buffer
+  b8 ReserveStagingSpace(u64 _size, u64 _alignment, u64* _ringOffset);
+  // Queues a copy of _size bytes into the destination, merged with the last write when adjacent
+  // Writes larger than a quarter of the ring are split
+  b8 StageBufferCopy(const void* _data, Ice::IvkBuffer* _destination, u64 _destinationOffset, u64 _size);
+  // Queues a copy of tightly packed texels filling the whole image, leaving it shader-readable
+  // Images larger than a quarter of the ring are split by rows
+  // The image's upload serial is set to the submission that will complete it
+  b8 StageImageCopy(const void* _data, Ice::Image* _image, u32 _texelSize);
+  // Blocks until at least one pending submission completes, submitting the recording one if needed
+  b8 WaitForStagingSpace();
+  // Reclaims the ring space of completed submissions, waiting for each when _wait is set
+  void RetireStagingSubmissions(b8 _wait);
+  // Flushes and submits the copies queued so far
+  // When _signal is given it receives a semaphore the next graphics submission must wait on,
+  //   otherwise the submission is waited on before returning
+  b8 SubmitStagingCopies(VkSemaphore* _signal);
+
+  b8 CreateFrameUniformRing(u64 _regionSize);
+  // Points the global, camera, and object sets at the ring
+  void WriteFrameUniformDescriptors();
+  // Starts the flight slot's region, growing every region to at least _size bytes first
+  b8 BeginFrameUniforms(u32 _flightIndex, u64 _size);
+  // Bytes a per-frame buffer takes in the ring, including alignment
+  u64 FrameUniformSize(const Ice::Buffer* _buffer);
+  // Reserves _size bytes of the current region, returning their dynamic offset
+  u32 ReserveFrameUniforms(u64 _size, void** _mapped);
+  // Copies a per-frame buffer into the current region, returning its dynamic offset
+  u32 PushFrameUniforms(const Ice::Buffer* _buffer);
+  // Groups the renderables by mesh and material, gathering their transforms into the current region
+  // Returns the dynamic offset of the gathered transforms
+  u32 PushInstanceGroups(Ice::FrameInformation* _data, Ice::ScratchVector<Ice::IvkInstanceGroup>& _groups);
+
 public:
   b8 Init(Ice::RendererSettingsCore _settings, const char* _title, u32 _version);
   b8 RenderFrame(Ice::FrameInformation* _data);
@@ -202,18 +372,32 @@ public:
 
   b8 SetMaterialInput(Ice::Material* _material, u32 _bindIndex, Ice::Image* _image);
 
+  // The texels are copied into the staging ring before returning
+  // Uploads are batched and submitted with the next frame's staging copies, which it waits on
   b8 CreateTexture(Ice::Image* _image, void* _data);
   void DestroyImage(Ice::Image* _image);
+  // True once the GPU has finished writing the texture
+  b8 IsTextureUploaded(const Ice::Image* _image);
+  // Submits every queued upload and blocks until they complete
+  b8 FinishUploads();
 
   b8 CreateBufferMemory(Ice::Buffer* _outBuffer,
                         u64 _elementSize,
                         u32 _elementCount,
-                        Ice::BufferMemoryUsageFlags _usage);
+                        Ice::BufferMemoryUsageFlags _usage,
+                        Ice::BufferMemoryHints _hint = Ice::Buffer_Memory_Hint_Upload,
+                        Ice::IvkMemoryPools _pool = Ice::Ivk_Memory_Pool_General);
   b8 ResizeBufferMemory(Ice::Buffer* _buffer, u32 _newElementCount);
   void DestroyBufferMemory(Ice::Buffer* _buffer);
 
-  // Pushes data to the GPU immediately
+  // Host-visible buffers are written immediately
+  // Device-local buffers are written through the staging ring, in time for the next frame submitted
   b8 PushDataToBuffer(void* _data, const Ice::BufferSegment _segmentInfo);
+  // Uploads of the last frame submitted, and since initialization
+  void GetUploadStats(Ice::RendererUploadStats* _lastFrame, Ice::RendererUploadStats* _total);
+  // Device memory by heap, memory type, and category
+  // Heap budgets and usage come from the driver when VK_EXT_memory_budget is available
+  void GetMemoryStats(Ice::GpuMemoryStats* _stats);
 
   b8 InitializeRenderComponent(Ice::RenderComponent* _component,
                                Ice::BufferSegment const _TransformBuffer);
@@ -221,8 +405,6 @@ public:
                            Ice::BufferSegment const _transformBufferSegment);
   b8 UpdateCameraComponent(Ice::CameraComponent* const _component,
                            Ice::BufferSegment const _transformBufferSegment);
-  b8 UpdateShaderBindings(VkDescriptorSet* const _set,
-                          Ice::BufferSegment const _transformBufferSegment);
   void DestroyRenderComponent(Ice::RenderComponent* _component);
   b8 InitializeCamera(Ice::CameraComponent* _camera,
                       Ice::BufferSegment _transformSegment,
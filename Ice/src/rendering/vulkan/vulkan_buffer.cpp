@@ -3,40 +3,35 @@
 
 #include "rendering/vulkan/vulkan.h"
 
-u32 GetMemoryTypeIndex(Ice::VulkanContext* _context,
-                       u32 _supportedMemoryTypes,
-                       VkMemoryPropertyFlags _flags)
-{
-  const VkPhysicalDeviceMemoryProperties& properties = _context->gpu.memoryProperties;
-
-  for (u32 i = 0; i < properties.memoryTypeCount; i++)
-  {
-    if (_supportedMemoryTypes & (1 << i) &&
-        (properties.memoryTypes[i].propertyFlags & _flags) == _flags)
-    {
-      return i;
-    }
-  }
-
-  IceLogError("No suitable memory type is supported for this buffer");
-  return Ice::null32;
-}
-
 b8 Ice::RendererVulkan::CreateBufferMemory(Ice::Buffer* _outBuffer,
                                            u64 _elementSize,
                                            u32 _elementCount,
-                                           Ice::BufferMemoryUsageFlags _usage)
+                                           Ice::BufferMemoryUsageFlags _usage,
+                                           Ice::BufferMemoryHints _hint /*= Buffer_Memory_Hint_Upload*/,
+                                           Ice::IvkMemoryPools _pool /*= Ivk_Memory_Pool_General*/)
 {
   if (_elementSize * _elementCount == 0)
   {
-    IceLogError("Can not create buffer with size 0\n> Element size %llu, Count : %u",
-                _elementSize,
-                _elementCount);
+    IceLogErrorIn(Ice::Log_Category_Renderer,
+                  "Can not create buffer with size 0\n> Element size %llu, Count : %u",
+                  _elementSize,
+                  _elementCount);
     ICE_BREAK;
     return false;
   }
 
-  *_outBuffer = { _elementSize, PadBufferSize(_elementSize, _usage), _elementCount, _usage };
+  *_outBuffer = { _elementSize, PadBufferSize(_elementSize, _usage), _elementCount, _usage, _hint };
+
+  // Per-frame =====
+  // Only host memory; the GPU reads the copy made into the frame uniform ring
+  if (_hint == Ice::Buffer_Memory_Hint_Per_Frame)
+  {
+    _outBuffer->vulkan.buffer = VK_NULL_HANDLE;
+    _outBuffer->vulkan.allocation = {};
+    _outBuffer->vulkan.mapped = Ice::BlockAllocateZero(_outBuffer->padElementSize * _outBuffer->count,
+                                                       Ice::Memory_Tag_Renderer);
+    return true;
+  }
 
   // Buffer =====
   VkBufferCreateInfo createInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
@@ -63,6 +58,25 @@ b8 Ice::RendererVulkan::CreateBufferMemory(Ice::Buffer* _outBuffer,
   {
     createInfo.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
   }
+  if (_usage & Ice::Buffer_Memory_Shader_Storage)
+  {
+    createInfo.usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  }
+
+  u32 queueFamilies[] = { context.gpu.graphicsQueueIndex, context.gpu.transientQueueIndex };
+  if (_hint == Ice::Buffer_Memory_Hint_Gpu_Only)
+  {
+    // Filled by staging copies, and copied from when resized
+    createInfo.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    // Shared with the transfer queue instead of transferring ownership after every copy
+    if (queueFamilies[0] != queueFamilies[1])
+    {
+      createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+      createInfo.queueFamilyIndexCount = 2;
+      createInfo.pQueueFamilyIndices = queueFamilies;
+    }
+  }
 
   IVK_ASSERT(vkCreateBuffer(context.device, &createInfo, context.alloc, &_outBuffer->vulkan.buffer),
              "Failed to create buffer : size %llu", _outBuffer->padElementSize * _outBuffer->count);
@@ -71,48 +85,167 @@ b8 Ice::RendererVulkan::CreateBufferMemory(Ice::Buffer* _outBuffer,
   VkMemoryRequirements bufferMemRequirements;
   vkGetBufferMemoryRequirements(context.device, _outBuffer->vulkan.buffer, &bufferMemRequirements);
 
-  VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-  allocInfo.allocationSize = bufferMemRequirements.size;
-  allocInfo.memoryTypeIndex = GetMemoryTypeIndex(&context,
-                                                 bufferMemRequirements.memoryTypeBits,
-                                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-                                                   | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  VkMemoryPropertyFlags memoryFlags = 0;
+  VkMemoryPropertyFlags preferredFlags = 0;
+  switch (_hint)
+  {
+  case Ice::Buffer_Memory_Hint_Gpu_Only:
+  {
+    memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  } break;
+  case Ice::Buffer_Memory_Hint_Readback:
+  {
+    memoryFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+  } break;
+  case Ice::Buffer_Memory_Hint_Upload_Cached:
+  {
+    memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+  } break;
+  case Ice::Buffer_Memory_Hint_Upload:
+  default:
+  {
+    memoryFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  } break;
+  }
 
-  IVK_ASSERT(vkAllocateMemory(context.device, &allocInfo, context.alloc, &_outBuffer->vulkan.memory),
-             "Failed to allocate buffer memory : size %llu",
-             _outBuffer->padElementSize * _outBuffer->count);
+  Ice::GpuMemoryCategories category = Ice::Gpu_Memory_Other;
+  if (_usage & (Ice::Buffer_Memory_Vertex | Ice::Buffer_Memory_Index))
+    category = Ice::Gpu_Memory_Mesh;
+  else if (_usage & (Ice::Buffer_Memory_Shader_Read | Ice::Buffer_Memory_Shader_Storage))
+    category = Ice::Gpu_Memory_Uniform;
+  else if (_usage & Ice::Buffer_Memory_Transfer_Src)
+    category = Ice::Gpu_Memory_Staging;
+
+  if (!context.memory.Allocate(bufferMemRequirements,
+                               memoryFlags,
+                               _pool,
+                               category,
+                               false,
+                               &_outBuffer->vulkan.allocation,
+                               preferredFlags))
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer,
+                  "Failed to allocate buffer memory : size %llu",
+                  bufferMemRequirements.size);
+    LogMemoryStats();
+    vkDestroyBuffer(context.device, _outBuffer->vulkan.buffer, context.alloc);
+    _outBuffer->vulkan.buffer = VK_NULL_HANDLE;
+    return false;
+  }
 
   // Bind =====
   IVK_ASSERT(vkBindBufferMemory(context.device,
                                 _outBuffer->vulkan.buffer,
-                                _outBuffer->vulkan.memory, 0),
+                                _outBuffer->vulkan.allocation.memory,
+                                _outBuffer->vulkan.allocation.offset),
              "Failed to bind buffer and memory");
 
+  _outBuffer->vulkan.stagedBatch = Ice::null64;
+
+  // Map =====
+  // Kept mapped until destruction so pushes don't pay for a map/unmap each
+  _outBuffer->vulkan.mapped = nullptr;
+  if (context.memory.IsHostVisible(_outBuffer->vulkan.allocation))
+  {
+    _outBuffer->vulkan.mapped = context.memory.Map(_outBuffer->vulkan.allocation);
+    if (_outBuffer->vulkan.mapped == nullptr)
+    {
+      IceLogErrorIn(Ice::Log_Category_Renderer,
+                    "Failed to map buffer memory : size %llu",
+                    bufferMemRequirements.size);
+      vkDestroyBuffer(context.device, _outBuffer->vulkan.buffer, context.alloc);
+      context.memory.Free(&_outBuffer->vulkan.allocation);
+      _outBuffer->vulkan.buffer = VK_NULL_HANDLE;
+      return false;
+    }
+  }
+
   return true;
 }
 
 b8 Ice::RendererVulkan::ResizeBufferMemory(Ice::Buffer* _buffer, u32 _newElementCount)
 {
-  vkDeviceWaitIdle(context.device);
+  // No GPU work is involved while the data only lives in host memory
+  if (_buffer->hint == Ice::Buffer_Memory_Hint_Per_Frame)
+  {
+    void* mapped = Ice::BlockReallocate(_buffer->vulkan.mapped,
+                                        _buffer->padElementSize * _buffer->count,
+                                        _buffer->padElementSize * _newElementCount,
+                                        Ice::Memory_Tag_Renderer);
+    if (mapped == nullptr)
+    {
+      IceLogErrorIn(Ice::Log_Category_Renderer,
+                    "Failed to resize per-frame buffer : %u elements",
+                    _newElementCount);
+      return false;
+    }
+    _buffer->vulkan.mapped = mapped;
+    _buffer->count = _newElementCount;
+    return true;
+  }
 
   // New buffer =====
   Ice::Buffer newBuffer = *_buffer;
-  ICE_ATTEMPT(CreateBufferMemory(&newBuffer, _buffer->elementSize, _newElementCount, _buffer->usage));
+  ICE_ATTEMPT(CreateBufferMemory(&newBuffer,
+                                 _buffer->elementSize,
+                                 _newElementCount,
+                                 _buffer->usage,
+                                 _buffer->hint,
+                                 (Ice::IvkMemoryPools)_buffer->vulkan.allocation.pool));
 
   // Copy data =====
-  VkCommandBuffer cmd = BeginSingleTimeCommand(context.transientCommandPool);
+  u64 copySize = min(_buffer->count * _buffer->padElementSize, newBuffer.count * newBuffer.padElementSize);
+
+  if (_buffer->vulkan.mapped != nullptr)
+  {
+    // Host-visible contents are only ever written by the CPU
+    Ice::MemoryCopy(_buffer->vulkan.mapped, newBuffer.vulkan.mapped, copySize);
+    context.memory.QueueFlush(newBuffer.vulkan.allocation, 0, copySize);
+  }
+  else
+  {
+    // Recorded with the staging copies so it lands after the writes staged into the old buffer and
+    //   before those staged into the new one, ahead of the next frame
+    VkCommandBuffer command = VK_NULL_HANDLE;
+    if (FlushBufferQueue())
+      command = GetStagingCommand();
+    if (command == VK_NULL_HANDLE)
+    {
+      DestroyBufferMemory(&newBuffer);
+      return false;
+    }
 
-  VkBufferCopy copy;
-  copy.size = min(_buffer->count * _buffer->padElementSize, newBuffer.count * newBuffer.padElementSize);
-  copy.dstOffset = 0;
-  copy.srcOffset = 0;
+    VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
 
-  vkCmdCopyBuffer(cmd, _buffer->vulkan.buffer, newBuffer.vulkan.buffer, 1, &copy);
+    VkBufferCopy copy;
+    copy.size = copySize;
+    copy.dstOffset = 0;
+    copy.srcOffset = 0;
 
-  EndSingleTimeCommand(cmd, context.transientCommandPool, context.transientQueue);
+    vkCmdPipelineBarrier(command,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         1, &barrier,
+                         0, nullptr,
+                         0, nullptr);
+    vkCmdCopyBuffer(command, _buffer->vulkan.buffer, newBuffer.vulkan.buffer, 1, &copy);
+    vkCmdPipelineBarrier(command,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         1, &barrier,
+                         0, nullptr,
+                         0, nullptr);
+  }
 
-  // Destory old buffer =====
-  DestroyBufferMemory(_buffer);
+  // Retire old buffer =====
+  // Frames in flight (and the copy) still read it
+  RetireBuffer(_buffer);
 
   *_buffer = newBuffer;
   return true;
@@ -120,32 +253,37 @@ b8 Ice::RendererVulkan::ResizeBufferMemory(Ice::Buffer* _buffer, u32 _newElement
 
 void Ice::RendererVulkan::DestroyBufferMemory(Ice::Buffer* _buffer)
 {
+  if (_buffer != nullptr && _buffer->hint == Ice::Buffer_Memory_Hint_Per_Frame)
+  {
+    if (_buffer->vulkan.mapped != nullptr)
+    {
+      Ice::BlockFree(_buffer->vulkan.mapped, _buffer->padElementSize * _buffer->count, Ice::Memory_Tag_Renderer);
+      _buffer->vulkan.mapped = nullptr;
+    }
+    return;
+  }
+
   if (_buffer == nullptr ||
       _buffer->vulkan.buffer == nullptr ||
       _buffer->padElementSize * _buffer->count == 0)
     return;
 
-  vkDeviceWaitIdle(context.device);
-  vkDestroyBuffer(context.device, _buffer->vulkan.buffer, context.alloc);
-  vkFreeMemory(context.device, _buffer->vulkan.memory, context.alloc);
+  RetireBuffer(_buffer);
 }
 
 b8 Ice::RendererVulkan::PushDataToBuffer(void* _data, const Ice::BufferSegment _segmentInfo)
 {
   if (_segmentInfo.buffer == nullptr)
   {
-    IceLogError("No buffer given to data push segment. Aborting data push.");
+    IceLogErrorIn(Ice::Log_Category_Renderer, "No buffer given to data push segment. Aborting data push.");
     return false;
   }
 
   // Using char* to index one byte at a time
-  char* mappedGpuMemory = nullptr;
   char* cpuMemory = (char*)_data;
 
   u64 stride = _segmentInfo.buffer->padElementSize;
-
   u64 bufferOffset = _segmentInfo.startIndex * stride; // GPU byte index
-  u64 bufferSize = _segmentInfo.count * stride; // Total byte range being accessed
 
   u64 copyElementSize = _segmentInfo.elementSize; // Bytes of each element to copy
   u64 elementOffset = _segmentInfo.offset; // Offset into the element to start copy
@@ -154,13 +292,41 @@ b8 Ice::RendererVulkan::PushDataToBuffer(void* _data, const Ice::BufferSegment _
   if (!copyElementSize)
     copyElementSize = _segmentInfo.buffer->elementSize;
 
-  IVK_ASSERT(vkMapMemory(context.device,
-                         _segmentInfo.buffer->vulkan.memory,
-                         bufferOffset,
-                         bufferSize,
-                         0,
-                         (void**)&mappedGpuMemory),
-             "Failed to map buffer memory\n> Offset %llu, Size %llu", bufferOffset, bufferSize);
+  // Device-local =====
+  if (_segmentInfo.buffer->vulkan.mapped == nullptr)
+  {
+    Ice::IvkBuffer* destination = &_segmentInfo.buffer->vulkan;
+
+    if (copyElementSize == stride && elementOffset == 0)
+    {
+      return StageBufferCopy(cpuMemory, destination, bufferOffset, stride * _segmentInfo.count);
+    }
+
+    for (u32 i = 0; i < _segmentInfo.count; i++)
+    {
+      ICE_ATTEMPT(StageBufferCopy(cpuMemory + (copyElementSize * i),
+                                  destination,
+                                  bufferOffset + (stride * i) + elementOffset,
+                                  copyElementSize));
+    }
+    return true;
+  }
+
+  // Host-visible =====
+  char* mappedGpuMemory = (char*)_segmentInfo.buffer->vulkan.mapped + bufferOffset;
+
+  const Ice::IvkAllocation& allocation = _segmentInfo.buffer->vulkan.allocation;
+  // Per-frame buffers are plain host memory with no device memory to flush
+  const b8 needsFlush = _segmentInfo.buffer->vulkan.buffer != VK_NULL_HANDLE;
+
+  // Unpadded elements are contiguous on both sides
+  if (copyElementSize == stride && elementOffset == 0)
+  {
+    Ice::MemoryCopy((void*)cpuMemory, (void*)mappedGpuMemory, stride * _segmentInfo.count);
+    if (needsFlush)
+      context.memory.QueueFlush(allocation, bufferOffset, stride * _segmentInfo.count);
+    return true;
+  }
 
   // Copy copyElementSize bytes at a time into each element for count elements
   for (u32 i = 0; i < _segmentInfo.count; i++)
@@ -170,7 +336,13 @@ b8 Ice::RendererVulkan::PushDataToBuffer(void* _data, const Ice::BufferSegment _
                     copyElementSize);
   }
 
-  vkUnmapMemory(context.device, _segmentInfo.buffer->vulkan.memory);
+  // One range over every element; flushing the padding between them costs less than separate ranges
+  if (needsFlush && _segmentInfo.count > 0)
+  {
+    context.memory.QueueFlush(allocation,
+                              bufferOffset + elementOffset,
+                              (stride * (_segmentInfo.count - 1)) + copyElementSize);
+  }
 
   return true;
 }
@@ -182,9 +354,642 @@ u64 Ice::RendererVulkan::PadBufferSize(u64 _size, Ice::BufferMemoryUsageFlags _u
   {
     alignment = context.gpu.properties.limits.minUniformBufferOffsetAlignment - 1;
   }
+  else if (_usage & Ice::Buffer_Memory_Shader_Storage)
+  {
+    // Elements are indexed within one binding rather than bound at their own offsets
+    return _size;
+  }
   else
   {
     alignment = context.gpu.properties.limits.minStorageBufferOffsetAlignment - 1;
   }
   return (_size + alignment) & ~alignment;
 }
+
+void Ice::RendererVulkan::RetireBuffer(Ice::Buffer* _buffer)
+{
+  Ice::IvkRetiredResource retired;
+  retired.buffer = _buffer->vulkan;
+  Retire(retired);
+
+  _buffer->vulkan.buffer = VK_NULL_HANDLE;
+  _buffer->vulkan.mapped = nullptr;
+}
+
+//=========================
+// Staging ring
+//=========================
+
+b8 Ice::RendererVulkan::CreateStagingRing()
+{
+  Ice::IvkStagingRing& ring = context.staging;
+
+  ICE_ATTEMPT(CreateBufferMemory(&ring.buffer,
+                                 ICE_VULKAN_STAGING_RING_SIZE,
+                                 1,
+                                 Ice::Buffer_Memory_Transfer_Src,
+                                 Ice::Buffer_Memory_Hint_Upload,
+                                 Ice::Ivk_Memory_Pool_Staging));
+  ring.capacity = ring.buffer.padElementSize;
+  ring.head = 0;
+  ring.tail = 0;
+
+  VkCommandBuffer commands[ICE_VULKAN_STAGING_SUBMISSION_COUNT];
+  VkCommandBufferAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandPool = context.transientCommandPool;
+  allocInfo.commandBufferCount = ICE_VULKAN_STAGING_SUBMISSION_COUNT;
+  IVK_ASSERT(vkAllocateCommandBuffers(context.device, &allocInfo, commands),
+             "Failed to allocate staging command buffers");
+
+  VkFenceCreateInfo fenceInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+  VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+  for (u32 i = 0; i < ICE_VULKAN_STAGING_SUBMISSION_COUNT; i++)
+  {
+    Ice::IvkStagingRing::Submission& submission = ring.submissions[i];
+    submission.command = commands[i];
+    submission.end = 0;
+    submission.serial = 0;
+    submission.pending = false;
+
+    IVK_ASSERT(vkCreateFence(context.device, &fenceInfo, context.alloc, &submission.fence),
+               "Failed to create staging fence %u", i);
+    IVK_ASSERT(vkCreateSemaphore(context.device, &semaphoreInfo, context.alloc, &submission.complete),
+               "Failed to create staging semaphore %u", i);
+  }
+
+  ring.current = 0;
+  ring.oldest = 0;
+  ring.recording = false;
+  ring.submittedSerial = 0;
+  ring.completedSerial = 0;
+
+  return true;
+}
+
+void Ice::RendererVulkan::DestroyStagingRing()
+{
+  Ice::IvkStagingRing& ring = context.staging;
+
+  for (u32 i = 0; i < ICE_VULKAN_STAGING_SUBMISSION_COUNT; i++)
+  {
+    Ice::IvkStagingRing::Submission& submission = ring.submissions[i];
+    vkFreeCommandBuffers(context.device, context.transientCommandPool, 1, &submission.command);
+    vkDestroyFence(context.device, submission.fence, context.alloc);
+    vkDestroySemaphore(context.device, submission.complete, context.alloc);
+    submission.pending = false;
+  }
+
+  ring.recording = false;
+  DestroyBufferMemory(&ring.buffer);
+}
+
+b8 Ice::RendererVulkan::ReserveStagingSpace(u64 _size, u64 _alignment, u64* _ringOffset)
+{
+  Ice::IvkStagingRing& ring = context.staging;
+
+  u64 start = (ring.head + _alignment - 1) & ~(_alignment - 1);
+  // Reservations never wrap around the end of the ring
+  if ((start % ring.capacity) + _size > ring.capacity)
+  {
+    start += ring.capacity - (start % ring.capacity);
+  }
+
+  while (start + _size - ring.tail > ring.capacity)
+  {
+    ICE_ATTEMPT(WaitForStagingSpace());
+  }
+
+  ring.head = start + _size;
+  *_ringOffset = start % ring.capacity;
+  return true;
+}
+
+b8 Ice::RendererVulkan::StageBufferCopy(const void* _data,
+                                        Ice::IvkBuffer* _destination,
+                                        u64 _destinationOffset,
+                                        u64 _size)
+{
+  Ice::IvkStagingRing& ring = context.staging;
+  const char* source = (const char*)_data;
+
+  // Large copies are split so no single piece needs most of the ring
+  const u64 maxPieceSize = ring.capacity / 4;
+
+  ring.frameStats.writeCount++;
+  ring.frameStats.bytes += _size;
+
+  while (_size > 0)
+  {
+    u64 pieceSize = (_size < maxPieceSize) ? _size : maxPieceSize;
+
+    // Copies within a batch land in no defined order, so overlapping writes go in the next one
+    if (_destination->stagedBatch == ring.batch
+        && _destinationOffset < _destination->stagedEnd
+        && _destinationOffset + pieceSize > _destination->stagedStart)
+    {
+      ICE_ATTEMPT(FlushBufferQueue());
+    }
+
+    // Continuing the last write is packed tightly so the two can merge
+    b8 continues = !ring.bufferRegions.empty()
+      && ring.bufferDestinations.back() == _destination->buffer
+      && ring.bufferRegions.back().dstOffset + ring.bufferRegions.back().size == _destinationOffset;
+
+    u64 ringOffset;
+    ICE_ATTEMPT(ReserveStagingSpace(pieceSize, continues ? 1 : 16, &ringOffset));
+    Ice::MemoryCopy((void*)source, (char*)ring.buffer.vulkan.mapped + ringOffset, pieceSize);
+
+    // Reserving space may have flushed the last write
+    VkBufferCopy* last = ring.bufferRegions.empty() ? nullptr : &ring.bufferRegions.back();
+    if (last != nullptr
+        && ring.bufferDestinations.back() == _destination->buffer
+        && last->dstOffset + last->size == _destinationOffset
+        && last->srcOffset + last->size == ringOffset)
+    {
+      last->size += pieceSize;
+    }
+    else
+    {
+      VkBufferCopy region;
+      region.srcOffset = ringOffset;
+      region.dstOffset = _destinationOffset;
+      region.size = pieceSize;
+      ring.bufferDestinations.push_back(_destination->buffer);
+      ring.bufferRegions.push_back(region);
+    }
+
+    if (_destination->stagedBatch != ring.batch)
+    {
+      _destination->stagedBatch = ring.batch;
+      _destination->stagedStart = _destinationOffset;
+      _destination->stagedEnd = _destinationOffset + pieceSize;
+    }
+    else
+    {
+      _destination->stagedStart = min(_destination->stagedStart, _destinationOffset);
+      _destination->stagedEnd = max(_destination->stagedEnd, _destinationOffset + pieceSize);
+    }
+
+    source += pieceSize;
+    _destinationOffset += pieceSize;
+    _size -= pieceSize;
+  }
+
+  return true;
+}
+
+b8 Ice::RendererVulkan::StageImageCopy(const void* _data, Ice::Image* _image, u32 _texelSize)
+{
+  Ice::IvkStagingRing& ring = context.staging;
+  const char* source = (const char*)_data;
+
+  const u64 rowSize = (u64)_image->extents.x * _texelSize;
+
+  // Pieces must start on rows the transfer queue can address : multiples of its granularity, or
+  //   only the whole image when it reports a granularity of zero
+  const u32 granularityRows = context.gpu.queueFamilyProperties[context.gpu.transientQueueIndex]
+                                .minImageTransferGranularity.height;
+  u32 maxPieceRows = _image->extents.y;
+  if (granularityRows != 0)
+  {
+    maxPieceRows = (u32)((ring.capacity / 4) / rowSize);
+    maxPieceRows = max(maxPieceRows - (maxPieceRows % granularityRows), granularityRows);
+  }
+
+  if (rowSize * min(maxPieceRows, _image->extents.y) > ring.capacity)
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer,
+                  "Image is too large to stage : %llu bytes per row, %u rows per copy",
+                  rowSize,
+                  min(maxPieceRows, _image->extents.y));
+    return false;
+  }
+
+  ring.frameStats.writeCount++;
+  ring.frameStats.bytes += rowSize * _image->extents.y;
+
+  u32 pieceRows;
+  for (u32 row = 0; row < _image->extents.y; row += pieceRows)
+  {
+    pieceRows = min(maxPieceRows, _image->extents.y - row);
+
+    u64 ringOffset;
+    ICE_ATTEMPT(ReserveStagingSpace(rowSize * pieceRows, 16, &ringOffset));
+    Ice::MemoryCopy((void*)(source + rowSize * row),
+                    (char*)ring.buffer.vulkan.mapped + ringOffset,
+                    rowSize * pieceRows);
+
+    Ice::IvkStagingRing::ImageWrite write;
+    write.image = _image->vulkan.image;
+    write.first = (row == 0);
+    write.last = (row + pieceRows == _image->extents.y);
+
+    write.region = {};
+    write.region.bufferOffset = ringOffset;
+    write.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    write.region.imageSubresource.mipLevel = 0;
+    write.region.imageSubresource.baseArrayLayer = 0;
+    write.region.imageSubresource.layerCount = 1;
+    write.region.imageOffset = { 0, (i32)row, 0 };
+    write.region.imageExtent = { _image->extents.x, pieceRows, 1 };
+
+    ring.imageWrites.push_back(write);
+  }
+
+  // Reserving space submits whatever is queued, so the last rows go with the next submission
+  _image->vulkan.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  _image->vulkan.uploadSerial = ring.submittedSerial + 1;
+  return true;
+}
+
+VkCommandBuffer Ice::RendererVulkan::GetStagingCommand()
+{
+  Ice::IvkStagingRing& ring = context.staging;
+  Ice::IvkStagingRing::Submission& submission = ring.submissions[ring.current];
+
+  if (ring.recording)
+    return submission.command;
+
+  // Slots are reused in order, so the oldest pending submission may be this one
+  while (submission.pending)
+  {
+    RetireStagingSubmissions(true);
+  }
+
+  VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if (vkBeginCommandBuffer(submission.command, &beginInfo) != VK_SUCCESS)
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer, "Failed to begin staging command buffer");
+    return VK_NULL_HANDLE;
+  }
+  ring.recording = true;
+
+  return submission.command;
+}
+
+b8 Ice::RendererVulkan::WaitForStagingSpace()
+{
+  Ice::IvkStagingRing& ring = context.staging;
+
+  if (ring.submissions[ring.oldest].pending)
+  {
+    RetireStagingSubmissions(true);
+    return true;
+  }
+
+  // Everything reading the ring is still being recorded
+  if (ring.recording || !ring.bufferRegions.empty() || !ring.imageWrites.empty())
+  {
+    return SubmitStagingCopies(nullptr);
+  }
+
+  IceLogErrorIn(Ice::Log_Category_Renderer, "Staging ring has no space to reclaim");
+  return false;
+}
+
+void Ice::RendererVulkan::RetireStagingSubmissions(b8 _wait)
+{
+  Ice::IvkStagingRing& ring = context.staging;
+
+  while (ring.submissions[ring.oldest].pending)
+  {
+    Ice::IvkStagingRing::Submission& submission = ring.submissions[ring.oldest];
+
+    if (_wait)
+    {
+      vkWaitForFences(context.device, 1, &submission.fence, VK_TRUE, UINT64_MAX);
+      _wait = false; // Only block for the oldest
+    }
+    else if (vkGetFenceStatus(context.device, submission.fence) != VK_SUCCESS)
+    {
+      return;
+    }
+
+    ring.tail = submission.end;
+    ring.completedSerial = submission.serial;
+    submission.pending = false;
+    ring.oldest = (ring.oldest + 1) % ICE_VULKAN_STAGING_SUBMISSION_COUNT;
+  }
+}
+
+b8 Ice::RendererVulkan::SubmitStagingCopies(VkSemaphore* _signal)
+{
+  Ice::IvkStagingRing& ring = context.staging;
+
+  RetireStagingSubmissions(false);
+  ICE_ATTEMPT(FlushBufferQueue());
+
+  if (!ring.recording)
+  {
+    if (_signal != nullptr)
+      *_signal = VK_NULL_HANDLE;
+    return true;
+  }
+
+  Ice::IvkStagingRing::Submission& submission = ring.submissions[ring.current];
+  ring.recording = false;
+
+  IVK_ASSERT(vkEndCommandBuffer(submission.command),
+             "Failed to record staging command buffer");
+
+  VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &submission.command;
+  // A binary semaphore must be waited on before it can be signaled again
+  if (_signal != nullptr)
+  {
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &submission.complete;
+    *_signal = submission.complete;
+  }
+
+  IVK_ASSERT(vkResetFences(context.device, 1, &submission.fence),
+             "Failed to reset staging fence");
+  IVK_ASSERT(vkQueueSubmit(context.transientQueue, 1, &submitInfo, submission.fence),
+             "Failed to submit staging copies");
+
+  submission.end = ring.head;
+  submission.serial = ++ring.submittedSerial;
+  submission.pending = true;
+  ring.current = (ring.current + 1) % ICE_VULKAN_STAGING_SUBMISSION_COUNT;
+  ring.frameStats.submitCount++;
+
+  if (_signal == nullptr)
+  {
+    while (submission.pending)
+    {
+      RetireStagingSubmissions(true);
+    }
+  }
+
+  return true;
+}
+
+b8 Ice::RendererVulkan::FlushBufferQueue()
+{
+  Ice::IvkStagingRing& ring = context.staging;
+
+  if (ring.bufferRegions.empty() && ring.imageWrites.empty())
+    return true;
+
+  // Copies already recorded may write what these overwrite
+  b8 followsCopies = ring.recording;
+
+  VkCommandBuffer command = GetStagingCommand();
+  if (command == VK_NULL_HANDLE)
+    return false;
+
+  Ice::ScratchScope scratch;
+  Ice::ScratchVector<VkImageMemoryBarrier> barriers;
+
+  // Prepare images =====
+  VkImageMemoryBarrier imageBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+  imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  imageBarrier.subresourceRange.baseMipLevel = 0;
+  imageBarrier.subresourceRange.levelCount = 1;
+  imageBarrier.subresourceRange.baseArrayLayer = 0;
+  imageBarrier.subresourceRange.layerCount = 1;
+
+  for (const Ice::IvkStagingRing::ImageWrite& write : ring.imageWrites)
+  {
+    if (!write.first)
+      continue;
+
+    // Whole images are written, so their previous contents are discarded
+    imageBarrier.image = write.image;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imageBarrier.srcAccessMask = 0;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers.push_back(imageBarrier);
+  }
+
+  VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+  memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  if (followsCopies || !barriers.empty())
+  {
+    vkCmdPipelineBarrier(command,
+                         followsCopies ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0,
+                         followsCopies ? 1 : 0, &memoryBarrier,
+                         0, nullptr,
+                         (u32)barriers.size(), barriers.data());
+  }
+
+  // Copy =====
+  u32 regionCount = (u32)ring.bufferRegions.size();
+  u32 first = 0;
+  for (u32 i = 1; i <= regionCount; i++)
+  {
+    if (i == regionCount || ring.bufferDestinations[i] != ring.bufferDestinations[first])
+    {
+      vkCmdCopyBuffer(command,
+                      ring.buffer.vulkan.buffer,
+                      ring.bufferDestinations[first],
+                      i - first,
+                      &ring.bufferRegions[first]);
+      first = i;
+    }
+  }
+
+  for (const Ice::IvkStagingRing::ImageWrite& write : ring.imageWrites)
+  {
+    vkCmdCopyBufferToImage(command,
+                           ring.buffer.vulkan.buffer,
+                           write.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1,
+                           &write.region);
+  }
+
+  // Release images =====
+  barriers.clear();
+  u32 transferFamily = context.gpu.transientQueueIndex;
+  u32 graphicsFamily = context.gpu.graphicsQueueIndex;
+
+  for (const Ice::IvkStagingRing::ImageWrite& write : ring.imageWrites)
+  {
+    if (!write.last)
+      continue;
+
+    imageBarrier.image = write.image;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    // Made visible to the graphics queue by the semaphore it waits on
+    imageBarrier.dstAccessMask = 0;
+
+    if (transferFamily != graphicsFamily)
+    {
+      imageBarrier.srcQueueFamilyIndex = transferFamily;
+      imageBarrier.dstQueueFamilyIndex = graphicsFamily;
+
+      // The graphics queue repeats the barrier to acquire the image
+      VkImageMemoryBarrier acquire = imageBarrier;
+      acquire.srcAccessMask = 0;
+      acquire.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+      ring.imageAcquires.push_back(acquire);
+    }
+
+    barriers.push_back(imageBarrier);
+  }
+
+  if (!barriers.empty())
+  {
+    vkCmdPipelineBarrier(command,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         (u32)barriers.size(), barriers.data());
+  }
+
+  ring.frameStats.copyCount += regionCount + (u32)ring.imageWrites.size();
+
+  ring.bufferDestinations.clear();
+  ring.bufferRegions.clear();
+  ring.imageWrites.clear();
+  ring.batch++;
+
+  return true;
+}
+
+void Ice::RendererVulkan::GetUploadStats(Ice::RendererUploadStats* _lastFrame, Ice::RendererUploadStats* _total)
+{
+  if (_lastFrame != nullptr)
+    *_lastFrame = context.staging.lastFrameStats;
+  if (_total != nullptr)
+    *_total = context.staging.totalStats;
+}
+
+//=========================
+// Frame uniform ring
+//=========================
+
+b8 Ice::RendererVulkan::CreateFrameUniformRing(u64 _regionSize)
+{
+  Ice::IvkFrameUniformRing& ring = context.frameUniforms;
+  const VkPhysicalDeviceLimits& limits = context.gpu.properties.limits;
+
+  ring.alignment = max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+  ring.regionSize = (_regionSize + ring.alignment - 1) & ~(ring.alignment - 1);
+  ring.regionStart = 0;
+  ring.head = 0;
+
+  return CreateBufferMemory(&ring.buffer,
+                            ring.regionSize,
+                            ICE_MAX_FLIGHT_IMAGE_COUNT,
+                            Ice::Buffer_Memory_Shader_Read | Ice::Buffer_Memory_Shader_Storage);
+}
+
+void Ice::RendererVulkan::WriteFrameUniformDescriptors()
+{
+  const u32 setCount = 3;
+  VkDescriptorSet sets[setCount] = { context.globalDescriptorSet,
+                                     context.cameraDescriptorSet,
+                                     context.objectDescriptorSet };
+  // The object set sees a whole region, so every transform is reachable from its start
+  VkDeviceSize ranges[setCount] = { sizeof(Ice::mat4), sizeof(Ice::CameraData), context.frameUniforms.regionSize };
+  VkDescriptorType types[setCount] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                       VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC };
+
+  VkDescriptorBufferInfo buffers[setCount];
+  VkWriteDescriptorSet writes[setCount];
+
+  for (u32 i = 0; i < setCount; i++)
+  {
+    buffers[i].buffer = context.frameUniforms.buffer.vulkan.buffer;
+    buffers[i].offset = 0;
+    buffers[i].range = ranges[i];
+
+    writes[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    writes[i].dstSet = sets[i];
+    writes[i].dstBinding = 0;
+    writes[i].dstArrayElement = 0;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = types[i];
+    writes[i].pBufferInfo = &buffers[i];
+  }
+
+  vkUpdateDescriptorSets(context.device, setCount, writes, 0, nullptr);
+}
+
+b8 Ice::RendererVulkan::BeginFrameUniforms(u32 _flightIndex, u64 _size)
+{
+  Ice::IvkFrameUniformRing& ring = context.frameUniforms;
+
+  if (_size > ring.regionSize)
+  {
+    u64 newSize = ring.regionSize;
+    while (newSize < _size)
+    {
+      newSize *= 2;
+    }
+
+    IceLogInfoIn(Ice::Log_Category_Renderer,
+                 "Growing frame uniform regions : %llu -> %llu bytes",
+                 ring.regionSize,
+                 newSize);
+
+    // Frames in flight keep using the old ring and sets, which can't be updated while bound
+    RetireBuffer(&ring.buffer);
+    Ice::IvkRetiredResource retiredSet;
+    retiredSet.descriptorSet = context.globalDescriptorSet;
+    Retire(retiredSet);
+    retiredSet.descriptorSet = context.cameraDescriptorSet;
+    Retire(retiredSet);
+    retiredSet.descriptorSet = context.objectDescriptorSet;
+    Retire(retiredSet);
+
+    ICE_ATTEMPT(CreateDescriptorSet(&context.globalDescriptorLayout, &context.globalDescriptorSet));
+    ICE_ATTEMPT(CreateDescriptorSet(&context.cameraDescriptorLayout, &context.cameraDescriptorSet));
+    ICE_ATTEMPT(CreateDescriptorSet(&context.objectDescriptorLayout, &context.objectDescriptorSet));
+    ICE_ATTEMPT(CreateFrameUniformRing(newSize));
+    WriteFrameUniformDescriptors();
+  }
+
+  ring.regionStart = _flightIndex * ring.regionSize;
+  ring.head = 0;
+
+  return true;
+}
+
+u64 Ice::RendererVulkan::FrameUniformSize(const Ice::Buffer* _buffer)
+{
+  u64 alignment = context.frameUniforms.alignment;
+  return (_buffer->padElementSize * _buffer->count + alignment - 1) & ~(alignment - 1);
+}
+
+u32 Ice::RendererVulkan::ReserveFrameUniforms(u64 _size, void** _mapped)
+{
+  Ice::IvkFrameUniformRing& ring = context.frameUniforms;
+
+  u64 size = (_size + ring.alignment - 1) & ~(ring.alignment - 1);
+  ICE_ASSERT_MSG(ring.head + size <= ring.regionSize,
+                 "Frame uniform region overflow : %llu + %llu > %llu", ring.head, size, ring.regionSize);
+
+  u64 offset = ring.regionStart + ring.head;
+  *_mapped = (char*)ring.buffer.vulkan.mapped + offset;
+  ring.head += size;
+
+  return (u32)offset;
+}
+
+u32 Ice::RendererVulkan::PushFrameUniforms(const Ice::Buffer* _buffer)
+{
+  void* mapped;
+  u32 offset = ReserveFrameUniforms(_buffer->padElementSize * _buffer->count, &mapped);
+  Ice::MemoryCopy(_buffer->vulkan.mapped, mapped, _buffer->padElementSize * _buffer->count);
+
+  return offset;
+}
@@ -3,50 +3,118 @@
 #include "rendering/vulkan/vulkan.h"
 
 #include "rendering/vulkan/vulkan_defines.h"
+#include "tools/radix_sort.h"
 
 #include <vector>
 
-VkCommandBuffer Ice::RendererVulkan::BeginSingleTimeCommand(VkCommandPool _pool)
+u32 Ice::RendererVulkan::PushInstanceGroups(Ice::FrameInformation* _data,
+                                            Ice::ScratchVector<Ice::IvkInstanceGroup>& _groups)
 {
-  // Allocate command =====
-  VkCommandBufferAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandPool = _pool;
-  allocInfo.commandBufferCount = 1;
+  const u32 count = _data->renderables->Size();
+  const Ice::RenderComponent* renderables = _data->renderables->GetArray();
 
-  VkCommandBuffer command;
-  IVK_ASSERT(vkAllocateCommandBuffers(context.device, &allocInfo, &command),
-             "Failed to allocate sintle time command");
+  //=========================
+  // Sort keys
+  //=========================
+  // Pipelines are numbered in order of first use, resolved once per material
+  Ice::ScratchVector<u32> materialPipelines(_data->materials->GetAllocatedSize(), Ice::null32);
+  Ice::ScratchVector<VkPipeline> pipelines;
 
-  // Begin command recording =====
-  VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-  vkBeginCommandBuffer(command, &beginInfo);
+  // Depth is measured along the first camera's view, so instances of a group draw front to back
+  b8 hasView = false;
+  f32 viewPosition[3] = {};
+  f32 viewForward[3] = {};
+  u32 cameraCount = 0;
+  Ice::CameraComponent* cameras = _data->cameras->GetArray(&cameraCount);
+  if (cameraCount > 0 && cameras[0].buffer.vulkan.mapped != nullptr)
+  {
+    const Ice::CameraData* view = (Ice::CameraData*)cameras[0].buffer.vulkan.mapped;
+    viewPosition[0] = view->position.x;
+    viewPosition[1] = view->position.y;
+    viewPosition[2] = view->position.z;
+    viewForward[0] = view->forward.x;
+    viewForward[1] = view->forward.y;
+    viewForward[2] = view->forward.z;
+    hasView = true;
+  }
 
-  return command;
-}
+  const Ice::Buffer* transforms = _data->transforms;
 
-b8 Ice::RendererVulkan::EndSingleTimeCommand(VkCommandBuffer& _command,
-                                             VkCommandPool _pool,
-                                             VkQueue _queue)
-{
-  // Complete recording =====
-  IVK_ASSERT(vkEndCommandBuffer(_command),
-             "Failed to record single-time command buffer");
+  Ice::ScratchVector<u64> keys(count);
+  Ice::ScratchVector<u32> order(count);
+  for (u32 i = 0; i < count; i++)
+  {
+    const Ice::RenderComponent& rc = renderables[i];
 
-  // Execution =====
-  VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &_command;
+    u32& pipelineIndex = materialPipelines[rc.material];
+    if (pipelineIndex == Ice::null32)
+    {
+      VkPipeline pipeline = _data->materials->Get(rc.material)->vulkan.pipeline;
+      pipelineIndex = 0;
+      while (pipelineIndex < pipelines.size() && pipelines[pipelineIndex] != pipeline)
+      {
+        pipelineIndex++;
+      }
+      if (pipelineIndex == pipelines.size())
+        pipelines.push_back(pipeline);
+    }
 
-  IVK_ASSERT(vkQueueSubmit(_queue, 1, &submitInfo, VK_NULL_HANDLE),
-             "Failed to submit single-time command");
-  vkQueueWaitIdle(_queue);
+    u64 depth = 0;
+    if (hasView)
+    {
+      const Ice::mat4* matrix =
+        (Ice::mat4*)((char*)transforms->vulkan.mapped + (rc.transformIndex * transforms->padElementSize));
+      f32 distance = (matrix->col3.x - viewPosition[0]) * viewForward[0]
+                     + (matrix->col3.y - viewPosition[1]) * viewForward[1]
+                     + (matrix->col3.z - viewPosition[2]) * viewForward[2];
+      distance = max(distance, 0.0f);
 
-  // Destruction =====
-  vkFreeCommandBuffers(context.device, _pool, 1, &_command);
+      // Non-negative floats order the same as their bit patterns; keep the sign, exponent, and top mantissa bits
+      u32 bits;
+      Ice::MemoryCopy(&distance, &bits, sizeof(bits));
+      depth = bits >> 16;
+    }
 
-  return true;
+    // From the most significant bits : pass (4) | pipeline (12) | material (16) | mesh (16) | depth (16)
+    // Sorting on it puts draws sharing state next to each other, then orders them front to back
+    keys[i] = ((u64)(Ivk_Draw_Pass_Forward & 0xf) << 60)
+              | ((u64)(pipelineIndex & 0xfff) << 48)
+              | ((u64)(rc.material & 0xffff) << 32)
+              | ((u64)(rc.mesh & 0xffff) << 16)
+              | depth;
+    order[i] = i;
+  }
+
+  Ice::ScratchVector<u64> tempKeys(count);
+  Ice::ScratchVector<u32> tempOrder(count);
+  Ice::RadixSort(keys.data(), order.data(), count, tempKeys.data(), tempOrder.data());
+
+  //=========================
+  // Gather
+  //=========================
+  const u64 matrixSize = transforms->elementSize;
+
+  void* mapped;
+  u32 offset = ReserveFrameUniforms(count * matrixSize, &mapped);
+  char* gathered = (char*)mapped;
+
+  // Groups split on the real indices, so states whose key fields were truncated never merge
+  _groups.clear();
+  for (u32 i = 0; i < count; i++)
+  {
+    const Ice::RenderComponent& rc = renderables[order[i]];
+    Ice::MemoryCopy((char*)transforms->vulkan.mapped + (rc.transformIndex * transforms->padElementSize),
+                    gathered + (i * matrixSize),
+                    matrixSize);
+
+    if (_groups.empty() || _groups.back().material != rc.material || _groups.back().mesh != rc.mesh)
+    {
+      _groups.push_back({ rc.material, rc.mesh, i, 0 });
+    }
+    _groups.back().instanceCount++;
+  }
+
+  return offset;
 }
 
 b8 Ice::RendererVulkan::RecordCommandBuffer(u32 _commandIndex, Ice::FrameInformation* _data)
@@ -76,13 +144,56 @@ b8 Ice::RendererVulkan::RecordCommandBuffer(u32 _commandIndex, Ice::FrameInforma
   forwardBeginInfo.renderPass = context.forward.renderpass;
   forwardBeginInfo.framebuffer = context.forward.framebuffers[_commandIndex];
 
+  //=========================
+  // Frame uniforms
+  //=========================
+  // Everything drawn with is copied into this flight slot's region of the ring, which no
+  //   in-flight frame reads, so the CPU copies stay free to change
+  Ice::ScratchScope scratch;
+  Ice::ScratchVector<u32> cameraOffsets;
+  cameraOffsets.reserve(_data->cameras->Size());
+
+  const u64 alignment = context.frameUniforms.alignment;
+  u64 instanceDataSize = _data->renderables->Size() * _data->transforms->elementSize;
+  u64 frameUniformSize = FrameUniformSize(&context.globalDescriptorBuffer)
+                         + ((instanceDataSize + alignment - 1) & ~(alignment - 1));
+  for (Ice::CameraComponent& cam : *_data->cameras)
+  {
+    frameUniformSize += FrameUniformSize(&cam.buffer);
+  }
+  ICE_ATTEMPT(BeginFrameUniforms(context.currentFlightIndex, frameUniformSize));
+
+  // Transforms first, so the object set's range (a whole region) fits from their offset
+  Ice::ScratchVector<Ice::IvkInstanceGroup> groups;
+  u32 transformsOffset = PushInstanceGroups(_data, groups);
+  u32 globalOffset = PushFrameUniforms(&context.globalDescriptorBuffer);
+  for (Ice::CameraComponent& cam : *_data->cameras)
+  {
+    cameraOffsets.push_back(PushFrameUniforms(&cam.buffer));
+  }
+
   //=========================
   // Begin recording
   //=========================
   IVK_ASSERT(vkBeginCommandBuffer(cmdBuffer, &beginInfo),
              "Failed to begin command buffer %u", _commandIndex);
 
-  // Descriptor sets : 0 = Global, 1 = per-camera, 2 = per-material, 3 = per-object
+  // Take ownership of images the transfer queue has written and released
+  std::vector<VkImageMemoryBarrier>& acquires = context.staging.imageAcquires;
+  if (!acquires.empty())
+  {
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         (u32)acquires.size(), acquires.data());
+    acquires.clear();
+  }
+
+  // Descriptor sets : 0 = Global, 1 = per-camera, 2 = per-material, 3 = every object's transform
+  // Each instance selects its gathered transform through gl_InstanceIndex
 
   //=========================
   // Forward renderpass
@@ -94,59 +205,82 @@ b8 Ice::RendererVulkan::RecordCommandBuffer(u32 _commandIndex, Ice::FrameInforma
                           0,
                           1,
                           &context.globalDescriptorSet,
-                          0,
-                          nullptr);
+                          1,
+                          &globalOffset);
 
-  for (Ice::CameraComponent& cam : *_data->cameras)
+  for (u32 cameraIndex = 0; cameraIndex < cameraOffsets.size(); cameraIndex++)
   {
     vkCmdBindDescriptorSets(cmdBuffer,
                             VK_PIPELINE_BIND_POINT_GRAPHICS,
                             context.globalPipelineLayout,
                             1,
                             1,
-                            &cam.vulkan.descriptorSet,
-                            0,
-                            nullptr);
+                            &context.cameraDescriptorSet,
+                            1,
+                            &cameraOffsets[cameraIndex]);
 
-    u32 testCount = 0;
-    for (Ice::RenderComponent& rc : *_data->renderables)
+    // Groups arrive sorted by pipeline, material, then mesh, so each state is bound only when it
+    //   changes and binding work scales with unique states rather than draws
+    // Set 3 is only disturbed when set 2 is bound with an incompatible (another material's) layout
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    u32 boundMaterial = Ice::null32;
+    u32 boundMesh = Ice::null32;
+    VkPipelineLayout objectsLayout = VK_NULL_HANDLE;
+    Ice::Material* material = nullptr;
+    Ice::Mesh* mesh = nullptr;
+    for (const Ice::IvkInstanceGroup& group : groups)
     {
-      testCount++;
-      vkCmdBindPipeline(cmdBuffer,
-                        VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        _data->materials->Get(rc.material)->vulkan.pipeline);
-
-      vkCmdBindDescriptorSets(cmdBuffer,
-                              VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              _data->materials->Get(rc.material)->vulkan.pipelineLayout,
-                              2,
-                              1,
-                              &_data->materials->Get(rc.material)->vulkan.descriptorSet,
-                              0,
-                              nullptr);
-
-      vkCmdBindDescriptorSets(cmdBuffer,
-                              VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              _data->materials->Get(rc.material)->vulkan.pipelineLayout,
-                              3,
-                              1,
-                              &rc.vulkan.descriptorSet,
-                              0,
-                              nullptr);
-
-      vkCmdBindVertexBuffers(cmdBuffer,
-                             0,
-                             1,
-                             &_data->meshes->Get(rc.mesh)->mesh.vertexBuffer.buffer->vulkan.buffer,
-                             &_data->meshes->Get(rc.mesh)->mesh.vertexBuffer.offset);
-      vkCmdBindIndexBuffer(cmdBuffer,
-                           _data->meshes->Get(rc.mesh)->mesh.indexBuffer.buffer->vulkan.buffer,
-                           _data->meshes->Get(rc.mesh)->mesh.indexBuffer.offset,
-                           VK_INDEX_TYPE_UINT32);
-
-      // TODO : Instanced rendering -- DrawIndexed can use a significant amount of time
-      //  Time to render rises to 10ms with ~1000 spheres (482 verts / 960 tris, with a basic unlit shader)
-      vkCmdDrawIndexed(cmdBuffer, _data->meshes->Get(rc.mesh)->mesh.indexCount, 1, 0, 0, 0);
+      if (group.material != boundMaterial)
+      {
+        material = _data->materials->Get(group.material);
+
+        if (material->vulkan.pipeline != boundPipeline)
+        {
+          vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material->vulkan.pipeline);
+          boundPipeline = material->vulkan.pipeline;
+        }
+
+        vkCmdBindDescriptorSets(cmdBuffer,
+                                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                material->vulkan.pipelineLayout,
+                                2,
+                                1,
+                                &material->vulkan.descriptorSet,
+                                0,
+                                nullptr);
+        boundMaterial = group.material;
+
+        if (objectsLayout != material->vulkan.pipelineLayout)
+        {
+          vkCmdBindDescriptorSets(cmdBuffer,
+                                  VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  material->vulkan.pipelineLayout,
+                                  3,
+                                  1,
+                                  &context.objectDescriptorSet,
+                                  1,
+                                  &transformsOffset);
+          objectsLayout = material->vulkan.pipelineLayout;
+        }
+      }
+
+      if (group.mesh != boundMesh)
+      {
+        mesh = &_data->meshes->Get(group.mesh)->mesh;
+
+        vkCmdBindVertexBuffers(cmdBuffer,
+                               0,
+                               1,
+                               &mesh->vertexBuffer.buffer->vulkan.buffer,
+                               &mesh->vertexBuffer.offset);
+        vkCmdBindIndexBuffer(cmdBuffer,
+                             mesh->indexBuffer.buffer->vulkan.buffer,
+                             mesh->indexBuffer.offset,
+                             VK_INDEX_TYPE_UINT32);
+        boundMesh = group.mesh;
+      }
+
+      vkCmdDrawIndexed(cmdBuffer, mesh->indexCount, group.instanceCount, 0, 0, group.firstInstance);
     }
   }
   vkCmdEndRenderPass(cmdBuffer);
@@ -17,10 +17,16 @@ b8 Ice::RendererVulkan::Init(Ice::RendererSettingsCore _settings, const char* _t
   ICE_ATTEMPT(CreateSurface());
   ICE_ATTEMPT(ChoosePhysicalDevice());
   ICE_ATTEMPT(CreateLogicalDevice());
+  ICE_ATTEMPT(context.memory.Initialize(context.device,
+                                        context.gpu.memoryProperties,
+                                        context.gpu.properties.limits.nonCoherentAtomSize,
+                                        context.alloc));
 
   ICE_ATTEMPT(CreateDescriptorPool());
   ICE_ATTEMPT(CreateCommandPool());
   ICE_ATTEMPT(CreateCommandPool(true));
+  ICE_ATTEMPT(CreateStagingRing());
+  ICE_ATTEMPT(CreateFrameUniformRing(ICE_VULKAN_FRAME_UNIFORM_REGION_SIZE));
 
   ICE_ATTEMPT(CreateSwapchain());
   ICE_ATTEMPT(CreateSyncObjects());
@@ -49,6 +55,13 @@ b8 Ice::RendererVulkan::RenderFrame(Ice::FrameInformation* _data)
                              3000000000), // 3 second timeout
              "Flight slot wait fence failed");
 
+  // Every frame up to the one last submitted from this slot has completed
+  if (context.submittedFrameCount >= ICE_MAX_FLIGHT_IMAGE_COUNT)
+  {
+    context.completedFrameCount = context.submittedFrameCount - ICE_MAX_FLIGHT_IMAGE_COUNT + 1;
+  }
+  ReleaseRetiredResources();
+
   result = vkAcquireNextImageKHR(context.device,
                                  context.swapchain,
                                  UINT64_MAX,
@@ -66,14 +79,37 @@ b8 Ice::RendererVulkan::RenderFrame(Ice::FrameInformation* _data)
     return false;
   }
 
+  // Uploads =====
+  // Copies queued since the last frame must land before this one reads them
+  // Submitted before recording so the frame can acquire the images they release
+  VkSemaphore stagingComplete = VK_NULL_HANDLE;
+  ICE_ATTEMPT(SubmitStagingCopies(&stagingComplete));
+
+  Ice::IvkStagingRing& staging = context.staging;
+  staging.lastFrameStats = staging.frameStats;
+  staging.totalStats.bytes += staging.frameStats.bytes;
+  staging.totalStats.writeCount += staging.frameStats.writeCount;
+  staging.totalStats.copyCount += staging.frameStats.copyCount;
+  staging.totalStats.submitCount += staging.frameStats.submitCount;
+  staging.frameStats = {};
+
   // Submit a command buffer =====
+  context.currentFlightIndex = flightSlotIndex;
   RecordCommandBuffer(swapchainImageIndex, _data);
 
-  VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+  // Make the frame's host writes to non-coherent memory visible before the GPU reads them
+  ICE_ATTEMPT(context.memory.FlushQueued());
+
+  VkSemaphore waitSemaphores[] = { context.imageAvailableSemaphores[flightSlotIndex], stagingComplete };
+  VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT |
+                                        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                                        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
 
   VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = &context.imageAvailableSemaphores[flightSlotIndex];
+  submitInfo.waitSemaphoreCount = (stagingComplete != VK_NULL_HANDLE) ? 2 : 1;
+  submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &context.commandBuffers[swapchainImageIndex];
@@ -89,6 +125,7 @@ b8 Ice::RendererVulkan::RenderFrame(Ice::FrameInformation* _data)
                            &submitInfo,
                            context.flightSlotAvailableFences[flightSlotIndex]),
              "Failed to submit draw command");
+  context.submittedFrameCount++;
 
   // Present =====
   VkPresentInfoKHR presentInfo{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
@@ -107,7 +144,7 @@ b8 Ice::RendererVulkan::RenderFrame(Ice::FrameInformation* _data)
   }
   else if (result != VK_SUCCESS)
   {
-    IceLogFatal("Failed to present the swapchain");
+    IceLogFatalIn(Ice::Log_Category_Renderer, "Failed to present the swapchain");
     return false;
   }
 
@@ -170,12 +207,22 @@ b8 Ice::RendererVulkan::Shutdown()
   vkDestroySwapchainKHR(context.device, context.swapchain, context.alloc);
 
   DestroyImage(&defaultTexture);
+  DestroyStagingRing();
+  DestroyBufferMemory(&context.frameUniforms.buffer);
+
+  // Everything destroyed above (and by the application beforehand) was only retired
+  ReleaseRetiredResources(true);
 
   // Pools =====
   vkDestroyCommandPool(context.device, context.graphicsCommandPool, context.alloc);
   vkDestroyCommandPool(context.device, context.transientCommandPool, context.alloc);
   vkDestroyDescriptorPool(context.device, context.descriptorPool, context.alloc);
 
+  // Memory =====
+  LogMemoryStats();
+  context.memory.LogOccupancy();
+  context.memory.Shutdown();
+
   // Device =====
   vkDestroyDevice(context.device, context.alloc);
   vkDestroySurfaceKHR(context.instance, context.surface, context.alloc);
@@ -188,7 +235,7 @@ b8 Ice::RendererVulkan::Resize()
 {
   vkDeviceWaitIdle(context.device);
 
-  IceLogDebug(">>> Resizing");
+  IceLogDebugIn(Ice::Log_Category_Renderer, ">>> Resizing");
 
   // Destroy frame components =====
   //Renderpasses
@@ -233,7 +280,7 @@ b8 Ice::RendererVulkan::Resize()
     UpdateCameraProjection(cc, cc->settings);
   }
 
-  IceLogDebug(">>> Complete");
+  IceLogDebugIn(Ice::Log_Category_Renderer, ">>> Complete");
 
   return true;
 }
@@ -302,7 +349,7 @@ b8 Ice::RendererVulkan::ChoosePhysicalDevice()
 
   if (context.gpu.device == VK_NULL_HANDLE)
   {
-    IceLogFatal("Failed to select a physical device");
+    IceLogFatalIn(Ice::Log_Category_Renderer, "Failed to select a physical device");
     return false;
   }
 
@@ -343,10 +390,11 @@ b8 Ice::RendererVulkan::ChoosePhysicalDevice()
       || context.gpu.presentQueueIndex == ~0U
       || context.gpu.transientQueueIndex == ~0U)
   {
-    IceLogFatal("Some of the queue indices are invalid (G : %u, P : %u, T : %u)",
-                context.gpu.graphicsQueueIndex,
-                context.gpu.presentQueueIndex,
-                context.gpu.transientQueueIndex);
+    IceLogFatalIn(Ice::Log_Category_Renderer,
+                  "Some of the queue indices are invalid (G : %u, P : %u, T : %u)",
+                  context.gpu.graphicsQueueIndex,
+                  context.gpu.presentQueueIndex,
+                  context.gpu.transientQueueIndex);
     return false;
   }
 
@@ -377,7 +425,9 @@ u32 Ice::RendererVulkan::GetIndexForQueue(VkQueueFlags _flags)
 
   if (bestFit == ~0U)
   {
-    IceLogError("Failed to find a device queue that matches the input %u", _flags);
+    IceLogErrorIn(Ice::Log_Category_Renderer,
+                  "Failed to find a device queue that matches the input %u",
+                  _flags);
   }
   return bestFit;
 }
@@ -409,7 +459,7 @@ u32 Ice::RendererVulkan::GetPresentQueue()
 
   if (bestFit == ~0U)
   {
-    IceLogError("Failed to find a device queue that supports presentation");
+    IceLogErrorIn(Ice::Log_Category_Renderer, "Failed to find a device queue that supports presentation");
   }
   return bestFit;
 }
@@ -456,8 +506,9 @@ b8 Ice::RendererVulkan::CreateLogicalDevice()
                                    context.gpu.presentQueueIndex,
                                    context.gpu.transientQueueIndex };
 
-  IceLogInfo("%s -- Graphics : %u -- Presentation : %u -- Transfer : %u",
-             context.gpu.properties.deviceName, queueIndices[0], queueIndices[1], queueIndices[2]);
+  IceLogInfoIn(Ice::Log_Category_Renderer,
+               "%s -- Graphics : %u -- Presentation : %u -- Transfer : %u",
+               context.gpu.properties.deviceName, queueIndices[0], queueIndices[1], queueIndices[2]);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos(queueCount);
   for (u32 i = 0; i < queueCount; i++)
@@ -472,6 +523,29 @@ b8 Ice::RendererVulkan::CreateLogicalDevice()
   // Extensions & Layers =====
   std::vector<const char*> extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
+  u32 availableCount = 0;
+  vkEnumerateDeviceExtensionProperties(context.gpu.device, nullptr, &availableCount, nullptr);
+  std::vector<VkExtensionProperties> availableExtensions(availableCount);
+  vkEnumerateDeviceExtensionProperties(context.gpu.device,
+                                       nullptr,
+                                       &availableCount,
+                                       availableExtensions.data());
+
+  // Optional : the budget is queried through vkGetPhysicalDeviceMemoryProperties2 (core in 1.1)
+  context.gpu.memoryBudgetSupported = false;
+  if (context.gpu.properties.apiVersion >= VK_API_VERSION_1_1)
+  {
+    for (const VkExtensionProperties& extension : availableExtensions)
+    {
+      if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+      {
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        context.gpu.memoryBudgetSupported = true;
+        break;
+      }
+    }
+  }
+
   std::vector<const char*> layers;
 #ifdef ICE_DEBUG
   layers.push_back("VK_LAYER_KHRONOS_validation");
@@ -501,7 +575,7 @@ b8 Ice::RendererVulkan::CreateLogicalDevice()
 b8 Ice::RendererVulkan::CreateDescriptorPool()
 {
   // Size definitions =====
-  const u32 poolSizeCount = 2;
+  const u32 poolSizeCount = 4;
   VkDescriptorPoolSize sizes[poolSizeCount] = {};
 
   // TODO : Make max uniform descriptor/image descriptor/set counts adjustable
@@ -511,10 +585,19 @@ b8 Ice::RendererVulkan::CreateDescriptorPool()
   sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
   sizes[1].descriptorCount = 2048; // TMP
 
+  // Global, camera, and object sets
+  // Replaced sets are kept until the frames using them complete when the frame uniforms grow
+  sizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  sizes[2].descriptorCount = 2 * (ICE_MAX_FLIGHT_IMAGE_COUNT + 1);
+
+  sizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+  sizes[3].descriptorCount = ICE_MAX_FLIGHT_IMAGE_COUNT + 1;
+
   // Creation =====
   VkDescriptorPoolCreateInfo createInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
   createInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-  createInfo.maxSets = 1024; // 0 = Global, 1 = per-camera, 2 = per-material, 3 = per-object
+  // Only materials have sets of their own; 0 = Global, 1 = per-camera, 2 = per-material, 3 = objects
+  createInfo.maxSets = 1024;
   createInfo.poolSizeCount = poolSizeCount;
   createInfo.pPoolSizes = sizes;
 
@@ -534,7 +617,7 @@ b8 Ice::RendererVulkan::CreateCommandPool(b8 _createTransient /*= false*/)
 
   if (_createTransient)
   { // Transfer =====
-    createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     createInfo.queueFamilyIndex = context.gpu.transientQueueIndex;
     poolPtr = &context.transientCommandPool;
   }
@@ -606,10 +689,11 @@ b8 Ice::RendererVulkan::CreateSwapchain()
       Ice::vec2U e = GetWindowExtents();
       extent = { e.width, e.height };
     }
-    IceLogInfo("Swapchain using: extents (%u, %u) -- format %d",
-               extent.width,
-               extent.height,
-               format);
+    IceLogInfoIn(Ice::Log_Category_Renderer,
+                 "Swapchain using: extents (%u, %u) -- format %d",
+                 extent.width,
+                 extent.height,
+                 format);
 
     // Creation =====
 
@@ -727,45 +811,150 @@ b8 Ice::RendererVulkan::CreateCommandBuffers()
   return true;
 }
 
+//=========================
+// Retirement
+//=========================
+
+void Ice::RendererVulkan::Retire(Ice::IvkRetiredResource _resource)
+{
+  _resource.frame = context.submittedFrameCount;
+  context.retiredResources.push_back(_resource);
+}
+
+void Ice::RendererVulkan::ReleaseRetiredResources(b8 _all /*= false*/)
+{
+  u32 releasedCount = 0;
+  for (Ice::IvkRetiredResource& retired : context.retiredResources)
+  {
+    // Retired in submission order
+    if (!_all && retired.frame >= context.completedFrameCount)
+      break;
+
+    if (retired.buffer.buffer != VK_NULL_HANDLE)
+    {
+      if (retired.buffer.mapped != nullptr)
+        context.memory.Unmap(retired.buffer.allocation);
+      vkDestroyBuffer(context.device, retired.buffer.buffer, context.alloc);
+      context.memory.Free(&retired.buffer.allocation);
+    }
+
+    if (retired.image.image != VK_NULL_HANDLE)
+    {
+      vkDestroySampler(context.device, retired.image.sampler, context.alloc);
+      vkDestroyImageView(context.device, retired.image.view, context.alloc);
+      vkDestroyImage(context.device, retired.image.image, context.alloc);
+      context.memory.Free(&retired.image.allocation);
+    }
+
+    if (retired.descriptorSet != VK_NULL_HANDLE)
+      vkFreeDescriptorSets(context.device, context.descriptorPool, 1, &retired.descriptorSet);
+    if (retired.descriptorSetLayout != VK_NULL_HANDLE)
+      vkDestroyDescriptorSetLayout(context.device, retired.descriptorSetLayout, context.alloc);
+    if (retired.pipeline != VK_NULL_HANDLE)
+      vkDestroyPipeline(context.device, retired.pipeline, context.alloc);
+    if (retired.pipelineLayout != VK_NULL_HANDLE)
+      vkDestroyPipelineLayout(context.device, retired.pipelineLayout, context.alloc);
+
+    releasedCount++;
+  }
+
+  context.retiredResources.erase(context.retiredResources.begin(),
+                                 context.retiredResources.begin() + releasedCount);
+}
+
+//=========================
+// Memory statistics
+//=========================
+
+void Ice::RendererVulkan::GetMemoryStats(Ice::GpuMemoryStats* _stats)
+{
+  context.memory.GetMemoryStats(_stats);
+
+  if (!context.gpu.memoryBudgetSupported)
+    return;
+
+  // Includes memory allocated by other processes' and APIs' use of the heap
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+  VkPhysicalDeviceMemoryProperties2 properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+  properties.pNext = &budget;
+  vkGetPhysicalDeviceMemoryProperties2(context.gpu.device, &properties);
+
+  for (u32 i = 0; i < _stats->heapCount; i++)
+  {
+    _stats->heaps[i].budget = budget.heapBudget[i];
+    _stats->heaps[i].usage = budget.heapUsage[i];
+  }
+  _stats->budgetReported = true;
+}
+
+void Ice::RendererVulkan::LogMemoryStats()
+{
+  Ice::GpuMemoryStats stats;
+  GetMemoryStats(&stats);
+
+  IceLog(Ice::Log_Type_Info,
+         Ice::Log_Category_Renderer,
+         "Device memory heaps (%s budget) :\n%-5s %-6s %14s %14s %14s %14s",
+         stats.budgetReported ? "driver" : "estimated",
+         "Heap", "Local", "Size", "Budget", "Usage", "Allocated");
+  for (u32 i = 0; i < stats.heapCount; i++)
+  {
+    const Ice::GpuMemoryHeapStats& heap = stats.heaps[i];
+    IceLog(Ice::Log_Type_Info,
+           Ice::Log_Category_Renderer,
+           "%-5u %-6s %14llu %14llu %14llu %14llu",
+           i,
+           heap.deviceLocal ? "yes" : "no",
+           heap.size,
+           heap.budget,
+           heap.usage,
+           heap.allocatedBytes);
+
+    if (heap.usage > heap.budget)
+    {
+      IceLog(Ice::Log_Type_Warning,
+             Ice::Log_Category_Renderer,
+             "Device memory heap %u is over budget by %llu bytes",
+             i,
+             heap.usage - heap.budget);
+    }
+  }
+
+  IceLog(Ice::Log_Type_Info,
+         Ice::Log_Category_Renderer,
+         "Device memory categories :\n%-10s %14s %14s %10s",
+         "Category", "Live bytes", "Peak bytes", "Live");
+  for (u32 i = 0; i < Ice::Gpu_Memory_Category_Count; i++)
+  {
+    IceLog(Ice::Log_Type_Info,
+           Ice::Log_Category_Renderer,
+           "%-10s %14llu %14llu %10llu",
+           Ice::GpuMemoryCategoryName((Ice::GpuMemoryCategories)i),
+           stats.categories[i].liveBytes,
+           stats.categories[i].peakBytes,
+           stats.categories[i].liveCount);
+  }
+}
+
 b8 Ice::RendererVulkan::InitializeRenderComponent(Ice::RenderComponent* _component,
                                                   Ice::BufferSegment const _transformBuffer)
 {
-  ICE_ATTEMPT(CreateDescriptorSet(&context.objectDescriptorLayout,
-                                  &_component->vulkan.descriptorSet));
-
-  return UpdateShaderBindings(&_component->vulkan.descriptorSet, _transformBuffer);
+  _component->transformIndex = _transformBuffer.startIndex;
+  return true;
 }
 
 b8 Ice::RendererVulkan::UpdateRenderComponent(Ice::RenderComponent* const _component,
                                               Ice::BufferSegment const _transformBufferSegment)
 {
-  return UpdateShaderBindings(&_component->vulkan.descriptorSet, _transformBufferSegment);
+  _component->transformIndex = _transformBufferSegment.startIndex;
+  return true;
 }
 
 b8 Ice::RendererVulkan::UpdateCameraComponent(Ice::CameraComponent* const _camera,
                                               Ice::BufferSegment const _transformBufferSegment)
 {
-  Ice::BufferSegment segment;
-  segment.buffer = &_camera->buffer;
-  segment.elementSize = _camera->buffer.elementSize;
-  segment.count = 1;
-  segment.offset = 0;
-  segment.startIndex = 0;
-
-  return UpdateShaderBindings(&_camera->vulkan.descriptorSet, segment);
-}
-
-// TODO : Abstract descriptor bindings so they are easier to work with
-b8 Ice::RendererVulkan::UpdateShaderBindings(VkDescriptorSet* const _set,
-                                             Ice::BufferSegment const _transformBufferSegment)
-{
-  Ice::ShaderInputElement bufferInput;
-  bufferInput.inputIndex = 0;
-  bufferInput.type = Ice::Shader_Input_Buffer;
-  bufferInput.bufferSegment = _transformBufferSegment;
-  std::vector<Ice::ShaderInputElement> inputs = { bufferInput };
-  UpdateDescriptorSet(_set, inputs);
-
+  // The camera's buffer is copied into the frame uniform ring every frame
   return true;
 }
 
@@ -780,22 +969,11 @@ b8 Ice::RendererVulkan::InitializeCamera(Ice::CameraComponent* _camera,
 {
   UpdateCameraProjection(_camera, _settings);
 
-  ICE_ATTEMPT(CreateBufferMemory(&_camera->buffer,
-                                 sizeof(Ice::CameraData),
-                                 1,
-                                 Ice::Buffer_Memory_Shader_Read | Ice::Buffer_Memory_Transfer_Dst));
-
-  // Create descriptor set =====
-  ICE_ATTEMPT(CreateDescriptorSet(&context.cameraDescriptorLayout, &_camera->vulkan.descriptorSet));
-
-  Ice::BufferSegment segment;
-  segment.buffer = &_camera->buffer;
-  segment.elementSize = _camera->buffer.elementSize;
-  segment.count = 1;
-  segment.offset = 0;
-  segment.startIndex = 0;
-
-  return UpdateShaderBindings(&_camera->vulkan.descriptorSet, segment);
+  return CreateBufferMemory(&_camera->buffer,
+                            sizeof(Ice::CameraData),
+                            1,
+                            Ice::Buffer_Memory_Shader_Read,
+                            Ice::Buffer_Memory_Hint_Per_Frame);
 }
 
 b8 Ice::RendererVulkan::UpdateCameraProjection(Ice::CameraComponent* _camera,
@@ -812,7 +990,7 @@ b8 Ice::RendererVulkan::UpdateCameraProjection(Ice::CameraComponent* _camera,
   }
   else
   {
-    IceLogWarning("Orthographic camera funcionality not currently working");
+    IceLogWarningIn(Ice::Log_Category_Renderer, "Orthographic camera funcionality not currently working");
     glmMatrix = glm::ortho(0.0f,
                            _settings.height * _settings.ratio,
                            0.0f,
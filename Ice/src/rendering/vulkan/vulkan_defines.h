@@ -12,6 +12,25 @@
 
 namespace Ice {
 
+//=========================
+// Memory
+//=========================
+
+// A range of device memory handed out by the IvkMemoryAllocator
+struct IvkAllocation
+{
+  VkDeviceMemory memory;
+  VkDeviceSize offset; // Bytes into memory
+  VkDeviceSize size;   // Bytes reserved, which may be more than were requested
+
+  u32 memoryType;
+  u32 blockIndex; // Ice::null32 for dedicated allocations
+  u8 pool;        // Ice::IvkMemoryPools
+  u8 order;       // Buddy order within the block (size = minimum node size << order)
+  u8 category;    // Ice::GpuMemoryCategories
+  u32 generation; // Linear pools : the block's generation when allocated
+};
+
 //=========================
 // Image
 //=========================
@@ -25,7 +44,9 @@ struct IvkImage
   VkFormat format;
   VkImageLayout layout;
 
-  VkDeviceMemory memory;
+  Ice::IvkAllocation allocation;
+
+  u64 uploadSerial; // Staging submission that finishes writing the image, 0 if none
 };
 
 //=========================
@@ -35,7 +56,13 @@ struct IvkImage
 struct IvkBuffer
 {
   VkBuffer buffer;
-  VkDeviceMemory memory;
+  Ice::IvkAllocation allocation;
+  void* mapped; // Host-visible buffers stay mapped for their lifetime, nullptr otherwise
+
+  // Destination bytes spanned by the writes queued in the staging ring's current batch
+  u64 stagedBatch;
+  u64 stagedStart;
+  u64 stagedEnd;
 };
 
 //=========================
@@ -80,12 +107,9 @@ struct Gpu
   u32 graphicsQueueIndex;
   u32 presentQueueIndex;
   u32 transientQueueIndex;
-};
 
-// Per-object data
-struct IvkObjectData
-{
-  VkDescriptorSet descriptorSet; // Shader input data
+  // VK_EXT_memory_budget is enabled, so heap budgets and usage can be read from the driver
+  b8 memoryBudgetSupported;
 };
 
 } // namespace Ice
@@ -6,93 +6,6 @@
 
 #include <vector>
 
-u32 FindMemoryType(const VkPhysicalDeviceMemoryProperties& _properties,
-                   u32 _mask,
-                   VkMemoryPropertyFlags _flags)
-{
-  for (u32 i = 0; i < _properties.memoryTypeCount; i++)
-  {
-    if (_mask & (1 << i) && (_properties.memoryTypes[i].propertyFlags & _flags) == _flags)
-    {
-      return i;
-    }
-  }
-
-  IceLogError("Failed to find a suitable memory type -- Mask : %u, Flags : %u", _mask, _flags);
-  return -1;
-}
-
-void Ice::RendererVulkan::TransitionImageLayout(Ice::Image* _image,
-                                                b8 _toWritable,
-                                                VkPipelineStageFlagBits _shaderStage)
-{
-  VkCommandBuffer command = BeginSingleTimeCommand(context.graphicsCommandPool);
-
-  VkImageMemoryBarrier memBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-  memBarrier.oldLayout = _image->vulkan.layout;
-  memBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  memBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  memBarrier.image = _image->vulkan.image;
-  memBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  memBarrier.subresourceRange.levelCount = 1;
-  memBarrier.subresourceRange.baseMipLevel = 0;
-  memBarrier.subresourceRange.layerCount = 1;
-  memBarrier.subresourceRange.baseArrayLayer = 0;
-
-  VkPipelineStageFlagBits srcStage, dstStage;
-
-  if (!_toWritable)
-  {
-    memBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    memBarrier.srcAccessMask = 0;
-    memBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-    srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-  }
-  else
-  {
-    memBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    memBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    memBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    dstStage = _shaderStage;
-  }
-
-  vkCmdPipelineBarrier(command, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &memBarrier);
-  EndSingleTimeCommand(command, context.graphicsCommandPool, context.graphicsQueue);
-
-  _image->vulkan.layout = memBarrier.newLayout;
-}
-
-void Ice::RendererVulkan::CopyBufferToImage(Ice::Buffer* _buffer, Ice::Image* _image)
-{
-  VkCommandBuffer command = BeginSingleTimeCommand(context.transientCommandPool);
-
-  VkBufferImageCopy copyRegion{};
-  copyRegion.bufferOffset = 0;
-  copyRegion.bufferRowLength = _image->extents.width;
-  copyRegion.bufferImageHeight = _image->extents.height;
-
-  copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  copyRegion.imageSubresource.mipLevel = 0;
-  copyRegion.imageSubresource.layerCount = 1;
-  copyRegion.imageSubresource.baseArrayLayer = 0;
-
-  copyRegion.imageOffset = { 0, 0, 0 };
-  copyRegion.imageExtent = { _image->extents.width, _image->extents.height, 1 };
-
-  vkCmdCopyBufferToImage(command,
-                         _buffer->vulkan.buffer,
-                         _image->vulkan.image,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                         1,
-                         &copyRegion);
-
-  EndSingleTimeCommand(command, context.transientCommandPool, context.transientQueue);
-}
-
 b8 Ice::RendererVulkan::CreateTexture(Ice::Image* _image, void* _data)
 {
   // Create image resources =====
@@ -110,41 +23,45 @@ b8 Ice::RendererVulkan::CreateTexture(Ice::Image* _image, void* _data)
   _image->vulkan.layout = VK_IMAGE_LAYOUT_UNDEFINED;
 
   // Fill the image =====
-  Ice::Buffer copyBuffer;
-  ICE_ATTEMPT(CreateBufferMemory(&copyBuffer,
-                                 _image->extents.x * _image->extents.y * 4, // Pixels * rgba
-                                 1,
-                                 Ice::Buffer_Memory_Transfer_Src));
+  // Recorded with every other queued upload, and acquired by the graphics queue in the next frame
+  ICE_ATTEMPT(StageImageCopy(_data, _image, 4)); // rgba
 
-  Ice::BufferSegment segment{};
-  segment.elementSize = _image->extents.x * _image->extents.y * 4;
-  segment.count = 1;
-  segment.buffer = &copyBuffer;
-  PushDataToBuffer(_data, segment);
+  return true;
+}
 
-  TransitionImageLayout(_image, false, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
-  CopyBufferToImage(&copyBuffer, _image);
-  TransitionImageLayout(_image, true, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+b8 Ice::RendererVulkan::IsTextureUploaded(const Ice::Image* _image)
+{
+  RetireStagingSubmissions(false);
+  return context.staging.completedSerial >= _image->vulkan.uploadSerial;
+}
 
-  _image->vulkan.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+b8 Ice::RendererVulkan::FinishUploads()
+{
+  ICE_ATTEMPT(SubmitStagingCopies(nullptr));
 
-  DestroyBufferMemory(&copyBuffer);
+  while (context.staging.submissions[context.staging.oldest].pending)
+  {
+    RetireStagingSubmissions(true);
+  }
 
   return true;
 }
 
 void Ice::RendererVulkan::DestroyImage(Ice::Image* _image)
 {
-  vkDestroySampler(context.device, _image->vulkan.sampler, context.alloc);
-  vkDestroyImageView(context.device, _image->vulkan.view, context.alloc);
-  vkFreeMemory(context.device, _image->vulkan.memory, context.alloc);
-  vkDestroyImage(context.device, _image->vulkan.image, context.alloc);
+  // Materials may still sample it in frames in flight
+  Ice::IvkRetiredResource retired;
+  retired.image = _image->vulkan;
+  Retire(retired);
+
+  _image->vulkan.image = VK_NULL_HANDLE;
 }
 
 b8 Ice::RendererVulkan::CreateImage(Ice::IvkImage* _image,
                                     VkExtent2D _extents,
                                     VkFormat _format,
-                                    VkImageUsageFlags _usage)
+                                    VkImageUsageFlags _usage,
+                                    Ice::IvkMemoryPools _pool /*= Ivk_Memory_Pool_General*/)
 {
   // Creation =====
   VkImageCreateInfo createInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
@@ -165,24 +82,36 @@ b8 Ice::RendererVulkan::CreateImage(Ice::IvkImage* _image,
              "Failed to create an image");
 
   _image->format = _format;
+  _image->uploadSerial = 0;
 
   // Image memory =====
   VkMemoryRequirements memoryReq;
   vkGetImageMemoryRequirements(context.device, _image->image, &memoryReq);
 
-  VkMemoryAllocateInfo memoryAlloc{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-  memoryAlloc.allocationSize = memoryReq.size;
-
-  // Search for an applicable memory type index
-  memoryAlloc.memoryTypeIndex = FindMemoryType(context.gpu.memoryProperties,
-                                               memoryReq.memoryTypeBits,
-                                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-  IVK_ASSERT(vkAllocateMemory(context.device, &memoryAlloc, context.alloc, &_image->memory),
-             "Failed to allocate image memory");
+  const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                                            | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  Ice::GpuMemoryCategories category = (_usage & attachmentUsage) ? Ice::Gpu_Memory_Attachment
+                                                                 : Ice::Gpu_Memory_Texture;
+
+  if (!context.memory.Allocate(memoryReq,
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                               _pool,
+                               category,
+                               true,
+                               &_image->allocation))
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer, "Failed to allocate image memory : size %llu", memoryReq.size);
+    LogMemoryStats();
+    vkDestroyImage(context.device, _image->image, context.alloc);
+    _image->image = VK_NULL_HANDLE;
+    return false;
+  }
 
   // Binding =====
-  IVK_ASSERT(vkBindImageMemory(context.device, _image->image, _image->memory, 0),
+  IVK_ASSERT(vkBindImageMemory(context.device,
+                               _image->image,
+                               _image->allocation.memory,
+                               _image->allocation.offset),
              "Failed to bind an image and its memory");
 
   return true;
@@ -240,7 +169,7 @@ b8 Ice::RendererVulkan::DestroyImage(Ice::IvkImage* _image)
 {
   vkDestroyImage(context.device, _image->image, context.alloc);
   vkDestroyImageView(context.device, _image->view, context.alloc);
-  vkFreeMemory(context.device, _image->memory, context.alloc);
+  context.memory.Free(&_image->allocation);
 
   return true;
 }
@@ -3,7 +3,9 @@
 
 #include "rendering/vulkan/vulkan.h"
 #include "core/platform/platform.h"
+#include "core/platform/memory_pool.h"
 #include "tools/lexer.h"
+#include "tools/fixed_array.h"
 
 #include <string>
 #include <vector>
@@ -15,7 +17,7 @@ b8 Ice::RendererVulkan::CreateShader(Ice::ShaderSettings _settings, Ice::Shader*
   case Shader_Vertex: _settings.fileDirectory.append(".vert"); break;
   case Shader_Fragment: _settings.fileDirectory.append(".frag"); break;
   case Shader_Compute: _settings.fileDirectory.append(".comp"); break;
-  default: IceLogError("Shader type unknown"); return {};
+  default: IceLogErrorIn(Ice::Log_Category_Renderer, "Shader type unknown"); return {};
   }
 
   _shader->settings = _settings;
@@ -28,16 +30,15 @@ b8 Ice::RendererVulkan::CreateShader(Ice::ShaderSettings _settings, Ice::Shader*
 
 void Ice::RendererVulkan::DestroyShader(Ice::Shader& _shader)
 {
-  vkDeviceWaitIdle(context.device);
+  // Pipelines don't reference their modules once created, so frames in flight are unaffected
   vkDestroyShaderModule(context.device, _shader.vulkan.module, context.alloc);
+  _shader.vulkan.module = VK_NULL_HANDLE;
 }
 
 b8 Ice::RendererVulkan::ReloadShader(Ice::Shader* _shader)
 {
-  vkDeviceWaitIdle(context.device);
-
-  vkDestroyShaderModule(context.device, _shader->vulkan.module, context.alloc);
-  _shader->input.clear();
+  DestroyShader(*_shader);
+  _shader->input.Clear();
 
   ICE_ATTEMPT(CreateShaderModule(_shader));
   _shader->input = LoadShaderDescriptors(_shader);
@@ -67,7 +68,7 @@ b8 Ice::RendererVulkan::CreateShaderModule(Ice::Shader* _shader)
   return true;
 }
 
-std::vector<Ice::ShaderInputElement> Ice::RendererVulkan::LoadShaderDescriptors(Ice::Shader* _shader)
+Ice::InlineArray<Ice::ShaderInputElement, 8> Ice::RendererVulkan::LoadShaderDescriptors(Ice::Shader* _shader)
 {
   // Descriptor loading could be useful across APIs, and most of the code will not change
   //  Should eventually look into abstracting this.
@@ -83,7 +84,7 @@ std::vector<Ice::ShaderInputElement> Ice::RendererVulkan::LoadShaderDescriptors(
   Ice::LexerToken token;
 
   Ice::ShaderInputElement newInput{};
-  std::vector<ShaderInputElement> tmpInputs;
+  Ice::InlineArray<ShaderInputElement, 8> tmpInputs;
 
   while (!lexer.CompletedStream())
   {
@@ -101,7 +102,10 @@ std::vector<Ice::ShaderInputElement> Ice::RendererVulkan::LoadShaderDescriptors(
                                                false);
         if (typeIndex == (u32)Ice::Shader_Input_Count)
         {
-          IceLogWarning("Invalid descriptor '%s'\n> '%s'", token.string.c_str(), directory.c_str());
+          IceLogWarningIn(Ice::Log_Category_Asset,
+                          "Invalid descriptor '%s'\n> '%s'",
+                          token.string.c_str(),
+                          directory.c_str());
           continue;
         }
         newInput.type = (ShaderInputTypes)typeIndex;
@@ -109,9 +113,10 @@ std::vector<Ice::ShaderInputElement> Ice::RendererVulkan::LoadShaderDescriptors(
         // Get input index
         if (!lexer.ExpectType(Ice::Token_Decimal, &token))
         {
-          IceLogError("Binding '%s' is missing an index. Ignoring this binding.\n> '%s'",
-                      token.string.c_str(),
-                      _shader->settings.fileDirectory.c_str());
+          IceLogErrorIn(Ice::Log_Category_Asset,
+                        "Binding '%s' is missing an index. Ignoring this binding.\n> '%s'",
+                        token.string.c_str(),
+                        _shader->settings.fileDirectory.c_str());
           continue;
         }
         newInput.inputIndex = lexer.GetUIntFromToken(&token);
@@ -128,18 +133,22 @@ std::vector<Ice::ShaderInputElement> Ice::RendererVulkan::LoadShaderDescriptors(
             newInput.bufferSegment.startIndex = newInput.inputIndex;
             if (newInput.bufferSegment.elementSize == 0)
             {
-              IceLogError("Shader defines buffer descriptor of size 0\n> '%s'", directory.c_str());
+              IceLogErrorIn(Ice::Log_Category_Asset,
+                            "Shader defines buffer descriptor of size 0\n> '%s'",
+                            directory.c_str());
             }
           }
           else
           {
-            IceLogError("Shader not defining buffer descriptor size\n> '%s'", directory.c_str());
+            IceLogErrorIn(Ice::Log_Category_Asset,
+                          "Shader not defining buffer descriptor size\n> '%s'",
+                          directory.c_str());
           }
         } break;
         default: break;
         }
 
-        tmpInputs.push_back(newInput);
+        tmpInputs.PushBack(newInput);
       }
     }
     // Get buffer information =====
@@ -184,7 +193,9 @@ b8 Ice::RendererVulkan::CreateMaterial(Ice::Material* _material)
     }
   }
 
-  UpdateDescriptorSet(&_material->vulkan.descriptorSet, _material->input);
+  UpdateDescriptorSet(&_material->vulkan.descriptorSet,
+                      _material->input.Data(),
+                      _material->input.Size());
 
   ICE_ATTEMPT(CreatePipelineLayout({ context.globalDescriptorLayout,
                                      context.cameraDescriptorLayout,
@@ -198,46 +209,52 @@ b8 Ice::RendererVulkan::CreateMaterial(Ice::Material* _material)
 
 void Ice::RendererVulkan::DestroyMaterial(Ice::Material& _material)
 {
-  vkDeviceWaitIdle(context.device);
-
   //for (auto& s : _material.settings->shaders)
   //{
   //  DestroyBufferMemory(&s.buffer);
   //}
   DestroyBufferMemory(&_material.buffer);
-  _material.shaders.clear();
-
-  _material.input.clear();
+  _material.shaders.Clear();
 
-  vkFreeDescriptorSets(context.device, context.descriptorPool, 1, &_material.vulkan.descriptorSet);
-  vkDestroyDescriptorSetLayout(context.device, _material.vulkan.descriptorSetLayout, context.alloc);
+  _material.input.Clear();
 
-  vkDestroyPipelineLayout(context.device, _material.vulkan.pipelineLayout, context.alloc);
-  vkDestroyPipeline(context.device, _material.vulkan.pipeline, context.alloc);
+  RetireMaterialObjects(&_material);
 }
 
 b8 Ice::RendererVulkan::RecreateMaterial(Ice::Material* _material)
 {
-  vkDestroyPipeline(context.device, _material->vulkan.pipeline, context.alloc);
-  vkDestroyPipelineLayout(context.device, _material->vulkan.pipelineLayout, context.alloc);
-  vkFreeDescriptorSets(context.device, context.descriptorPool, 1, &_material->vulkan.descriptorSet);
-  vkDestroyDescriptorSetLayout(context.device, _material->vulkan.descriptorSetLayout, context.alloc);
+  RetireMaterialObjects(_material);
 
-  _material->input.clear();
+  _material->input.Clear();
 
   return CreateMaterial(_material);
 }
 
+void Ice::RendererVulkan::RetireMaterialObjects(Ice::Material* _material)
+{
+  Ice::IvkRetiredResource retired;
+  retired.descriptorSet = _material->vulkan.descriptorSet;
+  retired.descriptorSetLayout = _material->vulkan.descriptorSetLayout;
+  retired.pipeline = _material->vulkan.pipeline;
+  retired.pipelineLayout = _material->vulkan.pipelineLayout;
+  Retire(retired);
+
+  _material->vulkan.descriptorSet = VK_NULL_HANDLE;
+  _material->vulkan.descriptorSetLayout = VK_NULL_HANDLE;
+  _material->vulkan.pipeline = VK_NULL_HANDLE;
+  _material->vulkan.pipelineLayout = VK_NULL_HANDLE;
+}
+
 b8 Ice::RendererVulkan::AssembleMaterialDescriptorBindings(Ice::Material* _material,
-                                                           std::vector<VkDescriptorSetLayoutBinding>& _bindings)
+                                                           Ice::ScratchVector<VkDescriptorSetLayoutBinding>& _bindings)
 {
   u32 count = 0;
-  std::vector<Ice::ShaderInputElement> orderedInputElements; // Used for faster place-checking
+  Ice::ScratchVector<Ice::ShaderInputElement> orderedInputElements; // Used for faster place-checking
 
   // Count descriptors =====
   for (Ice::Shader* s : _material->shaders)
   {
-    count += (u32)s->input.size();
+    count += s->input.Size();
   }
   _material->buffer.count = 1;
   _bindings.resize(count); // Worst-case size.
@@ -264,7 +281,9 @@ b8 Ice::RendererVulkan::AssembleMaterialDescriptorBindings(Ice::Material* _mater
       }
       else if (orderedInputElements[descriptor.inputIndex].type != Ice::Shader_Input_Count)
       {
-        IceLogFatal("Shader descriptor conflict at index %u", descriptor.inputIndex);
+        IceLogFatalIn(Ice::Log_Category_Renderer,
+                      "Shader descriptor conflict at index %u",
+                      descriptor.inputIndex);
         _bindings.clear();
         return false;
       }
@@ -302,7 +321,8 @@ b8 Ice::RendererVulkan::AssembleMaterialDescriptorBindings(Ice::Material* _mater
     }
   }
 
-  _material->input = orderedInputElements;
+  // Assign rather than replace so a rebuilt material reuses its existing capacity
+  _material->input.Assign(orderedInputElements.data(), (u32)orderedInputElements.size());
   _bindings.resize(actualCount);
 
   return true;
@@ -310,8 +330,6 @@ b8 Ice::RendererVulkan::AssembleMaterialDescriptorBindings(Ice::Material* _mater
 
 b8 Ice::RendererVulkan::CreateGlobalDescriptors()
 {
-  std::vector<VkDescriptorSetLayoutBinding> bindings;
-
   VkDescriptorSetLayoutBinding newBinding;
   newBinding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
   newBinding.pImmutableSamplers = nullptr;
@@ -321,34 +339,27 @@ b8 Ice::RendererVulkan::CreateGlobalDescriptors()
   {
     // Global descriptors =====
     newBinding.binding = 0;
-    newBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    bindings.push_back(newBinding);
+    newBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
-    ICE_ATTEMPT(CreateDescriptorLayoutAndSet(&bindings,
+    ICE_ATTEMPT(CreateDescriptorLayoutAndSet(&newBinding,
+                                             1,
                                              &context.globalDescriptorLayout,
                                              &context.globalDescriptorSet));
 
     ICE_ATTEMPT(CreateBufferMemory(&context.globalDescriptorBuffer,
                                    64 + (2 * sizeof(Ice::vec4)),
                                    1,
-                                   Ice::Buffer_Memory_Shader_Read));
-
-    std::vector<Ice::ShaderInputElement> iceBind(1);
-    iceBind[0].bufferSegment.buffer = &context.globalDescriptorBuffer;
-    iceBind[0].bufferSegment.offset = 0;
-    iceBind[0].bufferSegment.elementSize = 64;
-    iceBind[0].type = Shader_Input_Buffer;
-    iceBind[0].inputIndex = 0;
-    UpdateDescriptorSet(&context.globalDescriptorSet, iceBind);
+                                   Ice::Buffer_Memory_Shader_Read,
+                                   Ice::Buffer_Memory_Hint_Per_Frame));
 
     // Camera descriptors =====
-    bindings.clear();
-
     newBinding.binding = 0;
-    newBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    bindings.push_back(newBinding);
+    newBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
-    ICE_ATTEMPT(CreateDescriptorLayout(&bindings, &context.cameraDescriptorLayout));
+    ICE_ATTEMPT(CreateDescriptorLayoutAndSet(&newBinding,
+                                             1,
+                                             &context.cameraDescriptorLayout,
+                                             &context.cameraDescriptorSet));
 
     // Pipeline =====
     ICE_ATTEMPT(CreatePipelineLayout({ context.globalDescriptorLayout,
@@ -357,13 +368,17 @@ b8 Ice::RendererVulkan::CreateGlobalDescriptors()
   }
 
   // Object descriptors =====
-  bindings.clear();
-
+  // Every object's matrix in one storage buffer, bound once per frame
+  // Shaders index it with gl_InstanceIndex, which each draw's first instance sets to its transform
   newBinding.binding = 0;
-  newBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  bindings.push_back(newBinding);
+  newBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+  ICE_ATTEMPT(CreateDescriptorLayoutAndSet(&newBinding,
+                                           1,
+                                           &context.objectDescriptorLayout,
+                                           &context.objectDescriptorSet));
 
-  ICE_ATTEMPT(CreateDescriptorLayout(&bindings, &context.objectDescriptorLayout));
+  WriteFrameUniformDescriptors();
 
   return true;
 }
@@ -383,33 +398,37 @@ void Ice::RendererVulkan::PushDataToGlobalDescriptors(void* _data, Ice::BufferSe
 
 b8 Ice::RendererVulkan::CreateDescriptorLayoutAndSet(Ice::Material* _material)
 {
-  std::vector<VkDescriptorSetLayoutBinding> bindings;
+  Ice::ScratchScope scratch;
+  Ice::ScratchVector<VkDescriptorSetLayoutBinding> bindings;
   ICE_ATTEMPT(AssembleMaterialDescriptorBindings(_material, bindings));
 
-  return CreateDescriptorLayoutAndSet(&bindings,
+  return CreateDescriptorLayoutAndSet(bindings.data(),
+                                      (u32)bindings.size(),
                                       &_material->vulkan.descriptorSetLayout,
                                       &_material->vulkan.descriptorSet);
 }
 
-b8 Ice::RendererVulkan::CreateDescriptorLayoutAndSet(std::vector<VkDescriptorSetLayoutBinding>* _bindings,
+b8 Ice::RendererVulkan::CreateDescriptorLayoutAndSet(const VkDescriptorSetLayoutBinding* _bindings,
+                                                     u32 _bindingCount,
                                                      VkDescriptorSetLayout* _layout,
                                                      VkDescriptorSet* _set)
 {
-  ICE_ATTEMPT(CreateDescriptorLayout(_bindings, _layout));
+  ICE_ATTEMPT(CreateDescriptorLayout(_bindings, _bindingCount, _layout));
   ICE_ATTEMPT(CreateDescriptorSet(_layout, _set));
 
   return true;
 }
 
-b8 Ice::RendererVulkan::CreateDescriptorLayout(std::vector<VkDescriptorSetLayoutBinding>* _bindings,
+b8 Ice::RendererVulkan::CreateDescriptorLayout(const VkDescriptorSetLayoutBinding* _bindings,
+                                               u32 _bindingCount,
                                                VkDescriptorSetLayout* _layout)
 {
   VkDescriptorSetLayoutCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
   createInfo.flags = 0;
   createInfo.pNext = nullptr;
-  createInfo.bindingCount = (u32)_bindings->size();
-  createInfo.pBindings = _bindings->data();
+  createInfo.bindingCount = _bindingCount;
+  createInfo.pBindings = _bindings;
 
   IVK_ASSERT(vkCreateDescriptorSetLayout(context.device,
                                          &createInfo,
@@ -434,15 +453,18 @@ b8 Ice::RendererVulkan::CreateDescriptorSet(VkDescriptorSetLayout* _layout, VkDe
 }
 
 void Ice::RendererVulkan::UpdateDescriptorSet(VkDescriptorSet* _set,
-                                              const std::vector<Ice::ShaderInputElement>& _inputs)
+                                              const Ice::ShaderInputElement* _inputs,
+                                              u32 _inputCount)
 {
-  vkDeviceWaitIdle(context.device);
+  Ice::ScratchScope scratch;
 
-  std::vector<VkDescriptorImageInfo> images;
-  images.reserve(_inputs.size());
-  std::vector<VkDescriptorBufferInfo> buffers;
-  buffers.reserve(_inputs.size());
-  std::vector<VkWriteDescriptorSet> writes;
+  // Reserved up-front so the writes' info pointers remain valid
+  Ice::ScratchVector<VkDescriptorImageInfo> images;
+  images.reserve(_inputCount);
+  Ice::ScratchVector<VkDescriptorBufferInfo> buffers;
+  buffers.reserve(_inputCount);
+  Ice::ScratchVector<VkWriteDescriptorSet> writes;
+  writes.reserve(_inputCount);
 
   VkDescriptorImageInfo newImage{};
   VkDescriptorBufferInfo newBuffer{};
@@ -453,8 +475,9 @@ void Ice::RendererVulkan::UpdateDescriptorSet(VkDescriptorSet* _set,
   newWrite.descriptorCount = 1;
   newWrite.pTexelBufferView = nullptr;
 
-  for (const auto& descriptor : _inputs)
+  for (u32 i = 0; i < _inputCount; i++)
   {
+    const Ice::ShaderInputElement& descriptor = _inputs[i];
     newWrite.dstBinding = descriptor.inputIndex;
 
     switch (descriptor.type)
@@ -495,13 +518,19 @@ b8 Ice::RendererVulkan::SetMaterialInput(Ice::Material* _material,
                                          u32 _bindIndex,
                                          Ice::Image* _image)
 {
-  Ice::ShaderInputElement imageInput;
-  imageInput.inputIndex = _bindIndex;
-  imageInput.type = Ice::Shader_Input_Image2D;
-  imageInput.image = _image;
-  std::vector<Ice::ShaderInputElement> inputs = { imageInput };
+  for (Ice::ShaderInputElement& input : _material->input)
+  {
+    if (input.type == Ice::Shader_Input_Image2D && input.inputIndex == _bindIndex)
+      input.image = _image;
+  }
+
+  // Frames in flight may have the current set bound, so it's replaced rather than updated
+  Ice::IvkRetiredResource retired;
+  retired.descriptorSet = _material->vulkan.descriptorSet;
+  Retire(retired);
 
-  UpdateDescriptorSet(&_material->vulkan.descriptorSet, inputs);
+  ICE_ATTEMPT(CreateDescriptorSet(&_material->vulkan.descriptorSetLayout, &_material->vulkan.descriptorSet));
+  UpdateDescriptorSet(&_material->vulkan.descriptorSet, _material->input.Data(), _material->input.Size());
   return true;
 }
 
@@ -515,9 +544,10 @@ VkVertexInputBindingDescription GetVertexBindingDescription()
   return desc;
 }
 
-std::vector<VkVertexInputAttributeDescription> GetVertexAttributeDescriptions()
+Ice::FixedArray<VkVertexInputAttributeDescription, 3> GetVertexAttributeDescriptions()
 {
-  std::vector<VkVertexInputAttributeDescription> attribs(3);
+  Ice::FixedArray<VkVertexInputAttributeDescription, 3> attribs;
+  attribs.Resize(3);
   // Position
   attribs[0].binding = 0;
   attribs[0].location = 0;
@@ -537,7 +567,7 @@ std::vector<VkVertexInputAttributeDescription> GetVertexAttributeDescriptions()
   return attribs;
 }
 
-b8 Ice::RendererVulkan::CreatePipelineLayout(const std::vector<VkDescriptorSetLayout>& _setLayouts,
+b8 Ice::RendererVulkan::CreatePipelineLayout(const Ice::FixedArray<VkDescriptorSetLayout, 4>& _setLayouts,
                                              VkPipelineLayout* _pipelineLayout)
 {
   VkPipelineLayoutCreateInfo createInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
@@ -545,8 +575,8 @@ b8 Ice::RendererVulkan::CreatePipelineLayout(const std::vector<VkDescriptorSetLa
   createInfo.pNext = nullptr;
   createInfo.pushConstantRangeCount = 0;
   createInfo.pPushConstantRanges = nullptr;
-  createInfo.setLayoutCount = (u32)_setLayouts.size();
-  createInfo.pSetLayouts = _setLayouts.data();
+  createInfo.setLayoutCount = _setLayouts.Size();
+  createInfo.pSetLayouts = _setLayouts.Data();
 
   IVK_ASSERT(vkCreatePipelineLayout(context.device,
                                     &createInfo,
@@ -565,8 +595,17 @@ b8 Ice::RendererVulkan::CreatePipeline(Ice::Material* _material)
   shaderStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
   shaderStage.pName = "main";
 
-  std::vector<VkPipelineShaderStageCreateInfo> stages(_material->shaders.size());
-  for (u32 i = 0; i < _material->shaders.size(); i++)
+  // One stage per shader type
+  Ice::FixedArray<VkPipelineShaderStageCreateInfo, 4> stages;
+  if (_material->shaders.Size() > stages.GetAllocatedSize())
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer,
+                  "Materials support at most %u shader stages",
+                  stages.GetAllocatedSize());
+    return false;
+  }
+
+  for (u32 i = 0; i < _material->shaders.Size(); i++)
   {
     shaderStage.module = _material->shaders[i]->vulkan.module;
     switch (_material->shaders[i]->settings.type)
@@ -576,7 +615,7 @@ b8 Ice::RendererVulkan::CreatePipeline(Ice::Material* _material)
     default: return false;
     }
 
-    stages[i] = shaderStage;
+    stages.PushBack(shaderStage);
   }
 
   // Vertex Input State =====
@@ -587,8 +626,8 @@ b8 Ice::RendererVulkan::CreatePipeline(Ice::Material* _material)
   VkPipelineVertexInputStateCreateInfo vertexInputStateInfo{};
   vertexInputStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
   //vertexInputStateInfo.vertexAttributeDescriptionCount = 0;
-  vertexInputStateInfo.vertexAttributeDescriptionCount = (u32)vertexInputAttribDesc.size();
-  vertexInputStateInfo.pVertexAttributeDescriptions = vertexInputAttribDesc.data();
+  vertexInputStateInfo.vertexAttributeDescriptionCount = vertexInputAttribDesc.Size();
+  vertexInputStateInfo.pVertexAttributeDescriptions = vertexInputAttribDesc.Data();
   //vertexInputStateInfo.vertexBindingDescriptionCount = 0;
   vertexInputStateInfo.vertexBindingDescriptionCount = 1;
   vertexInputStateInfo.pVertexBindingDescriptions = &vertexInputBindingDesc;
@@ -688,8 +727,8 @@ b8 Ice::RendererVulkan::CreatePipeline(Ice::Material* _material)
   createInfo.pDepthStencilState = &depthStateInfo;
   createInfo.pColorBlendState = &blendStateInfo;
   createInfo.pDynamicState = &dynamicStateInfo;
-  createInfo.stageCount = (u32)stages.size();
-  createInfo.pStages = stages.data();
+  createInfo.stageCount = stages.Size();
+  createInfo.pStages = stages.Data();
 
   createInfo.layout = _material->vulkan.pipelineLayout;
   createInfo.renderPass = context.forward.renderpass;
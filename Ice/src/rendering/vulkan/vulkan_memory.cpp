@@ -0,0 +1,806 @@
+
+#include "defines.h"
+
+#include "rendering/vulkan/vulkan_memory.h"
+
+#include <algorithm>
+#include <bit>
+
+const char* const ivkMemoryPoolNames[Ice::Ivk_Memory_Pool_Count] = { "General", "Transient", "Staging" };
+
+//=========================
+// Setup
+//=========================
+
+b8 Ice::IvkMemoryAllocator::Initialize(VkDevice _device,
+                                       const VkPhysicalDeviceMemoryProperties& _properties,
+                                       VkDeviceSize _nonCoherentAtomSize,
+                                       VkAllocationCallbacks* _callbacks)
+{
+  device = _device;
+  properties = _properties;
+  nonCoherentAtomSize = max(_nonCoherentAtomSize, 1ull);
+  callbacks = _callbacks;
+  queuedFlushes.clear();
+  blockCount = 0;
+  for (u32 i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+  {
+    dedicatedCount[i] = 0;
+    dedicatedBytes[i] = 0;
+  }
+  for (u32 i = 0; i < Ice::Gpu_Memory_Category_Count; i++)
+  {
+    categoryStats[i] = {};
+  }
+  return true;
+}
+
+void Ice::IvkMemoryAllocator::Shutdown()
+{
+  for (u32 i = 0; i < blockCount; i++)
+  {
+    Block& block = blocks[i];
+    if (block.memory == VK_NULL_HANDLE)
+      continue;
+
+    if (block.pool == Ivk_Memory_Pool_General && block.allocationCount > 0)
+    {
+      IceLogWarningIn(Ice::Log_Category_Renderer,
+                      "Device memory block %u released with %u live allocations (%llu bytes)",
+                      i,
+                      block.allocationCount,
+                      block.usedBytes);
+    }
+    DestroyBlock(i);
+  }
+  blockCount = 0;
+
+  for (u32 i = 0; i < properties.memoryTypeCount; i++)
+  {
+    if (dedicatedCount[i] > 0)
+    {
+      IceLogWarningIn(Ice::Log_Category_Renderer,
+                      "%u dedicated device memory allocations of type %u (%llu bytes) were not freed",
+                      dedicatedCount[i],
+                      i,
+                      dedicatedBytes[i]);
+    }
+  }
+}
+
+u32 Ice::IvkMemoryAllocator::FindMemoryType(u32 _typeMask,
+                                            VkMemoryPropertyFlags _flags,
+                                            VkMemoryPropertyFlags _preferredFlags /*= 0*/) const
+{
+  if (_preferredFlags != 0)
+  {
+    for (u32 i = 0; i < properties.memoryTypeCount; i++)
+    {
+      VkMemoryPropertyFlags wanted = _flags | _preferredFlags;
+      if (_typeMask & (1 << i) && (properties.memoryTypes[i].propertyFlags & wanted) == wanted)
+      {
+        return i;
+      }
+    }
+  }
+
+  for (u32 i = 0; i < properties.memoryTypeCount; i++)
+  {
+    if (_typeMask & (1 << i) && (properties.memoryTypes[i].propertyFlags & _flags) == _flags)
+    {
+      return i;
+    }
+  }
+
+  IceLogErrorIn(Ice::Log_Category_Renderer,
+                "Failed to find a suitable memory type -- Mask : %u, Flags : %u",
+                _typeMask,
+                _flags);
+  return Ice::null32;
+}
+
+b8 Ice::IvkMemoryAllocator::IsHostVisible(const Ice::IvkAllocation& _allocation) const
+{
+  return (properties.memoryTypes[_allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+b8 Ice::IvkMemoryAllocator::IsCoherent(const Ice::IvkAllocation& _allocation) const
+{
+  return (properties.memoryTypes[_allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+//=========================
+// Blocks
+//=========================
+
+VkDeviceSize Ice::IvkMemoryAllocator::BlockSizeForType(u32 _memoryType) const
+{
+  // Small heaps (such as host-visible device memory) would be used up by a few full-size blocks
+  VkDeviceSize heapSize = properties.memoryHeaps[properties.memoryTypes[_memoryType].heapIndex].size;
+  VkDeviceSize size = ICE_VULKAN_MEMORY_BLOCK_SIZE;
+  while (size > heapSize / 8 && size > (1ull << 20))
+  {
+    size /= 2;
+  }
+  return size;
+}
+
+u32 Ice::IvkMemoryAllocator::CreateBlock(u32 _memoryType,
+                                         Ice::IvkMemoryPools _pool,
+                                         b8 _forImages,
+                                         VkDeviceSize _minimumSize)
+{
+  u32 index = 0;
+  while (index < blockCount && blocks[index].memory != VK_NULL_HANDLE)
+  {
+    index++;
+  }
+  if (index >= ICE_VULKAN_MAX_MEMORY_BLOCKS)
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer,
+                  "Reached the limit of %u device memory blocks",
+                  ICE_VULKAN_MAX_MEMORY_BLOCKS);
+    return Ice::null32;
+  }
+
+  VkDeviceSize size = BlockSizeForType(_memoryType);
+  if (size < _minimumSize)
+    size = _minimumSize;
+
+  VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = _memoryType;
+
+  Block& block = blocks[index];
+  VkResult result = vkAllocateMemory(device, &allocInfo, callbacks, &block.memory);
+  if (result != VK_SUCCESS)
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer,
+                  "Failed to allocate a %llu byte device memory block of type %u\n>> Vulkan result : %s",
+                  size,
+                  _memoryType,
+                  VulkanResultToString(result));
+    block.memory = VK_NULL_HANDLE;
+    return Ice::null32;
+  }
+
+  block.size = size;
+  block.memoryType = _memoryType;
+  block.pool = _pool;
+  block.holdsImages = _forImages;
+  block.usedBytes = 0;
+  block.allocationCount = 0;
+  block.mapped = nullptr;
+  block.mapCount = 0;
+  block.head = 0;
+  block.generation++;
+  block.orderCount = 0;
+
+  if (_pool == Ivk_Memory_Pool_General)
+  {
+    // General blocks are always a power of two, so the whole block is the top node
+    block.orderCount = std::countr_zero(size) - ICE_VULKAN_MEMORY_MIN_NODE_SHIFT + 1;
+    for (u32 order = 0; order < block.orderCount; order++)
+    {
+      block.freeNodes[order].SetMemoryTag(Ice::Memory_Tag_Renderer);
+      block.freeNodes[order].Resize((u32)(size >> (ICE_VULKAN_MEMORY_MIN_NODE_SHIFT + order)), false);
+    }
+    block.freeNodes[block.orderCount - 1].Set(0, true);
+  }
+
+  if (index == blockCount)
+    blockCount++;
+
+  return index;
+}
+
+void Ice::IvkMemoryAllocator::DestroyBlock(u32 _blockIndex)
+{
+  Block& block = blocks[_blockIndex];
+
+  if (block.mapped != nullptr)
+  {
+    vkUnmapMemory(device, block.memory);
+    block.mapped = nullptr;
+    block.mapCount = 0;
+  }
+
+  DiscardQueuedFlushes(block.memory);
+  vkFreeMemory(device, block.memory, callbacks);
+  block.memory = VK_NULL_HANDLE;
+
+  for (u32 order = 0; order < block.orderCount; order++)
+  {
+    block.freeNodes[order].Shutdown();
+  }
+  block.orderCount = 0;
+
+  while (blockCount > 0 && blocks[blockCount - 1].memory == VK_NULL_HANDLE)
+  {
+    blockCount--;
+  }
+}
+
+//=========================
+// Allocation
+//=========================
+
+b8 Ice::IvkMemoryAllocator::AllocateBuddy(u32 _blockIndex,
+                                          VkDeviceSize _size,
+                                          VkDeviceSize _alignment,
+                                          Ice::IvkAllocation* _out)
+{
+  Block& block = blocks[_blockIndex];
+
+  // Nodes are aligned to their own size, so covering the alignment covers both
+  VkDeviceSize nodeSize = std::bit_ceil(max(max(_size, _alignment), 1ull << ICE_VULKAN_MEMORY_MIN_NODE_SHIFT));
+  u32 order = std::countr_zero(nodeSize) - ICE_VULKAN_MEMORY_MIN_NODE_SHIFT;
+  if (order >= block.orderCount)
+    return false;
+
+  // Take the smallest free node that fits, splitting it down to the requested order
+  u32 sourceOrder = order;
+  while (sourceOrder < block.orderCount && block.freeNodes[sourceOrder].PopCount() == 0)
+  {
+    sourceOrder++;
+  }
+  if (sourceOrder >= block.orderCount)
+    return false;
+
+  u32 node = block.freeNodes[sourceOrder].FirstIndexWithValue(true);
+  block.freeNodes[sourceOrder].Set(node, false);
+  while (sourceOrder > order)
+  {
+    sourceOrder--;
+    node *= 2;
+    block.freeNodes[sourceOrder].Set(node + 1, true);
+  }
+
+  _out->memory = block.memory;
+  _out->offset = (VkDeviceSize)node << (ICE_VULKAN_MEMORY_MIN_NODE_SHIFT + order);
+  _out->size = nodeSize;
+  _out->memoryType = block.memoryType;
+  _out->blockIndex = _blockIndex;
+  _out->pool = (u8)Ivk_Memory_Pool_General;
+  _out->order = (u8)order;
+  _out->generation = 0;
+
+  block.usedBytes += nodeSize;
+  block.allocationCount++;
+  return true;
+}
+
+void Ice::IvkMemoryAllocator::FreeBuddy(Ice::IvkAllocation* _allocation)
+{
+  Block& block = blocks[_allocation->blockIndex];
+  u32 order = _allocation->order;
+  u32 node = (u32)(_allocation->offset >> (ICE_VULKAN_MEMORY_MIN_NODE_SHIFT + order));
+
+  // Merge with free buddies for as long as possible
+  while (order + 1 < block.orderCount && block.freeNodes[order].Get(node ^ 1))
+  {
+    block.freeNodes[order].Set(node ^ 1, false);
+    node /= 2;
+    order++;
+  }
+  block.freeNodes[order].Set(node, true);
+
+  block.usedBytes -= _allocation->size;
+  block.allocationCount--;
+}
+
+b8 Ice::IvkMemoryAllocator::AllocateLinear(u32 _blockIndex,
+                                           VkDeviceSize _size,
+                                           VkDeviceSize _alignment,
+                                           Ice::IvkAllocation* _out)
+{
+  Block& block = blocks[_blockIndex];
+
+  VkDeviceSize offset = (block.head + _alignment - 1) & ~(_alignment - 1);
+  if (offset + _size > block.size)
+    return false;
+
+  _out->memory = block.memory;
+  _out->offset = offset;
+  _out->size = _size;
+  _out->memoryType = block.memoryType;
+  _out->blockIndex = _blockIndex;
+  _out->pool = (u8)block.pool;
+  _out->order = 0;
+  _out->generation = block.generation;
+
+  block.head = offset + _size;
+  block.usedBytes = block.head;
+  block.allocationCount++;
+  return true;
+}
+
+b8 Ice::IvkMemoryAllocator::AllocateDedicated(u32 _memoryType, VkDeviceSize _size, Ice::IvkAllocation* _out)
+{
+  VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+  allocInfo.allocationSize = _size;
+  allocInfo.memoryTypeIndex = _memoryType;
+
+  VkResult allocateResult = vkAllocateMemory(device, &allocInfo, callbacks, &_out->memory);
+  if (allocateResult != VK_SUCCESS)
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer,
+                  "Failed to allocate dedicated device memory : size %llu\n>> Vulkan result : %s",
+                  _size,
+                  VulkanResultToString(allocateResult));
+    _out->memory = VK_NULL_HANDLE;
+    return false;
+  }
+
+  _out->offset = 0;
+  _out->size = _size;
+  _out->memoryType = _memoryType;
+  _out->blockIndex = Ice::null32;
+  _out->pool = (u8)Ivk_Memory_Pool_General;
+  _out->order = 0;
+  _out->generation = 0;
+
+  dedicatedCount[_memoryType]++;
+  dedicatedBytes[_memoryType] += _size;
+  return true;
+}
+
+b8 Ice::IvkMemoryAllocator::Allocate(const VkMemoryRequirements& _requirements,
+                                     VkMemoryPropertyFlags _flags,
+                                     Ice::IvkMemoryPools _pool,
+                                     Ice::GpuMemoryCategories _category,
+                                     b8 _forImage,
+                                     Ice::IvkAllocation* _out,
+                                     VkMemoryPropertyFlags _preferredFlags /*= 0*/)
+{
+  u32 memoryType = FindMemoryType(_requirements.memoryTypeBits, _flags, _preferredFlags);
+  if (memoryType == Ice::null32)
+    return false;
+
+  if (!AllocateFromType(memoryType, _requirements, _pool, _forImage, _out))
+    return false;
+
+  _out->category = (u8)_category;
+  Ice::GpuMemoryCategoryStats& stats = categoryStats[_category];
+  stats.liveBytes += _out->size;
+  stats.peakBytes = max(stats.peakBytes, stats.liveBytes);
+  stats.liveCount++;
+
+  return true;
+}
+
+b8 Ice::IvkMemoryAllocator::AllocateFromType(u32 _memoryType,
+                                             const VkMemoryRequirements& _requirements,
+                                             Ice::IvkMemoryPools _pool,
+                                             b8 _forImage,
+                                             Ice::IvkAllocation* _out)
+{
+  u32 memoryType = _memoryType;
+  VkDeviceSize alignment = max(_requirements.alignment, 1ull);
+  VkMemoryRequirements requirements = _requirements;
+
+  // Flushes cover whole atoms, which must not reach into another allocation
+  const VkMemoryPropertyFlags flags = properties.memoryTypes[memoryType].propertyFlags;
+  if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+  {
+    alignment = max(alignment, nonCoherentAtomSize);
+    requirements.size = (requirements.size + nonCoherentAtomSize - 1) & ~(nonCoherentAtomSize - 1);
+  }
+
+  // General blocks are only worth sharing between resources well under their size
+  if (_pool == Ivk_Memory_Pool_General && requirements.size > BlockSizeForType(memoryType) / 2)
+  {
+    return AllocateDedicated(memoryType, requirements.size, _out);
+  }
+
+  for (u32 i = 0; i < blockCount; i++)
+  {
+    const Block& block = blocks[i];
+    if (block.memory == VK_NULL_HANDLE
+        || block.memoryType != memoryType
+        || block.pool != _pool
+        || block.holdsImages != _forImage)
+    {
+      continue;
+    }
+
+    if (_pool == Ivk_Memory_Pool_General ? AllocateBuddy(i, requirements.size, alignment, _out)
+                                         : AllocateLinear(i, requirements.size, alignment, _out))
+    {
+      return true;
+    }
+  }
+
+  // Linear blocks grow to fit whatever they are asked for
+  u32 blockIndex = CreateBlock(memoryType,
+                               _pool,
+                               _forImage,
+                               _pool == Ivk_Memory_Pool_General ? 0 : requirements.size);
+  if (blockIndex == Ice::null32)
+    return false;
+
+  return _pool == Ivk_Memory_Pool_General ? AllocateBuddy(blockIndex, requirements.size, alignment, _out)
+                                          : AllocateLinear(blockIndex, requirements.size, alignment, _out);
+}
+
+void Ice::IvkMemoryAllocator::Free(Ice::IvkAllocation* _allocation)
+{
+  if (_allocation->memory == VK_NULL_HANDLE)
+    return;
+
+  Ice::GpuMemoryCategoryStats& stats = categoryStats[_allocation->category];
+  stats.liveBytes -= _allocation->size;
+  stats.liveCount--;
+
+  if (_allocation->blockIndex == Ice::null32)
+  {
+    DiscardQueuedFlushes(_allocation->memory);
+    vkFreeMemory(device, _allocation->memory, callbacks);
+    dedicatedCount[_allocation->memoryType]--;
+    dedicatedBytes[_allocation->memoryType] -= _allocation->size;
+    _allocation->memory = VK_NULL_HANDLE;
+    return;
+  }
+
+  Block& block = blocks[_allocation->blockIndex];
+  if (block.pool == Ivk_Memory_Pool_General)
+  {
+    FreeBuddy(_allocation);
+  }
+  else if (_allocation->generation != block.generation)
+  {
+    // Already released by a reset; the block's count now belongs to newer allocations
+    _allocation->memory = VK_NULL_HANDLE;
+    return;
+  }
+  else if (block.allocationCount > 0 && --block.allocationCount == 0)
+  {
+    block.head = 0;
+    block.usedBytes = 0;
+  }
+
+  // Keep one empty block of each kind around to avoid reallocating it on the next request
+  if (block.allocationCount == 0)
+  {
+    for (u32 i = 0; i < blockCount; i++)
+    {
+      const Block& other = blocks[i];
+      if (i != _allocation->blockIndex
+          && other.memory != VK_NULL_HANDLE
+          && other.memoryType == block.memoryType
+          && other.pool == block.pool
+          && other.holdsImages == block.holdsImages)
+      {
+        DestroyBlock(_allocation->blockIndex);
+        break;
+      }
+    }
+  }
+
+  _allocation->memory = VK_NULL_HANDLE;
+}
+
+void Ice::IvkMemoryAllocator::ResetPool(Ice::IvkMemoryPools _pool)
+{
+  if (_pool == Ivk_Memory_Pool_General)
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer, "General device memory can not be reset");
+    return;
+  }
+
+  for (u32 i = 0; i < blockCount; i++)
+  {
+    Block& block = blocks[i];
+    if (block.memory != VK_NULL_HANDLE && block.pool == _pool)
+    {
+      block.head = 0;
+      block.usedBytes = 0;
+      block.allocationCount = 0;
+      block.generation++;
+    }
+  }
+}
+
+//=========================
+// Mapping
+//=========================
+
+void* Ice::IvkMemoryAllocator::Map(const Ice::IvkAllocation& _allocation)
+{
+  void* mapped = nullptr;
+
+  if (_allocation.blockIndex == Ice::null32)
+  {
+    VkResult mapResult = vkMapMemory(device, _allocation.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    if (mapResult != VK_SUCCESS)
+    {
+      IceLogErrorIn(Ice::Log_Category_Renderer,
+                    "Failed to map dedicated device memory\n>> Vulkan result : %s",
+                    VulkanResultToString(mapResult));
+      return nullptr;
+    }
+    return mapped;
+  }
+
+  // A memory object can only be mapped once, so the whole block is mapped for all its users
+  Block& block = blocks[_allocation.blockIndex];
+  if (block.mapCount == 0)
+  {
+    VkResult mapResult = vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+    if (mapResult != VK_SUCCESS)
+    {
+      IceLogErrorIn(Ice::Log_Category_Renderer,
+                    "Failed to map device memory block %u\n>> Vulkan result : %s",
+                    _allocation.blockIndex,
+                    VulkanResultToString(mapResult));
+      block.mapped = nullptr;
+      return nullptr;
+    }
+  }
+  block.mapCount++;
+
+  return (char*)block.mapped + _allocation.offset;
+}
+
+void Ice::IvkMemoryAllocator::Unmap(const Ice::IvkAllocation& _allocation)
+{
+  if (_allocation.blockIndex == Ice::null32)
+  {
+    vkUnmapMemory(device, _allocation.memory);
+    return;
+  }
+
+  Block& block = blocks[_allocation.blockIndex];
+  if (block.mapCount > 0 && --block.mapCount == 0)
+  {
+    vkUnmapMemory(device, block.memory);
+    block.mapped = nullptr;
+  }
+}
+
+//=========================
+// Flushing
+//=========================
+
+void Ice::IvkMemoryAllocator::QueueFlush(const Ice::IvkAllocation& _allocation,
+                                         VkDeviceSize _offset,
+                                         VkDeviceSize _size)
+{
+  if (_size == 0 || IsCoherent(_allocation))
+    return;
+
+  // Allocations start and end on atom boundaries, so the widened range stays within this one
+  VkDeviceSize start = _allocation.offset + _offset;
+  VkDeviceSize end = start + _size;
+  start &= ~(nonCoherentAtomSize - 1);
+  end = (end + nonCoherentAtomSize - 1) & ~(nonCoherentAtomSize - 1);
+
+  // Sequential writes usually continue the last range
+  if (!queuedFlushes.empty())
+  {
+    VkMappedMemoryRange& last = queuedFlushes.back();
+    if (last.memory == _allocation.memory && start <= last.offset + last.size && end >= last.offset)
+    {
+      VkDeviceSize lastEnd = max(last.offset + last.size, end);
+      last.offset = min(last.offset, start);
+      last.size = lastEnd - last.offset;
+      return;
+    }
+  }
+
+  VkMappedMemoryRange range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
+  range.memory = _allocation.memory;
+  range.offset = start;
+  range.size = end - start;
+  queuedFlushes.push_back(range);
+}
+
+b8 Ice::IvkMemoryAllocator::FlushQueued()
+{
+  if (queuedFlushes.empty())
+    return true;
+
+  std::sort(queuedFlushes.begin(),
+            queuedFlushes.end(),
+            [](const VkMappedMemoryRange& _a, const VkMappedMemoryRange& _b)
+            {
+              if (_a.memory != _b.memory)
+                return _a.memory < _b.memory;
+              return _a.offset < _b.offset;
+            });
+
+  u32 mergedCount = 0;
+  for (u32 i = 0; i < queuedFlushes.size(); i++)
+  {
+    const VkMappedMemoryRange& range = queuedFlushes[i];
+    VkMappedMemoryRange* merged = mergedCount > 0 ? &queuedFlushes[mergedCount - 1] : nullptr;
+
+    if (merged != nullptr
+        && merged->memory == range.memory
+        && range.offset <= merged->offset + merged->size)
+    {
+      merged->size = max(merged->offset + merged->size, range.offset + range.size) - merged->offset;
+    }
+    else
+    {
+      queuedFlushes[mergedCount++] = range;
+    }
+  }
+
+  VkResult flushResult = vkFlushMappedMemoryRanges(device, mergedCount, queuedFlushes.data());
+  queuedFlushes.clear();
+
+  if (flushResult != VK_SUCCESS)
+  {
+    IceLogErrorIn(Ice::Log_Category_Renderer,
+                  "Failed to flush %u mapped memory ranges\n>> Vulkan result : %s",
+                  mergedCount,
+                  VulkanResultToString(flushResult));
+    return false;
+  }
+  return true;
+}
+
+void Ice::IvkMemoryAllocator::DiscardQueuedFlushes(VkDeviceMemory _memory)
+{
+  std::erase_if(queuedFlushes, [_memory](const VkMappedMemoryRange& _range)
+                               {
+                                 return _range.memory == _memory;
+                               });
+}
+
+//=========================
+// Statistics
+//=========================
+
+const char* Ice::GpuMemoryCategoryName(Ice::GpuMemoryCategories _category)
+{
+  switch (_category)
+  {
+  case Gpu_Memory_Mesh: return "Mesh";
+  case Gpu_Memory_Texture: return "Texture";
+  case Gpu_Memory_Uniform: return "Uniform";
+  case Gpu_Memory_Staging: return "Staging";
+  case Gpu_Memory_Attachment: return "Attachment";
+  case Gpu_Memory_Other: return "Other";
+  default: return "Invalid";
+  }
+}
+
+u32 Ice::IvkMemoryAllocator::GetBlockStats(Ice::IvkMemoryBlockStats* _stats, u32 _maxCount) const
+{
+  u32 count = 0;
+  for (u32 i = 0; i < blockCount; i++)
+  {
+    const Block& block = blocks[i];
+    if (block.memory == VK_NULL_HANDLE)
+      continue;
+
+    if (count < _maxCount)
+    {
+      Ice::IvkMemoryBlockStats& stats = _stats[count];
+      stats.memoryType = block.memoryType;
+      stats.pool = block.pool;
+      stats.holdsImages = block.holdsImages;
+      stats.size = block.size;
+      stats.usedBytes = block.usedBytes;
+      stats.allocationCount = block.allocationCount;
+
+      if (block.pool == Ivk_Memory_Pool_General)
+      {
+        stats.largestFreeRange = 0;
+        for (u32 order = block.orderCount; order > 0; order--)
+        {
+          if (block.freeNodes[order - 1].PopCount() > 0)
+          {
+            stats.largestFreeRange = 1ull << (ICE_VULKAN_MEMORY_MIN_NODE_SHIFT + order - 1);
+            break;
+          }
+        }
+      }
+      else
+      {
+        stats.largestFreeRange = block.size - block.head;
+      }
+    }
+    count++;
+  }
+  return count;
+}
+
+void Ice::IvkMemoryAllocator::GetMemoryStats(Ice::GpuMemoryStats* _stats) const
+{
+  _stats->budgetReported = false;
+
+  _stats->heapCount = properties.memoryHeapCount;
+  for (u32 i = 0; i < properties.memoryHeapCount; i++)
+  {
+    Ice::GpuMemoryHeapStats& heap = _stats->heaps[i];
+    heap = {};
+    heap.size = properties.memoryHeaps[i].size;
+    heap.deviceLocal = (properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+  }
+
+  _stats->typeCount = properties.memoryTypeCount;
+  for (u32 i = 0; i < properties.memoryTypeCount; i++)
+  {
+    VkMemoryPropertyFlags flags = properties.memoryTypes[i].propertyFlags;
+
+    Ice::GpuMemoryTypeStats& type = _stats->types[i];
+    type = {};
+    type.heap = properties.memoryTypes[i].heapIndex;
+    type.deviceLocal = (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+    type.hostVisible = (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+    type.hostCached = (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+    type.allocatedBytes = dedicatedBytes[i];
+    type.usedBytes = dedicatedBytes[i];
+    type.dedicatedCount = dedicatedCount[i];
+  }
+
+  for (u32 i = 0; i < blockCount; i++)
+  {
+    const Block& block = blocks[i];
+    if (block.memory == VK_NULL_HANDLE)
+      continue;
+
+    Ice::GpuMemoryTypeStats& type = _stats->types[block.memoryType];
+    type.allocatedBytes += block.size;
+    type.usedBytes += block.usedBytes;
+    type.blockCount++;
+  }
+
+  for (u32 i = 0; i < properties.memoryTypeCount; i++)
+  {
+    Ice::GpuMemoryHeapStats& heap = _stats->heaps[_stats->types[i].heap];
+    heap.allocatedBytes += _stats->types[i].allocatedBytes;
+    heap.usedBytes += _stats->types[i].usedBytes;
+  }
+
+  for (u32 i = 0; i < properties.memoryHeapCount; i++)
+  {
+    _stats->heaps[i].budget = _stats->heaps[i].size;
+    _stats->heaps[i].usage = _stats->heaps[i].allocatedBytes;
+  }
+
+  for (u32 i = 0; i < Ice::Gpu_Memory_Category_Count; i++)
+  {
+    _stats->categories[i] = categoryStats[i];
+  }
+}
+
+void Ice::IvkMemoryAllocator::LogOccupancy() const
+{
+  Ice::IvkMemoryBlockStats stats[ICE_VULKAN_MAX_MEMORY_BLOCKS];
+  u32 count = GetBlockStats(stats, ICE_VULKAN_MAX_MEMORY_BLOCKS);
+
+  u32 totalDedicatedCount = 0;
+  VkDeviceSize totalDedicatedBytes = 0;
+  for (u32 i = 0; i < properties.memoryTypeCount; i++)
+  {
+    totalDedicatedCount += dedicatedCount[i];
+    totalDedicatedBytes += dedicatedBytes[i];
+  }
+
+  IceLog(Ice::Log_Type_Info,
+         Ice::Log_Category_Renderer,
+         "Device memory : %u blocks, %u dedicated allocations (%llu bytes)",
+         count,
+         totalDedicatedCount,
+         totalDedicatedBytes);
+
+  for (u32 i = 0; i < count; i++)
+  {
+    const Ice::IvkMemoryBlockStats& s = stats[i];
+    IceLog(Ice::Log_Type_Info,
+           Ice::Log_Category_Renderer,
+           "  Type %2u %-9s %-7s : %10llu / %10llu bytes (%5.1f%%) in %5u allocations -- largest free %llu",
+           s.memoryType,
+           ivkMemoryPoolNames[s.pool],
+           s.holdsImages ? "images" : "buffers",
+           s.usedBytes,
+           s.size,
+           100.0 * (f64)s.usedBytes / (f64)s.size,
+           s.allocationCount,
+           s.largestFreeRange);
+  }
+}
@@ -0,0 +1,162 @@
+
+#ifndef ICE_RENDERING_VULKAN_MEMORY_H_
+#define ICE_RENDERING_VULKAN_MEMORY_H_
+
+#include "defines.h"
+
+#include "rendering/renderer_defines.h"
+#include "rendering/vulkan/vulkan_defines.h"
+#include "tools/flag_array.h"
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+namespace Ice {
+
+// Preferred size of each device memory block (smaller for heaps that can't fit eight of them)
+#define ICE_VULKAN_MEMORY_BLOCK_SIZE (64ull * 1024 * 1024)
+// Smallest range the buddy allocator hands out (log2)
+#define ICE_VULKAN_MEMORY_MIN_NODE_SHIFT 8
+#define ICE_VULKAN_MEMORY_MAX_ORDERS 24
+#define ICE_VULKAN_MAX_MEMORY_BLOCKS 256
+
+enum IvkMemoryPools
+{
+  // Long-lived resources, freed individually
+  Ivk_Memory_Pool_General,
+  // Resources created and destroyed together, like the swapchain-sized attachments
+  // Space is reclaimed once every allocation in a block is freed, or by ResetPool
+  Ivk_Memory_Pool_Transient,
+  // Host-visible sources for uploads (the staging ring), reclaimed the same way
+  Ivk_Memory_Pool_Staging,
+
+  Ivk_Memory_Pool_Count
+};
+
+struct IvkMemoryBlockStats
+{
+  u32 memoryType;
+  Ice::IvkMemoryPools pool;
+  b8 holdsImages;
+  VkDeviceSize size;
+  VkDeviceSize usedBytes;
+  VkDeviceSize largestFreeRange;
+  u32 allocationCount;
+};
+
+// Sub-allocates resources from large blocks of device memory, keeping the number of
+//   vkAllocateMemory calls (which drivers limit) low
+// General allocations use a buddy allocator per block; transient and staging pools are linear.
+// Buffers and images never share a block, so bufferImageGranularity can be ignored.
+// Requests larger than half a block get a dedicated vkAllocateMemory of their own.
+// Allocations in non-coherent memory are padded to whole nonCoherentAtomSize units so flushing
+//   one never touches its neighbours.
+class IvkMemoryAllocator
+{
+private:
+  struct Block
+  {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    u32 memoryType = 0;
+    Ice::IvkMemoryPools pool = Ivk_Memory_Pool_General;
+    b8 holdsImages = false;
+
+    VkDeviceSize usedBytes = 0;
+    u32 allocationCount = 0;
+
+    void* mapped = nullptr;
+    u32 mapCount = 0;
+
+    // Buddy : one flag per node of each order, set while the node is free
+    u32 orderCount = 0;
+    Ice::FlagArray freeNodes[ICE_VULKAN_MEMORY_MAX_ORDERS];
+
+    // Linear : bytes handed out since the last reset
+    VkDeviceSize head = 0;
+    // Linear : bumped by every reset and recreation, so frees of older allocations are ignored
+    u32 generation = 0;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkAllocationCallbacks* callbacks = nullptr;
+  VkPhysicalDeviceMemoryProperties properties;
+
+  Block blocks[ICE_VULKAN_MAX_MEMORY_BLOCKS];
+  u32 blockCount = 0; // Highest block index in use + 1
+
+  u32 dedicatedCount[VK_MAX_MEMORY_TYPES] = {};
+  VkDeviceSize dedicatedBytes[VK_MAX_MEMORY_TYPES] = {};
+
+  Ice::GpuMemoryCategoryStats categoryStats[Ice::Gpu_Memory_Category_Count] = {};
+
+  VkDeviceSize nonCoherentAtomSize = 1;
+  // Ranges of non-coherent memory written by the host since the last FlushQueued
+  std::vector<VkMappedMemoryRange> queuedFlushes;
+
+  VkDeviceSize BlockSizeForType(u32 _memoryType) const;
+  u32 CreateBlock(u32 _memoryType, Ice::IvkMemoryPools _pool, b8 _forImages, VkDeviceSize _minimumSize);
+  void DestroyBlock(u32 _blockIndex);
+  // Drops queued flushes of memory about to be freed
+  void DiscardQueuedFlushes(VkDeviceMemory _memory);
+
+  b8 AllocateBuddy(u32 _blockIndex, VkDeviceSize _size, VkDeviceSize _alignment, Ice::IvkAllocation* _out);
+  void FreeBuddy(Ice::IvkAllocation* _allocation);
+  b8 AllocateLinear(u32 _blockIndex, VkDeviceSize _size, VkDeviceSize _alignment, Ice::IvkAllocation* _out);
+  b8 AllocateDedicated(u32 _memoryType, VkDeviceSize _size, Ice::IvkAllocation* _out);
+  b8 AllocateFromType(u32 _memoryType,
+                      const VkMemoryRequirements& _requirements,
+                      Ice::IvkMemoryPools _pool,
+                      b8 _forImage,
+                      Ice::IvkAllocation* _out);
+
+public:
+  b8 Initialize(VkDevice _device,
+                const VkPhysicalDeviceMemoryProperties& _properties,
+                VkDeviceSize _nonCoherentAtomSize,
+                VkAllocationCallbacks* _callbacks);
+  // Releases every block, reporting any allocations still live
+  void Shutdown();
+
+  // Returns the first memory type in _typeMask with all of _flags, or Ice::null32
+  // Types that also have all of _preferredFlags are chosen first
+  u32 FindMemoryType(u32 _typeMask, VkMemoryPropertyFlags _flags, VkMemoryPropertyFlags _preferredFlags = 0) const;
+  b8 IsHostVisible(const Ice::IvkAllocation& _allocation) const;
+  // Host writes to non-coherent memory are only seen by the device once flushed
+  b8 IsCoherent(const Ice::IvkAllocation& _allocation) const;
+
+  b8 Allocate(const VkMemoryRequirements& _requirements,
+              VkMemoryPropertyFlags _flags,
+              Ice::IvkMemoryPools _pool,
+              Ice::GpuMemoryCategories _category,
+              b8 _forImage,
+              Ice::IvkAllocation* _out,
+              VkMemoryPropertyFlags _preferredFlags = 0);
+  // Linear allocations are only reclaimed once their whole block is free or reset
+  void Free(Ice::IvkAllocation* _allocation);
+  // Releases every allocation in a linear pool at once
+  // Allocations made before the reset may still be passed to Free, which then ignores them
+  void ResetPool(Ice::IvkMemoryPools _pool);
+
+  // Host-visible allocations only; mappings of the same block are shared and counted
+  // Returns nullptr, leaving the mapping count untouched, if the memory can't be mapped
+  void* Map(const Ice::IvkAllocation& _allocation);
+  void Unmap(const Ice::IvkAllocation& _allocation);
+
+  // Queues _size bytes written from _offset into the allocation to be flushed by FlushQueued
+  // Does nothing for coherent memory
+  void QueueFlush(const Ice::IvkAllocation& _allocation, VkDeviceSize _offset, VkDeviceSize _size);
+  // Flushes every queued range with one call, merging ranges of the same memory that overlap or touch
+  b8 FlushQueued();
+
+  // Fills up to _maxCount entries, returning the number of blocks in use
+  u32 GetBlockStats(Ice::IvkMemoryBlockStats* _stats, u32 _maxCount) const;
+  // Fills everything but the heaps' budget and usage, which only the driver knows
+  void GetMemoryStats(Ice::GpuMemoryStats* _stats) const;
+  void LogOccupancy() const;
+};
+
+} // namespace Ice
+
+#endif // !ICE_RENDERING_VULKAN_MEMORY_H_
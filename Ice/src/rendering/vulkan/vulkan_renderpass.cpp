@@ -8,12 +8,14 @@ b8 Ice::RendererVulkan::CreateDepthImages()
   const u32 count = (u32)context.swapchainImages.size();
   context.depthImages.resize(count);
 
+  // Transient : every depth image is destroyed together when the swapchain is resized
   for (u32 i = 0; i < count; i++)
   {
     CreateImage(&context.depthImages[i],
                 context.swapchainExtent,
                 VK_FORMAT_D24_UNORM_S8_UINT,
-                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                Ice::Ivk_Memory_Pool_Transient);
     CreateImageView(&context.depthImages[i].view,
                     context.depthImages[i].image,
                     context.depthImages[i].format,
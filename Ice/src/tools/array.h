@@ -4,6 +4,11 @@
 
 #include "defines.h"
 #include "platform/platform.h"
+#include "core/platform/block_allocator.h"
+
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace Ice {
 
@@ -12,6 +17,7 @@ class Array
 {
 private:
   T* data = nullptr;
+  Ice::MemoryTags memoryTag = Ice::Memory_Tag_Container;
 
   u32 allocatedElementCount = 0;
   u32 usedElementCount = 0;
@@ -21,33 +27,88 @@ private:
     return usedElementCount - 1;
   }
 
+  // Moves _count elements into uninitialized memory, leaving the sources destroyed
+  static void RelocateElements(T* _source, T* _destination, u32 _count)
+  {
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+      if (_count > 0)
+        Ice::MemoryCopy(_source, _destination, _count * sizeof(T));
+    }
+    else
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        new (&_destination[i]) T(std::move(_source[i]));
+        _source[i].~T();
+      }
+    }
+  }
+
+  static void DestroyElements(T* _first, u32 _count)
+  {
+    if constexpr (!std::is_trivially_destructible_v<T>)
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        _first[i].~T();
+      }
+    }
+  }
+
+  // Elements past the used count are left unconstructed
   void ResizeData(u32 _newCount)
   {
-    T* old = data;
-    data = (T*)Ice::MemoryAllocZero(_newCount * sizeof(T));
+    u32 keptCount = min(usedElementCount, _newCount);
+    DestroyElements(data + keptCount, usedElementCount - keptCount);
+    usedElementCount = keptCount;
+
+    // Large arrays usually have reserved address space to grow into
+    if (Ice::BlockResizeInPlace(data, allocatedElementCount * sizeof(T), _newCount * sizeof(T), memoryTag))
+    {
+      allocatedElementCount = _newCount;
+      return;
+    }
 
-    usedElementCount = min(usedElementCount, _newCount);
-    Ice::MemoryCopy(old, data, usedElementCount * sizeof(T));
-    Ice::MemoryFree(old);
+    T* old = data;
+    data = (T*)Ice::BlockAllocate(_newCount * sizeof(T), memoryTag);
+    RelocateElements(old, data, keptCount);
+    Ice::BlockFree(old, allocatedElementCount * sizeof(T), memoryTag);
 
     allocatedElementCount = _newCount;
   }
 
 public:
-  Array(u32 _count = 1)
+  Array(u32 _count = 1, Ice::MemoryTags _tag = Ice::Memory_Tag_Container)
   {
-    data = (T*)Ice::MemoryAllocZero(_count * sizeof(T));
+    memoryTag = _tag;
+    data = (T*)Ice::BlockAllocate(_count * sizeof(T), memoryTag);
     allocatedElementCount = _count;
   }
 
-  Array(T* _data, u32 _count)
+  // Copies _count elements from _data
+  Array(const T* _data, u32 _count)
   {
-    data = (T*)Ice::MemoryAllocZero(_count * sizeof(T));
+    data = (T*)Ice::BlockAllocate(_count * sizeof(T), memoryTag);
     allocatedElementCount = _count;
+    usedElementCount = _count;
 
-    Ice::MemoryCopy(_data, data, _count * sizeof(T));
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+      Ice::MemoryCopy((void*)_data, data, _count * sizeof(T));
+    }
+    else
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        new (&data[i]) T(_data[i]);
+      }
+    }
   }
 
+  Array(const Ice::Array<T>& _other) = delete;
+  Ice::Array<T>& operator =(const Ice::Array<T>& _other) = delete;
+
   ~Array()
   {
     if (allocatedElementCount)
@@ -56,7 +117,8 @@ public:
 
   void Shutdown()
   {
-    Ice::MemoryFree(data);
+    DestroyElements(data, usedElementCount);
+    Ice::BlockFree(data, allocatedElementCount * sizeof(T), memoryTag);
     allocatedElementCount = 0;
     usedElementCount = 0;
   }
@@ -68,7 +130,7 @@ public:
       ResizeData(allocatedElementCount * 2);
     }
 
-    data[usedElementCount] = _value;
+    new (&data[usedElementCount]) T(std::move(_value));
     usedElementCount++;
 
     return data[usedElementCount - 1];
@@ -5,9 +5,13 @@
 #include "defines.h"
 
 #include "core/platform/platform.h"
+#include "core/platform/block_allocator.h"
 #include "tools/flag_array.h"
 
 #include <bitset>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace Ice {
@@ -19,6 +23,7 @@ class CompactArray
   T* data = nullptr;
   u32* indexMap = nullptr;
   Ice::FlagArray indexAvailability;
+  Ice::MemoryTags memoryTag = Ice::Memory_Tag_Container;
 
   u32 allocatedElementCount = 0;
   u32 usedElementCount = 0;
@@ -29,51 +34,117 @@ class CompactArray
     return usedElementCount - 1;
   }
 
+  // Moves _count elements into uninitialized memory, leaving the sources destroyed
+  static void RelocateElements(T* _source, T* _destination, u32 _count)
+  {
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+      if (_count > 0)
+        Ice::MemoryCopy(_source, _destination, _count * sizeof(T));
+    }
+    else
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        new (&_destination[i]) T(std::move(_source[i]));
+        _source[i].~T();
+      }
+    }
+  }
+
+  static void DestroyElements(T* _first, u32 _count)
+  {
+    if constexpr (!std::is_trivially_destructible_v<T>)
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        _first[i].~T();
+      }
+    }
+  }
+
+  // Elements past the used count are left unconstructed
   void ResizeData(u32 _newCount)
   {
-    T* old = data;
-    data = (T*)Ice::MemoryAllocZero(_newCount * sizeof(T));
+    u32 keptCount = min(usedElementCount, _newCount);
+    DestroyElements(data + keptCount, usedElementCount - keptCount);
+    usedElementCount = keptCount;
+
+    // Large arrays usually have reserved address space to grow into
+    if (Ice::BlockResizeInPlace(data, allocatedElementCount * sizeof(T), _newCount * sizeof(T), memoryTag))
+    {
+      allocatedElementCount = _newCount;
+      return;
+    }
 
-    usedElementCount = min(usedElementCount, _newCount);
-    Ice::MemoryCopy(old, data, usedElementCount * sizeof(T));
-    Ice::MemoryFree(old);
+    T* old = data;
+    data = (T*)Ice::BlockAllocate(_newCount * sizeof(T), memoryTag);
+    RelocateElements(old, data, keptCount);
+    Ice::BlockFree(old, allocatedElementCount * sizeof(T), memoryTag);
 
     allocatedElementCount = _newCount;
   }
 
   void ResizeMap(u32 _newCount)
   {
-    u32* oldMap = indexMap;
-    indexMap = (u32*)Ice::MemoryAllocate(_newCount * sizeof(u32));
+    u32* newMap = (u32*)Ice::BlockReallocate(indexMap,
+                                             indexCount * sizeof(u32),
+                                             _newCount * sizeof(u32),
+                                             memoryTag);
+    if (newMap == nullptr)
+    {
+      ICE_ABORT("Failed to resize index map to %u elements", _newCount);
+    }
+    indexMap = newMap;
     indexAvailability.Resize(_newCount, true);
-
-    Ice::MemoryCopy(oldMap, indexMap, indexCount * sizeof(u32));
     indexCount = _newCount;
   }
 
 public:
-  CompactArray(u32 _count)
+  CompactArray(u32 _count, Ice::MemoryTags _tag = Ice::Memory_Tag_Container)
   {
-    data = (T*)Ice::MemoryAllocZero(_count * sizeof(T));
-    indexMap = (u32*)Ice::MemoryAllocate(_count * sizeof(u32));
+    memoryTag = _tag;
+    indexAvailability.SetMemoryTag(_tag);
+    data = (T*)Ice::BlockAllocate(_count * sizeof(T), memoryTag);
+    indexMap = (u32*)Ice::BlockAllocate(_count * sizeof(u32), memoryTag);
     indexAvailability.Resize(_count, true);
     allocatedElementCount = _count;
     indexCount = _count;
   }
 
+  // Copies the elements and their index mapping
   CompactArray(const Ice::CompactArray<T>& _other)
   {
-    u32 _count;
-    T* _data = _other.GetArray(_count);
+    memoryTag = _other.memoryTag;
+    allocatedElementCount = _other.allocatedElementCount;
+    usedElementCount = _other.usedElementCount;
+    indexCount = _other.indexCount;
 
-    data = (T*)Ice::MemoryAllocZero(_count * sizeof(T));
-    Ice::MemoryCopy(_data, data, _count);
-    indexMap = (u32*)Ice::MemoryAllocate(_count * sizeof(u32));
-    indexAvailability.Resize(_count, true);
-    allocatedElementCount = _count;
-    indexCount = _count;
+    data = (T*)Ice::BlockAllocate(allocatedElementCount * sizeof(T), memoryTag);
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+      Ice::MemoryCopy(_other.data, data, usedElementCount * sizeof(T));
+    }
+    else
+    {
+      for (u32 i = 0; i < usedElementCount; i++)
+      {
+        new (&data[i]) T(_other.data[i]);
+      }
+    }
+
+    indexMap = (u32*)Ice::BlockAllocate(indexCount * sizeof(u32), memoryTag);
+    Ice::MemoryCopy(_other.indexMap, indexMap, indexCount * sizeof(u32));
+
+    indexAvailability.SetMemoryTag(memoryTag);
+    indexAvailability.Resize(indexCount, true);
+    _other.indexAvailability.ForEachWithValue(false, [&](u32 _index) {
+      indexAvailability.Set(_index, false);
+    });
   }
 
+  Ice::CompactArray<T>& operator =(const Ice::CompactArray<T>& _other) = delete;
+
   ~CompactArray()
   {
     if (allocatedElementCount)
@@ -82,8 +153,9 @@ public:
 
   void Shutdown()
   {
-    Ice::MemoryFree(data);
-    Ice::MemoryFree(indexMap);
+    DestroyElements(data, usedElementCount);
+    Ice::BlockFree(data, allocatedElementCount * sizeof(T), memoryTag);
+    Ice::BlockFree(indexMap, indexCount * sizeof(u32), memoryTag);
     allocatedElementCount = 0;
     usedElementCount = 0;
     indexCount = 0;
@@ -109,7 +181,7 @@ public:
 
     if (!indexAvailability.Get(_index))
     {
-      IceLogWarning("Index %u unavailable in compact array", _index);
+      IceLogWarningIn(Ice::Log_Category_Ecs, "Index %u unavailable in compact array", _index);
       DebugBreak();
       return -1;
     }
@@ -118,7 +190,7 @@ public:
 
     indexAvailability.Set(_index, 0);
     indexMap[_index] = dataIndex;
-    data[dataIndex] = _initValue;
+    new (&data[dataIndex]) T(std::move(_initValue));
     usedElementCount++;
 
     return _index;
@@ -140,7 +212,7 @@ public:
 
     indexAvailability.Set(index, 0);
     indexMap[index] = dataIndex;
-    data[dataIndex] = _initValue;
+    new (&data[dataIndex]) T(std::move(_initValue));
     usedElementCount++;
 
     return index;
@@ -148,23 +220,27 @@ public:
 
   void RemoveAt(u32 _index)
   {
-    assert(_index < usedElementCount);
+    assert(_index < indexCount && !indexAvailability.Get(_index));
 
     u32 dataIndex = indexMap[_index];
     u32 dataBackIndex = usedElementCount - 1;
 
-    // Swap removed & back in data
-    data[dataIndex] = data[dataBackIndex];
-
-    // Find back index in map
-    u32 mapBackIndex = 0;
-    while (mapBackIndex < usedElementCount && indexMap[mapBackIndex] != dataBackIndex)
+    // Move the back element into the removed element's place
+    if (dataIndex != dataBackIndex)
     {
-      mapBackIndex++;
+      data[dataIndex] = std::move(data[dataBackIndex]);
+
+      // Find back index in map
+      u32 mapBackIndex = 0;
+      while (indexAvailability.Get(mapBackIndex) || indexMap[mapBackIndex] != dataBackIndex)
+      {
+        mapBackIndex++;
+      }
+      indexMap[mapBackIndex] = dataIndex;
     }
-    indexMap[_index] = indexMap[mapBackIndex];
+    DestroyElements(&data[dataBackIndex], 1);
 
-    indexAvailability.Set(mapBackIndex, 1);
+    indexAvailability.Set(_index, 1);
     usedElementCount--;
   }
 
@@ -0,0 +1,110 @@
+
+#ifndef ICE_TOOLS_FIXED_ARRAY_H_
+#define ICE_TOOLS_FIXED_ARRAY_H_
+
+#include "defines.h"
+
+#include <assert.h>
+#include <initializer_list>
+
+namespace Ice {
+
+// Array with a compile-time capacity stored in-place (no heap allocation)
+// Intended for small, bounded lists such as Vulkan create-info arrays
+template<typename T, u32 Capacity>
+class FixedArray
+{
+private:
+  T data[Capacity] {};
+  u32 usedElementCount = 0;
+
+public:
+  FixedArray() {}
+
+  FixedArray(std::initializer_list<T> _values)
+  {
+    assert(_values.size() <= Capacity);
+    for (const T& v : _values)
+    {
+      data[usedElementCount] = v;
+      usedElementCount++;
+    }
+  }
+
+  T& PushBack(T _value)
+  {
+    assert(usedElementCount < Capacity);
+
+    data[usedElementCount] = _value;
+    usedElementCount++;
+
+    return data[usedElementCount - 1];
+  }
+
+  T& Back()
+  {
+    return data[usedElementCount - 1];
+  }
+
+  T& operator [](u32 _index)
+  {
+    assert(_index < usedElementCount);
+    return data[_index];
+  }
+
+  const T& operator [](u32 _index) const
+  {
+    assert(_index < usedElementCount);
+    return data[_index];
+  }
+
+  T* Data()
+  {
+    return data;
+  }
+
+  const T* Data() const
+  {
+    return data;
+  }
+
+  constexpr u32 Size() const
+  {
+    return usedElementCount;
+  }
+
+  constexpr u32 GetAllocatedSize() const
+  {
+    return Capacity;
+  }
+
+  // Newly exposed elements are value-initialized
+  void Resize(u32 _newCount)
+  {
+    assert(_newCount <= Capacity);
+
+    for (u32 i = usedElementCount; i < _newCount; i++)
+    {
+      data[i] = T{};
+    }
+    usedElementCount = _newCount;
+  }
+
+  void Clear()
+  {
+    usedElementCount = 0;
+  }
+
+  //=========================
+  // Iterator
+  //=========================
+
+  T* begin() { return data; }
+  T* end() { return data + usedElementCount; }
+  const T* begin() const { return data; }
+  const T* end() const { return data + usedElementCount; }
+};
+
+} // namespace Ice
+
+#endif // !ICE_TOOLS_FIXED_ARRAY_H_
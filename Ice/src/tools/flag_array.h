@@ -5,28 +5,129 @@
 #include "defines.h"
 
 #include "core/platform/platform.h"
+#include "core/platform/block_allocator.h"
+
+#include <bit>
 
 namespace Ice {
 
+// Packed array of boolean flags
+// Flags are stored in 64-bit words. Two summary levels record which words contain any set
+//   and any clear flags (one bit per word, then one bit per summary word), letting searches
+//   skip whole 4096-flag regions at a time.
+// Bits past the final flag are always kept clear.
 class FlagArray
 {
 private:
-  char* data = nullptr;
-  u32 byteCount = 0;
+  // One allocation holding words, then the set/clear summaries for each level
+  u64* words = nullptr;
+  u64* anySet = nullptr;       // Bit per word : word has at least one set flag
+  u64* anyClear = nullptr;     // Bit per word : word has at least one clear flag
+  u64* anySetUpper = nullptr;  // Bit per anySet word : that word is non-zero
+  u64* anyClearUpper = nullptr;
+
+  Ice::MemoryTags memoryTag = Ice::Memory_Tag_Container;
+  u32 wordCount = 0;
+  u32 summaryCount = 0;
+  u32 upperCount = 0;
   u32 flagCount = 0;
+  u32 setCount = 0;
+
+  static constexpr u32 WordCountFor(u32 _bitCount)
+  {
+    return (_bitCount + 63) / 64;
+  }
+
+  constexpr u64 AllocationSize() const
+  {
+    return (u64)(wordCount + 2 * summaryCount + 2 * upperCount) * sizeof(u64);
+  }
+
+  // Flags in the word that exist
+  constexpr u64 ValidMask(u32 _wordIndex) const
+  {
+    u32 remainder = flagCount % 64;
+    return (_wordIndex == wordCount - 1 && remainder != 0) ? ((1ull << remainder) - 1) : ~0ull;
+  }
+
+  static void AssignBit(u64* _bits, u32 _index, b8 _value)
+  {
+    u64 mask = 1ull << (_index % 64);
+    _bits[_index / 64] = _value ? (_bits[_index / 64] | mask) : (_bits[_index / 64] & ~mask);
+  }
+
+  // Refreshes both summary levels after a word changes
+  void UpdateSummary(u32 _wordIndex)
+  {
+    u64 word = words[_wordIndex];
+    AssignBit(anySet, _wordIndex, word != 0);
+    AssignBit(anyClear, _wordIndex, (~word & ValidMask(_wordIndex)) != 0);
+
+    u32 summaryIndex = _wordIndex / 64;
+    AssignBit(anySetUpper, summaryIndex, anySet[summaryIndex] != 0);
+    AssignBit(anyClearUpper, summaryIndex, anyClear[summaryIndex] != 0);
+  }
+
+  void RebuildSummaries()
+  {
+    Ice::MemoryZero(anySet, (u64)(2 * summaryCount + 2 * upperCount) * sizeof(u64));
+    setCount = 0;
+
+    for (u32 i = 0; i < wordCount; i++)
+    {
+      setCount += std::popcount(words[i]);
+      if (words[i] != 0)
+        AssignBit(anySet, i, true);
+      if ((~words[i] & ValidMask(i)) != 0)
+        AssignBit(anyClear, i, true);
+    }
+
+    for (u32 i = 0; i < summaryCount; i++)
+    {
+      if (anySet[i] != 0)
+        AssignBit(anySetUpper, i, true);
+      if (anyClear[i] != 0)
+        AssignBit(anyClearUpper, i, true);
+    }
+  }
 
-  constexpr u32 ValueToByte(u32 _value)
+  // First word at or after _startWord whose summary bit is set, or null32
+  u32 NextSummarizedWord(const u64* _summary, const u64* _upper, u32 _startWord) const
   {
-    return _value / 8;
+    if (_startWord >= wordCount)
+      return Ice::null32;
+
+    u32 summaryIndex = _startWord / 64;
+    u64 bits = _summary[summaryIndex] & (~0ull << (_startWord % 64));
+    if (bits != 0)
+      return summaryIndex * 64 + std::countr_zero(bits);
+
+    // Find the next non-empty summary word; the upper level has one bit per 4096 flags
+    for (u32 i = summaryIndex + 1; i < summaryCount; )
+    {
+      u32 upperIndex = i / 64;
+      u64 upperBits = _upper[upperIndex] & (~0ull << (i % 64));
+      if (upperBits != 0)
+      {
+        u32 next = upperIndex * 64 + std::countr_zero(upperBits);
+        return next * 64 + std::countr_zero(_summary[next]);
+      }
+      i = (upperIndex + 1) * 64;
+    }
+
+    return Ice::null32;
   }
-  constexpr u32 ValueToBit(u32 _value)
+
+  // Word with the flags holding _value set
+  constexpr u64 MatchingBits(u32 _wordIndex, b8 _value) const
   {
-    return _value % 8;
+    return _value ? words[_wordIndex] : (~words[_wordIndex] & ValidMask(_wordIndex));
   }
 
 public:
-  FlagArray(u32 _flagCount, b8 _initialValue = false)
+  FlagArray(u32 _flagCount, b8 _initialValue = false, Ice::MemoryTags _tag = Ice::Memory_Tag_Container)
   {
+    memoryTag = _tag;
     Resize(_flagCount, _initialValue);
   }
 
@@ -41,33 +142,76 @@ public:
 
   void Shutdown()
   {
+    Ice::BlockFree(words, AllocationSize(), memoryTag);
+    words = anySet = anyClear = anySetUpper = anyClearUpper = nullptr;
+    wordCount = summaryCount = upperCount = 0;
     flagCount = 0;
-    byteCount = 0;
-    Ice::MemoryFree(data);
+    setCount = 0;
   }
 
+  // Applies to allocations made after this call
+  void SetMemoryTag(Ice::MemoryTags _tag)
+  {
+    memoryTag = _tag;
+  }
+
+  // Existing flags keep their values; new flags are set to _initialValue
   void Resize(u32 _flagCount, b8 _initialValue = false)
   {
-    char* oldData = data;
-    u32 oldByteCount = byteCount;
+    u64* oldWords = words;
+    u64 oldAllocationSize = AllocationSize();
+    u32 oldWordCount = wordCount;
+    u32 oldFlagCount = flagCount;
 
     flagCount = _flagCount;
-    byteCount = (flagCount + 7) / 8; // Bits to bytes, rounding up
+    wordCount = WordCountFor(flagCount);
+    summaryCount = WordCountFor(wordCount);
+    upperCount = WordCountFor(summaryCount);
+
+    words = (u64*)Ice::BlockAllocate(AllocationSize(), memoryTag);
+    anySet = words + wordCount;
+    anyClear = anySet + summaryCount;
+    anySetUpper = anyClear + summaryCount;
+    anyClearUpper = anySetUpper + upperCount;
+
+    u32 keptWords = min(oldWordCount, wordCount);
+    if (oldWords != nullptr)
+    {
+      Ice::MemoryCopy(oldWords, words, (u64)keptWords * sizeof(u64));
+      Ice::BlockFree(oldWords, oldAllocationSize, memoryTag);
+    }
+    if (wordCount > keptWords)
+    {
+      Ice::MemoryZero(words + keptWords, (u64)(wordCount - keptWords) * sizeof(u64));
+    }
 
-    data = (char*)Ice::MemoryAllocate(byteCount);
-    Ice::MemorySet(data, byteCount, 0xFFFFFFFF * _initialValue);
+    if (wordCount > 0)
+    {
+      words[wordCount - 1] &= ValidMask(wordCount - 1);
+    }
 
-    if (oldData != nullptr)
+    // Summaries are rebuilt below, so fill the new flags directly
+    for (u32 i = oldFlagCount; i < flagCount && _initialValue; )
     {
-      Ice::MemoryCopy(oldData, data, min(oldByteCount, byteCount));
-      Ice::MemoryFree(oldData);
+      if (i % 64 == 0 && i + 64 <= flagCount)
+      {
+        words[i / 64] = ~0ull;
+        i += 64;
+      }
+      else
+      {
+        AssignBit(words, i, true);
+        i++;
+      }
     }
+
+    RebuildSummaries();
   }
 
-  b8 Get(u32 _index)
+  b8 Get(u32 _index) const
   {
     assert(_index < flagCount);
-    return (data[ValueToByte(_index)] >> ValueToBit(_index)) & 1;
+    return (words[_index / 64] >> (_index % 64)) & 1;
   }
 
   void Set(u32 _index, b8 _value)
@@ -75,66 +219,133 @@ public:
     assert(_index < flagCount);
     _value = _value != 0; // Ensure the value is only 1 or 0
 
-    b8 changeNeeded = ((data[ValueToByte(_index)] >> ValueToBit(_index)) & 1) != _value;
+    if (Get(_index) == _value)
+      return;
 
-    data[ValueToByte(_index)] ^= (changeNeeded << ValueToBit(_index));
+    words[_index / 64] ^= 1ull << (_index % 64);
+    setCount = _value ? setCount + 1 : setCount - 1;
+    UpdateSummary(_index / 64);
   }
 
   b8 Toggle(u32 _index)
   {
     assert(_index < flagCount);
-    data[ValueToByte(_index)] ^= (1 << ValueToBit(_index));
+    Set(_index, !Get(_index));
     return Get(_index);
   }
 
-  u32 FirstIndexWithValue(b8 _value)
+  // Sets _count flags starting at _start to _value
+  void SetRange(u32 _start, u32 _count, b8 _value)
   {
+    assert(_start + _count <= flagCount);
     _value = _value != 0;
 
-    u32 byteIndex = 0;
+    u32 end = _start + _count;
+    u32 i = _start;
+    while (i < end)
+    {
+      u32 wordIndex = i / 64;
+      u32 first = i % 64;
+      u32 last = min(end - wordIndex * 64, 64u); // Exclusive
 
-    // Either a full (0xFF) or empty (0x00) byte depending on the value being searched for
-    const char ignoredByte = 0xFF * !_value;
+      u64 mask = (last == 64 ? ~0ull : ((1ull << last) - 1)) & (~0ull << first);
+      u64 old = words[wordIndex];
+      words[wordIndex] = _value ? (old | mask) : (old & ~mask);
 
-    while (data[byteIndex] == ignoredByte && byteIndex < byteCount)
-    {
-      byteIndex++;
+      setCount += std::popcount(words[wordIndex]) - std::popcount(old);
+      UpdateSummary(wordIndex);
+
+      i = wordIndex * 64 + last;
     }
+  }
+
+  // Returns the first flag at or after _start holding _value, or null32 if there is none
+  u32 FirstIndexWithValue(b8 _value, u32 _start = 0) const
+  {
+    _value = _value != 0;
 
-    if (byteIndex >= byteCount)
+    if (_start < flagCount)
     {
-      IceLogWarning("No flags with desired value of %u", _value);
-      return -1;
+      u32 wordIndex = _start / 64;
+      u64 bits = MatchingBits(wordIndex, _value) & (~0ull << (_start % 64));
+      if (bits != 0)
+        return wordIndex * 64 + std::countr_zero(bits);
+
+      wordIndex = _value ? NextSummarizedWord(anySet, anySetUpper, wordIndex + 1)
+                         : NextSummarizedWord(anyClear, anyClearUpper, wordIndex + 1);
+      if (wordIndex != Ice::null32)
+        return wordIndex * 64 + std::countr_zero(MatchingBits(wordIndex, _value));
     }
 
-    const char byteValue = data[byteIndex];
-    u32 bitIndex = 0;
-    u32 maxBitIndex = (byteIndex < (byteCount - 1)) ? 8 : ValueToBit(flagCount);
+    IceLogWarning("No flags with desired value of %u", _value);
+    return Ice::null32;
+  }
 
-    // The current bit is full so check all bits
-    if (maxBitIndex == 0)
-      maxBitIndex = 8;
+  // Calls _function(index) for every flag holding _value, in ascending order
+  template<typename F>
+  void ForEachWithValue(b8 _value, F _function) const
+  {
+    _value = _value != 0;
 
-    while (((byteValue >> bitIndex) & 1) != _value && bitIndex < maxBitIndex)
+    u32 wordIndex = _value ? NextSummarizedWord(anySet, anySetUpper, 0)
+                           : NextSummarizedWord(anyClear, anyClearUpper, 0);
+    while (wordIndex != Ice::null32)
     {
-      bitIndex++;
+      u64 bits = MatchingBits(wordIndex, _value);
+      while (bits != 0)
+      {
+        _function(wordIndex * 64 + std::countr_zero(bits));
+        bits &= bits - 1;
+      }
+
+      wordIndex = _value ? NextSummarizedWord(anySet, anySetUpper, wordIndex + 1)
+                         : NextSummarizedWord(anyClear, anyClearUpper, wordIndex + 1);
     }
+  }
+
+  // Number of set flags
+  constexpr u32 PopCount() const
+  {
+    return setCount;
+  }
 
-    if (bitIndex >= maxBitIndex)
+  // Number of set flags in [_start, _start + _count)
+  u32 PopCount(u32 _start, u32 _count) const
+  {
+    assert(_start + _count <= flagCount);
+
+    u32 total = 0;
+    u32 end = _start + _count;
+    u32 i = _start;
+    while (i < end)
     {
-      IceLogWarning("No flags with desired value of %u", _value);
-      return -1;
+      u32 wordIndex = i / 64;
+      u32 first = i % 64;
+      u32 last = min(end - wordIndex * 64, 64u);
+
+      u64 mask = (last == 64 ? ~0ull : ((1ull << last) - 1)) & (~0ull << first);
+      total += std::popcount(words[wordIndex] & mask);
+
+      i = wordIndex * 64 + last;
     }
 
-    return bitIndex + (8 * byteIndex);
+    return total;
+  }
+
+  constexpr u32 Size() const
+  {
+    return flagCount;
   }
 
   // Set all bits to the input value
   void Clear(b8 _value = false)
   {
-    _value = _value != 0;
+    if (flagCount == 0)
+      return;
 
-    Ice::MemorySet(data, byteCount, (~0) * _value);
+    Ice::MemorySet(words, (u64)wordCount * sizeof(u64), _value ? 0xFF : 0x00);
+    words[wordCount - 1] &= ValidMask(wordCount - 1);
+    RebuildSummaries();
   }
 
 };
@@ -0,0 +1,281 @@
+
+#ifndef ICE_TOOLS_INLINE_ARRAY_H_
+#define ICE_TOOLS_INLINE_ARRAY_H_
+
+#include "defines.h"
+
+#include "core/platform/platform.h"
+#include "core/platform/block_allocator.h"
+
+#include <assert.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Ice {
+
+// Growable array that stores its first InlineCapacity elements in-place
+// Only moves to a heap block once the inline capacity is exceeded, so short lists (a
+//   material's shaders, a shader's inputs) never allocate
+template<typename T, u32 InlineCapacity>
+class InlineArray
+{
+private:
+  alignas(T) u8 inlineData[InlineCapacity * sizeof(T)];
+  T* data = (T*)inlineData;
+  Ice::MemoryTags memoryTag = Ice::Memory_Tag_Container;
+
+  u32 allocatedElementCount = InlineCapacity;
+  u32 usedElementCount = 0;
+
+  b8 IsInline() const
+  {
+    return data == (const T*)inlineData;
+  }
+
+  // Moves _count elements into uninitialized memory, leaving the sources destroyed
+  static void RelocateElements(T* _source, T* _destination, u32 _count)
+  {
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+      if (_count > 0)
+        Ice::MemoryCopy(_source, _destination, _count * sizeof(T));
+    }
+    else
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        new (&_destination[i]) T(std::move(_source[i]));
+        _source[i].~T();
+      }
+    }
+  }
+
+  static void DestroyElements(T* _first, u32 _count)
+  {
+    if constexpr (!std::is_trivially_destructible_v<T>)
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        _first[i].~T();
+      }
+    }
+  }
+
+  void ReleaseHeap()
+  {
+    if (!IsInline())
+    {
+      Ice::BlockFree(data, allocatedElementCount * sizeof(T), memoryTag);
+      data = (T*)inlineData;
+      allocatedElementCount = InlineCapacity;
+    }
+  }
+
+  void CopyFrom(const T* _data, u32 _count)
+  {
+    Reserve(_count);
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+      if (_count > 0)
+        Ice::MemoryCopy((void*)_data, data, _count * sizeof(T));
+    }
+    else
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        new (&data[i]) T(_data[i]);
+      }
+    }
+    usedElementCount = _count;
+  }
+
+  // Takes _other's heap block, or moves its elements when they are inline
+  void MoveFrom(Ice::InlineArray<T, InlineCapacity>& _other)
+  {
+    memoryTag = _other.memoryTag;
+    if (_other.IsInline())
+    {
+      RelocateElements(_other.data, data, _other.usedElementCount);
+    }
+    else
+    {
+      data = _other.data;
+      allocatedElementCount = _other.allocatedElementCount;
+      _other.data = (T*)_other.inlineData;
+      _other.allocatedElementCount = InlineCapacity;
+    }
+    usedElementCount = _other.usedElementCount;
+    _other.usedElementCount = 0;
+  }
+
+public:
+  InlineArray()
+  {}
+
+  // _tag : Credited with the heap block if the array outgrows its inline storage
+  InlineArray(Ice::MemoryTags _tag)
+  {
+    memoryTag = _tag;
+  }
+
+  InlineArray(const Ice::InlineArray<T, InlineCapacity>& _other)
+  {
+    memoryTag = _other.memoryTag;
+    CopyFrom(_other.data, _other.usedElementCount);
+  }
+
+  InlineArray(Ice::InlineArray<T, InlineCapacity>&& _other)
+  {
+    MoveFrom(_other);
+  }
+
+  ~InlineArray()
+  {
+    Clear();
+    ReleaseHeap();
+  }
+
+  Ice::InlineArray<T, InlineCapacity>& operator =(const Ice::InlineArray<T, InlineCapacity>& _other)
+  {
+    if (this != &_other)
+      Assign(_other.data, _other.usedElementCount);
+
+    return *this;
+  }
+
+  Ice::InlineArray<T, InlineCapacity>& operator =(Ice::InlineArray<T, InlineCapacity>&& _other)
+  {
+    if (this != &_other)
+    {
+      Clear();
+      ReleaseHeap();
+      MoveFrom(_other);
+    }
+
+    return *this;
+  }
+
+  // Replaces the contents with copies of _count elements from _data
+  void Assign(const T* _data, u32 _count)
+  {
+    Clear();
+    CopyFrom(_data, _count);
+  }
+
+  T& PushBack(T _value)
+  {
+    if (usedElementCount >= allocatedElementCount)
+    {
+      Reserve(allocatedElementCount * 2);
+    }
+
+    new (&data[usedElementCount]) T(std::move(_value));
+    usedElementCount++;
+
+    return data[usedElementCount - 1];
+  }
+
+  T& Back()
+  {
+    return data[usedElementCount - 1];
+  }
+
+  T& operator [](u32 _index)
+  {
+    assert(_index < usedElementCount);
+    return data[_index];
+  }
+
+  const T& operator [](u32 _index) const
+  {
+    assert(_index < usedElementCount);
+    return data[_index];
+  }
+
+  T* Get(u32 _index)
+  {
+    assert(_index < usedElementCount);
+    return &data[_index];
+  }
+
+  T* GetArray(u32* _count = nullptr)
+  {
+    if (_count != nullptr)
+      *_count = usedElementCount;
+
+    return data;
+  }
+
+  T* Data()
+  {
+    return data;
+  }
+
+  const T* Data() const
+  {
+    return data;
+  }
+
+  constexpr u32 Size() const
+  {
+    return usedElementCount;
+  }
+
+  constexpr u32 GetAllocatedSize() const
+  {
+    return allocatedElementCount;
+  }
+
+  // Ensures space for _count elements without further allocation
+  void Reserve(u32 _count)
+  {
+    if (_count <= allocatedElementCount)
+      return;
+
+    T* newData = (T*)Ice::BlockAllocate(_count * sizeof(T), memoryTag);
+    RelocateElements(data, newData, usedElementCount);
+    ReleaseHeap();
+
+    data = newData;
+    allocatedElementCount = _count;
+  }
+
+  // Newly exposed elements are value-initialized
+  void Resize(u32 _newCount)
+  {
+    if (_newCount < usedElementCount)
+    {
+      DestroyElements(data + _newCount, usedElementCount - _newCount);
+    }
+    else
+    {
+      Reserve(_newCount);
+      for (u32 i = usedElementCount; i < _newCount; i++)
+      {
+        new (&data[i]) T{};
+      }
+    }
+    usedElementCount = _newCount;
+  }
+
+  // Keeps any heap block for reuse
+  void Clear()
+  {
+    DestroyElements(data, usedElementCount);
+    usedElementCount = 0;
+  }
+
+  //=========================
+  // Iterator
+  //=========================
+
+  T* begin() { return data; }
+  T* end() { return data + usedElementCount; }
+  const T* begin() const { return data; }
+  const T* end() const { return data + usedElementCount; }
+};
+
+} // namespace Ice
+
+#endif // !ICE_TOOLS_INLINE_ARRAY_H_
@@ -0,0 +1,187 @@
+
+// Converts a binary log file (written with Ice::Logger_File_Binary) to text
+// Usage : IceLogDecoder <log file> [output file]
+// Each line is prefixed with the message's type and category
+
+#include "defines.h"
+
+#include "tools/log_format.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct LogDecoder
+{
+  std::vector<u8> data;
+  u64 offset = 0;
+
+  b8 Read(void* _out, u64 _size)
+  {
+    if (offset + _size > data.size())
+      return false;
+    if (_size == 0)
+      return true;
+
+    memcpy(_out, data.data() + offset, _size);
+    offset += _size;
+    return true;
+  }
+};
+
+b8 LoadLogFile(const char* _path, std::vector<u8>& _data)
+{
+  FILE* file = fopen(_path, "rb");
+  if (file == nullptr)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  _data.resize(size > 0 ? (size_t)size : 0);
+  size_t read = fread(_data.data(), 1, _data.size(), file);
+  fclose(file);
+  return read == _data.size();
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage : %s <log file> [output file]\n", argv[0]);
+    return 1;
+  }
+
+  LogDecoder decoder;
+  if (!LoadLogFile(argv[1], decoder.data))
+  {
+    fprintf(stderr, "Failed to read '%s'\n", argv[1]);
+    return 1;
+  }
+
+  Ice::LogFileHeader header;
+  if (!decoder.Read(&header, sizeof(header))
+      || memcmp(header.magic, ICE_LOG_FILE_MAGIC, sizeof(header.magic)) != 0)
+  {
+    fprintf(stderr, "'%s' is not a binary log file\n", argv[1]);
+    return 1;
+  }
+  if (header.version != ICE_LOG_FILE_VERSION)
+  {
+    fprintf(stderr, "Unsupported log file version %u (expected %u)\n", header.version, ICE_LOG_FILE_VERSION);
+    return 1;
+  }
+
+  FILE* output = stdout;
+  if (argc > 2)
+  {
+    output = fopen(argv[2], "w");
+    if (output == nullptr)
+    {
+      fprintf(stderr, "Failed to open '%s'\n", argv[2]);
+      return 1;
+    }
+  }
+
+  std::unordered_map<u64, std::string> formats;
+  std::vector<u8> arguments;
+  char message[ICE_LOG_MESSAGE_MAX];
+  b8 complete = true;
+
+  while (decoder.offset < decoder.data.size())
+  {
+    u8 entry;
+    decoder.Read(&entry, sizeof(u8));
+
+    switch (entry)
+    {
+    case Ice::Log_File_Entry_Format:
+    {
+      u64 id;
+      u16 length;
+      if (!decoder.Read(&id, sizeof(u64)) || !decoder.Read(&length, sizeof(u16)))
+      {
+        complete = false;
+        break;
+      }
+
+      std::string format(length, '\0');
+      if (!decoder.Read(format.data(), length))
+      {
+        complete = false;
+        break;
+      }
+      formats[id] = std::move(format);
+    } break;
+    case Ice::Log_File_Entry_Record:
+    {
+      u8 type, category;
+      u64 id;
+      u16 size;
+      if (!decoder.Read(&type, sizeof(u8))
+          || !decoder.Read(&category, sizeof(u8))
+          || !decoder.Read(&id, sizeof(u64))
+          || !decoder.Read(&size, sizeof(u16)))
+      {
+        complete = false;
+        break;
+      }
+
+      arguments.resize(size);
+      if (!decoder.Read(arguments.data(), size))
+      {
+        complete = false;
+        break;
+      }
+
+      auto format = formats.find(id);
+      if (format == formats.end())
+      {
+        fprintf(output, "[%s][%s] <undefined format 0x%llx>\n",
+                Ice::LogTypeName((Ice::LogTypes)type),
+                Ice::LogCategoryName((Ice::LogCategories)category),
+                id);
+        break;
+      }
+
+      Ice::LogFormatMessage(message, format->second.c_str(), arguments.data(), size);
+      fprintf(output, "[%s][%s] %s",
+              Ice::LogTypeName((Ice::LogTypes)type),
+              Ice::LogCategoryName((Ice::LogCategories)category),
+              message);
+    } break;
+    case Ice::Log_File_Entry_Dropped:
+    {
+      u64 count;
+      if (!decoder.Read(&count, sizeof(u64)))
+      {
+        complete = false;
+        break;
+      }
+      fprintf(output, "[Warning][Logger] Queue full -- dropped %llu messages\n", count);
+    } break;
+    default:
+    {
+      fprintf(stderr, "Unknown entry %u at offset %llu\n", entry, decoder.offset - 1);
+      decoder.offset = decoder.data.size();
+      complete = false;
+    } break;
+    }
+
+    if (!complete)
+      break;
+  }
+
+  if (!complete)
+  {
+    fprintf(stderr, "Stopped decoding early; the log may have been cut off by a crash\n");
+  }
+
+  if (output != stdout)
+    fclose(output);
+
+  return complete ? 0 : 1;
+}
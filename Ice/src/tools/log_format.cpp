@@ -0,0 +1,275 @@
+
+#include "defines.h"
+
+#include "tools/log_format.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct LogArgument
+{
+  u8 kind;
+  u64 bits;
+  const char* string;
+};
+
+// Reads the argument at *_offset, returning false when none remain or it is malformed
+b8 LogReadArgument(const u8* _arguments, u32 _size, u32* _offset, LogArgument* _out)
+{
+  u32 offset = *_offset;
+  if (offset >= _size)
+    return false;
+
+  _out->kind = _arguments[offset];
+  _out->bits = 0;
+  _out->string = nullptr;
+
+  if (_out->kind == Ice::Log_Argument_String)
+  {
+    u16 length;
+    if (offset + 3 > _size)
+      return false;
+    memcpy(&length, _arguments + offset + 1, sizeof(u16));
+    if (length == 0 || offset + 3 + length > _size || _arguments[offset + 3 + length - 1] != '\0')
+      return false;
+
+    _out->string = (const char*)(_arguments + offset + 3);
+    *_offset = offset + 3 + length;
+    return true;
+  }
+
+  if (_out->kind > Ice::Log_Argument_String || offset + 9 > _size)
+    return false;
+
+  memcpy(&_out->bits, _arguments + offset + 1, sizeof(u64));
+  *_offset = offset + 9;
+  return true;
+}
+
+i64 LogArgumentAsInteger(const LogArgument& _argument)
+{
+  switch (_argument.kind)
+  {
+  case Ice::Log_Argument_Float:
+  {
+    f64 value;
+    memcpy(&value, &_argument.bits, sizeof(f64));
+    return (i64)value;
+  }
+  case Ice::Log_Argument_String: return 0;
+  default: return (i64)_argument.bits;
+  }
+}
+
+f64 LogArgumentAsFloat(const LogArgument& _argument)
+{
+  switch (_argument.kind)
+  {
+  case Ice::Log_Argument_Float:
+  {
+    f64 value;
+    memcpy(&value, &_argument.bits, sizeof(f64));
+    return value;
+  }
+  case Ice::Log_Argument_Signed: return (f64)(i64)_argument.bits;
+  case Ice::Log_Argument_String: return 0.0;
+  default: return (f64)_argument.bits;
+  }
+}
+
+// Strings for %s, formatting other kinds of argument as they were most likely meant
+const char* LogArgumentAsString(const LogArgument& _argument, char* _scratch, u32 _scratchSize)
+{
+  switch (_argument.kind)
+  {
+  case Ice::Log_Argument_String: return _argument.string;
+  case Ice::Log_Argument_Float: snprintf(_scratch, _scratchSize, "%g", LogArgumentAsFloat(_argument)); break;
+  case Ice::Log_Argument_Signed: snprintf(_scratch, _scratchSize, "%lld", (i64)_argument.bits); break;
+  default: snprintf(_scratch, _scratchSize, "0x%llx", _argument.bits); break;
+  }
+  return _scratch;
+}
+
+u32 Ice::LogFormatMessage(char* _buffer, const char* _format, const u8* _arguments, u32 _argumentsSize)
+{
+  // Leaves room for the newline and terminator
+  const u32 capacity = ICE_LOG_MESSAGE_MAX - 2;
+  u32 length = 0;
+  u32 offset = 0;
+  const char* c = _format;
+
+  while (*c != '\0' && length < capacity)
+  {
+    if (*c != '%')
+    {
+      _buffer[length++] = *c++;
+      continue;
+    }
+
+    const char* specifierStart = c++;
+    if (*c == '%')
+    {
+      _buffer[length++] = '%';
+      c++;
+      continue;
+    }
+
+    // Rebuild the specifier with a length modifier matching the stored argument
+    char specifier[64];
+    u32 specifierLength = 0;
+    b8 valid = true;
+    specifier[specifierLength++] = '%';
+
+    while (*c != '\0' && strchr("-+ #0", *c) != nullptr)
+    {
+      if (specifierLength < 8)
+        specifier[specifierLength++] = *c;
+      c++;
+    }
+
+    // Width, then precision; either may be taken from an argument
+    for (u32 part = 0; part < 2; part++)
+    {
+      if (part == 1)
+      {
+        if (*c != '.')
+          break;
+        specifier[specifierLength++] = *c++;
+      }
+
+      if (*c == '*')
+      {
+        LogArgument size;
+        if (LogReadArgument(_arguments, _argumentsSize, &offset, &size))
+        {
+          specifierLength += snprintf(specifier + specifierLength,
+                                      sizeof(specifier) - specifierLength,
+                                      "%d",
+                                      (i32)LogArgumentAsInteger(size));
+        }
+        else
+        {
+          valid = false;
+        }
+        c++;
+      }
+      else
+      {
+        u32 digitCount = 0;
+        while (*c >= '0' && *c <= '9')
+        {
+          if (digitCount++ < 6)
+            specifier[specifierLength++] = *c;
+          c++;
+        }
+      }
+    }
+
+    while (*c != '\0' && strchr("hlLjzt", *c) != nullptr)
+    {
+      c++;
+    }
+
+    char conversion = *c;
+    if (conversion != '\0')
+      c++;
+
+    LogArgument argument;
+    if (conversion == '\0'
+        || strchr("diuxXocfFeEgGaAsp", conversion) == nullptr
+        || !valid
+        || !LogReadArgument(_arguments, _argumentsSize, &offset, &argument))
+    {
+      u32 copied = (u32)(c - specifierStart);
+      if (copied > capacity - length)
+        copied = capacity - length;
+      memcpy(_buffer + length, specifierStart, copied);
+      length += copied;
+      continue;
+    }
+
+    char* out = _buffer + length;
+    size_t room = capacity - length + 1; // snprintf counts the terminator
+    i32 written = 0;
+    switch (conversion)
+    {
+    case 'd': case 'i':
+    {
+      memcpy(specifier + specifierLength, "ll", 2);
+      specifier[specifierLength + 2] = conversion;
+      specifier[specifierLength + 3] = '\0';
+      written = snprintf(out, room, specifier, LogArgumentAsInteger(argument));
+    } break;
+    case 'u': case 'x': case 'X': case 'o':
+    {
+      memcpy(specifier + specifierLength, "ll", 2);
+      specifier[specifierLength + 2] = conversion;
+      specifier[specifierLength + 3] = '\0';
+      written = snprintf(out, room, specifier, (u64)LogArgumentAsInteger(argument));
+    } break;
+    case 'c':
+    {
+      specifier[specifierLength] = conversion;
+      specifier[specifierLength + 1] = '\0';
+      written = snprintf(out, room, specifier, (i32)LogArgumentAsInteger(argument));
+    } break;
+    case 'p':
+    {
+      specifier[specifierLength] = conversion;
+      specifier[specifierLength + 1] = '\0';
+      written = snprintf(out, room, specifier, (void*)(size_t)LogArgumentAsInteger(argument));
+    } break;
+    case 's':
+    {
+      char scratch[32];
+      specifier[specifierLength] = conversion;
+      specifier[specifierLength + 1] = '\0';
+      written = snprintf(out, room, specifier, LogArgumentAsString(argument, scratch, sizeof(scratch)));
+    } break;
+    default:
+    {
+      specifier[specifierLength] = conversion;
+      specifier[specifierLength + 1] = '\0';
+      written = snprintf(out, room, specifier, LogArgumentAsFloat(argument));
+    } break;
+    }
+
+    if (written < 0)
+      written = 0;
+    if ((u32)written > capacity - length)
+      written = (i32)(capacity - length);
+    length += (u32)written;
+  }
+
+  _buffer[length] = '\n';
+  _buffer[length + 1] = '\0';
+  return length + 1;
+}
+
+const char* Ice::LogTypeName(Ice::LogTypes _type)
+{
+  switch (_type)
+  {
+  case Ice::Log_Type_Info: return "Info";
+  case Ice::Log_Type_Debug: return "Debug";
+  case Ice::Log_Type_Warning: return "Warning";
+  case Ice::Log_Type_Error: return "Error";
+  case Ice::Log_Type_Fatal: return "Fatal";
+  default: return "Unknown";
+  }
+}
+
+const char* Ice::LogCategoryName(Ice::LogCategories _category)
+{
+  switch (_category)
+  {
+  case Ice::Log_Category_General: return "General";
+  case Ice::Log_Category_Platform: return "Platform";
+  case Ice::Log_Category_Memory: return "Memory";
+  case Ice::Log_Category_Renderer: return "Renderer";
+  case Ice::Log_Category_Ecs: return "Ecs";
+  case Ice::Log_Category_Asset: return "Asset";
+  case Ice::Log_Category_Game: return "Game";
+  default: return "Unknown";
+  }
+}
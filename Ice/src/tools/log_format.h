@@ -0,0 +1,55 @@
+
+#ifndef ICE_TOOLS_LOG_FORMAT_H_
+#define ICE_TOOLS_LOG_FORMAT_H_
+
+#include "defines.h"
+
+// Shared by the logger and the log decoder tool, so nothing here may use the platform layer
+
+// Longest message including its newline; longer messages are truncated
+#define ICE_LOG_MESSAGE_MAX 2048
+
+namespace Ice {
+
+//=========================
+// Binary log files
+//=========================
+// A LogFileHeader followed by a stream of entries, each starting with a LogFileEntries byte.
+// All values are little-endian and unaligned.
+//   Format  : u64 id, u16 length, characters (no terminator)
+//             Written once per format string, before the first record that uses it
+//   Record  : u8 type, u8 category, u64 format id, u16 arguments size, arguments
+//             Arguments are encoded as in Ice::LogArguments
+//   Dropped : u64 number of messages lost to a full queue
+
+#define ICE_LOG_FILE_MAGIC "IceLog"
+#define ICE_LOG_FILE_VERSION 1
+
+struct LogFileHeader
+{
+  char magic[6];
+  u16 version;
+};
+
+enum LogFileEntries
+{
+  Log_File_Entry_Format,
+  Log_File_Entry_Record,
+  Log_File_Entry_Dropped,
+};
+
+//=========================
+// Formatting
+//=========================
+
+// Formats _format with the encoded arguments into _buffer (at least ICE_LOG_MESSAGE_MAX bytes) and
+//   appends the newline, returning the length written
+// Arguments are converted to suit each specifier, and specifiers without an argument are copied as-is
+u32 LogFormatMessage(char* _buffer, const char* _format, const u8* _arguments, u32 _argumentsSize);
+
+const char* LogTypeName(Ice::LogTypes _type);
+const char* LogCategoryName(Ice::LogCategories _category);
+
+} // namespace Ice
+
+#endif // !ICE_TOOLS_LOG_FORMAT_H_
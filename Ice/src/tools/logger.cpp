@@ -2,22 +2,603 @@
 #include "defines.h"
 
 #include "tools/logger.h"
+#include "tools/log_format.h"
 #include "core/platform/platform.h"
 
+#include <atomic>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+//=========================
+// Queue
+//=========================
+// Messages are copied into consecutive fixed-size slots of a lock-free ring buffer.
+// Each slot carries a sequence number that tells producers when it is free and the logging
+//   thread when it is filled, so any number of threads can queue while one thread writes.
+// A record spans one or more slots. The first slot starts with a LogRecordHeader, followed by
+//   the record's payload : the format string pointer, then the encoded arguments.
+
+#define ICE_LOG_SLOT_SIZE 128
+#define ICE_LOG_PAYLOAD_MAX (sizeof(u64) + ICE_LOG_ARGUMENTS_MAX)
+
+struct LogSlot
+{
+  std::atomic<u64> sequence;
+  char payload[ICE_LOG_SLOT_SIZE - sizeof(std::atomic<u64>)];
+};
+
+struct LogRecordHeader
+{
+  u8 type;
+  u8 category;
+  u16 slotCount;
+  u16 length; // Bytes of payload
+  u16 padding;
+};
+
+constexpr u32 logSlotPayloadSize = sizeof(LogSlot::payload);
+constexpr u32 logFirstSlotPayloadSize = logSlotPayloadSize - sizeof(LogRecordHeader);
+// Enough slots for the largest record
+constexpr u32 logMinSlotCount = 64;
+
+struct LoggerState
+{
+  LogSlot* slots;
+  u64 slotCount;
+  Ice::LoggerSettings settings;
+  FILE* file;
+
+  alignas(64) std::atomic<u64> writePosition; // Next position claimed by a producer
+  alignas(64) std::atomic<u64> readPosition;  // Next position consumed by the logging thread
+
+  alignas(64) std::atomic<b8> running;
+  std::atomic<u32> activeWriters;  // Producers that may be touching the ring
+  std::atomic<u32> wakeCount;
+  std::atomic<b8> threadSleeping;
+  std::atomic<u64> droppedCount;
+
+  // Keeps direct writes (Fatal messages and synchronous mode) from interleaving with batches
+  std::atomic_flag outputLock;
+
+  // Format strings already defined in the binary file, as an open-addressed set of pointers
+  // Guarded by outputLock
+  u64* knownFormats;
+  u32 knownFormatCapacity;
+  u32 knownFormatCount;
+};
+
+// Zero-initialized, so messages logged before LoggerInitialize take the synchronous path
+LoggerState logger;
+std::thread loggerThread;
+std::atomic<u8> logLevels[Ice::Log_Category_Count];
+
+// Joins the logging thread if the application exits without calling LoggerShutdown
+struct LoggerShutdownGuard
+{
+  ~LoggerShutdownGuard()
+  {
+    Ice::LoggerShutdown();
+  }
+} loggerShutdownGuard;
+
+//=========================
+// Output
+//=========================
+
+void LoggerLockOutput()
+{
+  while (logger.outputLock.test_and_set(std::memory_order_acquire))
+  {
+    std::this_thread::yield();
+  }
+}
+
+void LoggerUnlockOutput()
+{
+  logger.outputLock.clear(std::memory_order_release);
+}
+
+b8 LoggerTextFile()
+{
+  return logger.file != nullptr && logger.settings.fileFormat == Ice::Logger_File_Text;
+}
+
+b8 LoggerBinaryFile()
+{
+  return logger.file != nullptr && logger.settings.fileFormat == Ice::Logger_File_Binary;
+}
+
+// _text must be null-terminated at _text[_length]
+void LoggerWriteOutput(Ice::LogTypes _type, const char* _text, u32 _length, b8 _console)
+{
+  if (_console)
+  {
+    Ice::PrintToConsole(_text, _type);
+  }
+
+  if (LoggerTextFile())
+  {
+    fwrite(_text, 1, _length, logger.file);
+  }
+}
+
+// Binary files =====
+
+// Adds _format to the set of defined formats, returning false if it was already there
+b8 LoggerDefineFormat(u64 _format)
+{
+  if ((logger.knownFormatCount + 1) * 2 > logger.knownFormatCapacity)
+  {
+    u32 newCapacity = logger.knownFormatCapacity ? logger.knownFormatCapacity * 2 : 256;
+    u64* newFormats = (u64*)Ice::MemoryAllocZero(newCapacity * sizeof(u64), Ice::Memory_Tag_Logger);
+    if (newFormats == nullptr)
+      return true; // Redefining a format is harmless
+
+    for (u32 i = 0; i < logger.knownFormatCapacity; i++)
+    {
+      u64 format = logger.knownFormats[i];
+      if (format == 0)
+        continue;
+
+      u32 index = (u32)((format * 0x9E3779B97F4A7C15ull) >> 32) & (newCapacity - 1);
+      while (newFormats[index] != 0)
+      {
+        index = (index + 1) & (newCapacity - 1);
+      }
+      newFormats[index] = format;
+    }
+
+    Ice::MemoryFree(logger.knownFormats);
+    logger.knownFormats = newFormats;
+    logger.knownFormatCapacity = newCapacity;
+  }
+
+  const u32 mask = logger.knownFormatCapacity - 1;
+  u32 index = (u32)((_format * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+  while (logger.knownFormats[index] != 0)
+  {
+    if (logger.knownFormats[index] == _format)
+      return false;
+    index = (index + 1) & mask;
+  }
+
+  logger.knownFormats[index] = _format;
+  logger.knownFormatCount++;
+  return true;
+}
+
+// Writes the record, preceded by its format string the first time that format is seen
+void LoggerWriteBinaryRecord(Ice::LogTypes _type,
+                             Ice::LogCategories _category,
+                             const char* _format,
+                             const u8* _arguments,
+                             u32 _argumentsSize)
+{
+  u8 entry[1 + sizeof(u64) + sizeof(u16)];
+  u64 format = (u64)(size_t)_format;
+
+  if (LoggerDefineFormat(format))
+  {
+    size_t formatLength = strlen(_format);
+    u16 length = formatLength > Ice::null16 ? Ice::null16 : (u16)formatLength;
+
+    entry[0] = (u8)Ice::Log_File_Entry_Format;
+    memcpy(entry + 1, &format, sizeof(u64));
+    memcpy(entry + 1 + sizeof(u64), &length, sizeof(u16));
+    fwrite(entry, 1, sizeof(entry), logger.file);
+    fwrite(_format, 1, length, logger.file);
+  }
+
+  u8 record[3 + sizeof(u64) + sizeof(u16)];
+  u16 argumentsSize = (u16)_argumentsSize;
+  record[0] = (u8)Ice::Log_File_Entry_Record;
+  record[1] = (u8)_type;
+  record[2] = (u8)_category;
+  memcpy(record + 3, &format, sizeof(u64));
+  memcpy(record + 3 + sizeof(u64), &argumentsSize, sizeof(u16));
+  fwrite(record, 1, sizeof(record), logger.file);
+  fwrite(_arguments, 1, argumentsSize, logger.file);
+}
+
+//=========================
+// Logging thread
+//=========================
+
+void LoggerWake()
+{
+  logger.wakeCount.fetch_add(1, std::memory_order_seq_cst);
+  logger.wakeCount.notify_one();
+}
+
+b8 LoggerRecordReady()
+{
+  u64 position = logger.readPosition.load(std::memory_order_relaxed);
+  const LogSlot& slot = logger.slots[position & (logger.slotCount - 1)];
+  return slot.sequence.load(std::memory_order_seq_cst) == position + 1;
+}
+
+// Writes every published record, batching consecutive records of the same type
+// Records are only formatted if they are going to the console or a text file
+// Returns false if there was nothing to write
+b8 LoggerDrain()
+{
+  // Only touched by the logging thread (or by LoggerShutdown once it has stopped)
+  static char batch[4 * ICE_LOG_MESSAGE_MAX + 1];
+  static u8 payload[ICE_LOG_PAYLOAD_MAX];
+  u32 batchLength = 0;
+  Ice::LogTypes batchType = Ice::Log_Type_Info;
+  const b8 formatRecords = logger.settings.writeToConsole || LoggerTextFile();
+
+  const u64 mask = logger.slotCount - 1;
+  u64 position = logger.readPosition.load(std::memory_order_relaxed);
+  b8 wroteAny = false;
+
+  while (true)
+  {
+    LogSlot& first = logger.slots[position & mask];
+    if (first.sequence.load(std::memory_order_acquire) != position + 1)
+      break;
+
+    LogRecordHeader header;
+    memcpy(&header, first.payload, sizeof(LogRecordHeader));
+
+    // Continuation slots are published before the first, so the whole record is readable
+    u32 copied = min(header.length, logFirstSlotPayloadSize);
+    memcpy(payload, first.payload + sizeof(LogRecordHeader), copied);
+    for (u32 i = 1; i < header.slotCount; i++)
+    {
+      const LogSlot& slot = logger.slots[(position + i) & mask];
+      u32 chunk = min(header.length - copied, logSlotPayloadSize);
+      memcpy(payload + copied, slot.payload, chunk);
+      copied += chunk;
+    }
+
+    u64 formatPointer;
+    memcpy(&formatPointer, payload, sizeof(u64));
+    const char* format = (const char*)(size_t)formatPointer;
+    const u8* arguments = payload + sizeof(u64);
+    u32 argumentsSize = header.length - sizeof(u64);
+
+    if (LoggerBinaryFile())
+    {
+      LoggerWriteBinaryRecord((Ice::LogTypes)header.type,
+                              (Ice::LogCategories)header.category,
+                              format,
+                              arguments,
+                              argumentsSize);
+    }
+
+    if (formatRecords)
+    {
+      if (batchLength > 0
+          && (header.type != batchType || batchLength + ICE_LOG_MESSAGE_MAX >= sizeof(batch)))
+      {
+        batch[batchLength] = '\0';
+        LoggerWriteOutput(batchType, batch, batchLength, logger.settings.writeToConsole);
+        batchLength = 0;
+      }
+
+      batchLength += Ice::LogFormatMessage(batch + batchLength, format, arguments, argumentsSize);
+      batchType = (Ice::LogTypes)header.type;
+    }
+
+    // Hand the slots back to producers for the next lap of the ring
+    for (u32 i = 0; i < header.slotCount; i++)
+    {
+      logger.slots[(position + i) & mask].sequence.store(position + i + logger.slotCount,
+                                                         std::memory_order_release);
+    }
+    position += header.slotCount;
+    logger.readPosition.store(position, std::memory_order_release);
+    wroteAny = true;
+  }
+
+  if (batchLength > 0)
+  {
+    batch[batchLength] = '\0';
+    LoggerWriteOutput(batchType, batch, batchLength, logger.settings.writeToConsole);
+  }
+
+  u64 dropped = logger.droppedCount.exchange(0, std::memory_order_relaxed);
+  if (dropped > 0)
+  {
+    i32 length = snprintf(batch, sizeof(batch), "Logger queue full -- dropped %llu messages\n", dropped);
+    LoggerWriteOutput(Ice::Log_Type_Warning, batch, (u32)length, logger.settings.writeToConsole);
+
+    if (LoggerBinaryFile())
+    {
+      u8 entry[1 + sizeof(u64)];
+      entry[0] = (u8)Ice::Log_File_Entry_Dropped;
+      memcpy(entry + 1, &dropped, sizeof(u64));
+      fwrite(entry, 1, sizeof(entry), logger.file);
+    }
+  }
+
+  if (wroteAny && logger.file != nullptr)
+  {
+    fflush(logger.file);
+  }
+
+  return wroteAny;
+}
+
+void LoggerThreadMain()
+{
+  while (true)
+  {
+    LoggerLockOutput();
+    b8 wrote = LoggerDrain();
+    LoggerUnlockOutput();
+
+    if (wrote)
+      continue;
+
+    // Blocked producers still need room after shutdown begins
+    if (!logger.running.load(std::memory_order_acquire)
+        && logger.activeWriters.load(std::memory_order_acquire) == 0)
+    {
+      break;
+    }
+
+    // Sleep until a producer or LoggerShutdown signals
+    u32 wake = logger.wakeCount.load(std::memory_order_seq_cst);
+    logger.threadSleeping.store(true, std::memory_order_seq_cst);
+    if (!LoggerRecordReady() && logger.running.load(std::memory_order_seq_cst))
+    {
+      logger.wakeCount.wait(wake, std::memory_order_seq_cst);
+    }
+    logger.threadSleeping.store(false, std::memory_order_relaxed);
+  }
+}
+
+//=========================
+// Producers
+//=========================
+
+// Claims enough consecutive slots for the record, applying the overflow policy when full
+// Returns false if the message was dropped
+b8 LoggerEnqueue(Ice::LogTypes _type, Ice::LogCategories _category, const u8* _payload, u32 _length)
+{
+  u32 slotsNeeded = 1;
+  if (_length > logFirstSlotPayloadSize)
+  {
+    slotsNeeded += (_length - logFirstSlotPayloadSize + logSlotPayloadSize - 1) / logSlotPayloadSize;
+  }
+
+  const u64 mask = logger.slotCount - 1;
+  u64 position = logger.writePosition.load(std::memory_order_relaxed);
+  while (true)
+  {
+    // The logging thread frees slots in order, so the last slot being free means all are
+    u64 last = position + slotsNeeded - 1;
+    u64 sequence = logger.slots[last & mask].sequence.load(std::memory_order_acquire);
+    i64 difference = (i64)sequence - (i64)last;
+
+    if (difference == 0)
+    {
+      if (logger.writePosition.compare_exchange_weak(position,
+                                                     position + slotsNeeded,
+                                                     std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (difference < 0)
+    {
+      if (logger.settings.overflowPolicy == Ice::Logger_Overflow_Drop)
+      {
+        logger.droppedCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+
+      LoggerWake();
+      std::this_thread::yield();
+      position = logger.writePosition.load(std::memory_order_relaxed);
+    }
+    else
+    {
+      position = logger.writePosition.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Continuation slots first, then the header slot to publish the record
+  u32 written = min(_length, logFirstSlotPayloadSize);
+  for (u32 i = 1; i < slotsNeeded; i++)
+  {
+    LogSlot& slot = logger.slots[(position + i) & mask];
+    u32 chunk = min(_length - written, logSlotPayloadSize);
+    memcpy(slot.payload, _payload + written, chunk);
+    written += chunk;
+    slot.sequence.store(position + i + 1, std::memory_order_release);
+  }
+
+  LogSlot& first = logger.slots[position & mask];
+  LogRecordHeader header;
+  header.type = (u8)_type;
+  header.category = (u8)_category;
+  header.slotCount = (u16)slotsNeeded;
+  header.length = (u16)_length;
+  header.padding = 0;
+  memcpy(first.payload, &header, sizeof(LogRecordHeader));
+  memcpy(first.payload + sizeof(LogRecordHeader), _payload, min(_length, logFirstSlotPayloadSize));
+  first.sequence.store(position + 1, std::memory_order_seq_cst);
+
+  if (logger.threadSleeping.load(std::memory_order_seq_cst))
+  {
+    LoggerWake();
+  }
+
+  return true;
+}
+
+//=========================
+// Interface
+//=========================
+
+bool Ice::LoggerInitialize(const Ice::LoggerSettings& _settings /*= {}*/)
+{
+  if (logger.running.load(std::memory_order_acquire))
+    return true;
+
+  u64 slotCount = logMinSlotCount;
+  while (slotCount * ICE_LOG_SLOT_SIZE < _settings.queueSize)
+  {
+    slotCount *= 2;
+  }
+
+  logger.slots = (LogSlot*)Ice::MemoryAllocate(slotCount * sizeof(LogSlot), Ice::Memory_Tag_Logger);
+  if (logger.slots == nullptr)
+    return false;
+
+  for (u64 i = 0; i < slotCount; i++)
+  {
+    logger.slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  logger.slotCount = slotCount;
+  logger.writePosition.store(0, std::memory_order_relaxed);
+  logger.readPosition.store(0, std::memory_order_relaxed);
+  logger.droppedCount.store(0, std::memory_order_relaxed);
+  logger.settings = _settings;
+
+  logger.file = nullptr;
+  if (_settings.filePath != nullptr)
+  {
+    if (_settings.fileFormat == Ice::Logger_File_Binary)
+    {
+      logger.file = fopen(_settings.filePath, "wb");
+      if (logger.file != nullptr)
+      {
+        Ice::LogFileHeader header;
+        memcpy(header.magic, ICE_LOG_FILE_MAGIC, sizeof(header.magic));
+        header.version = ICE_LOG_FILE_VERSION;
+        fwrite(&header, 1, sizeof(header), logger.file);
+      }
+    }
+    else
+    {
+      logger.file = fopen(_settings.filePath, "w");
+    }
+  }
+
+  logger.running.store(true, std::memory_order_seq_cst);
+  loggerThread = std::thread(LoggerThreadMain);
+
+  if (_settings.filePath != nullptr && logger.file == nullptr)
+  {
+    IceLogWarning("Failed to open log file '%s'", _settings.filePath);
+  }
+
+  return true;
+}
+
+void Ice::LoggerShutdown()
+{
+  if (!logger.running.exchange(false, std::memory_order_seq_cst))
+    return;
+
+  // Wait out producers that saw the logger running; later ones write synchronously
+  while (logger.activeWriters.load(std::memory_order_seq_cst) > 0)
+  {
+    std::this_thread::yield();
+  }
+
+  LoggerWake();
+  loggerThread.join();
+
+  LoggerLockOutput();
+  LoggerDrain();
+  if (logger.file != nullptr)
+  {
+    fclose(logger.file);
+    logger.file = nullptr;
+  }
+  LoggerUnlockOutput();
+
+  Ice::MemoryFree(logger.slots);
+  logger.slots = nullptr;
+  logger.slotCount = 0;
+
+  if (logger.knownFormats != nullptr)
+  {
+    Ice::MemoryFree(logger.knownFormats);
+    logger.knownFormats = nullptr;
+  }
+  logger.knownFormatCapacity = 0;
+  logger.knownFormatCount = 0;
+}
+
+void Ice::LoggerFlush()
+{
+  if (!logger.running.load(std::memory_order_acquire) || loggerThread.get_id() == std::this_thread::get_id())
+    return;
+
+  u64 target = logger.writePosition.load(std::memory_order_acquire);
+  while (logger.readPosition.load(std::memory_order_acquire) < target)
+  {
+    LoggerWake();
+    std::this_thread::yield();
+  }
+
+  // The last batch may still be mid-write
+  LoggerLockOutput();
+  LoggerUnlockOutput();
+}
+
+void Ice::LoggerSetLevel(Ice::LogCategories _category, Ice::LogTypes _minimum)
+{
+  logLevels[_category].store((u8)_minimum, std::memory_order_relaxed);
+}
+
+Ice::LogTypes Ice::LoggerGetLevel(Ice::LogCategories _category)
+{
+  return (Ice::LogTypes)logLevels[_category].load(std::memory_order_relaxed);
+}
+
+bool Ice::LoggerIsEnabled(Ice::LogTypes _type, Ice::LogCategories _category)
+{
+  return _type == Log_Type_Fatal || (u8)_type >= logLevels[_category].load(std::memory_order_relaxed);
+}
+
 // Not in logger.h to use engine platform functions
 //   instead of having some platform specific functionality separate from the rest
-void Ice::LoggerAssembleMessage(Ice::LogTypes _type, const char* _message, ...)
+void Ice::LoggerSubmit(Ice::LogTypes _type,
+                       Ice::LogCategories _category,
+                       const char* _format,
+                       const Ice::LogArguments& _arguments)
 {
-  // Limit 2048 characters per message
-  const u16 length = 0x800;
-  char* outMessage = (char*)Ice::MemoryAllocZero(length);
+  logger.activeWriters.fetch_add(1, std::memory_order_seq_cst);
+  b8 queued = false;
+  if (logger.running.load(std::memory_order_seq_cst) && _type != Log_Type_Fatal)
+  {
+    u8 payload[ICE_LOG_PAYLOAD_MAX];
+    u64 format = (u64)(size_t)_format;
+    memcpy(payload, &format, sizeof(u64));
+    memcpy(payload + sizeof(u64), _arguments.data, _arguments.size);
+
+    queued = LoggerEnqueue(_type, _category, payload, sizeof(u64) + _arguments.size)
+             || logger.settings.overflowPolicy == Logger_Overflow_Drop;
+  }
+  logger.activeWriters.fetch_sub(1, std::memory_order_seq_cst);
 
-  va_list args;
-  va_start(args, _message);
-  vsnprintf(outMessage, length, _message, args);
-  va_end(args);
+  if (queued)
+    return;
 
-  Ice::PrintToConsole(outMessage, _type);
+  // Fatal messages (and all messages without a logging thread) are formatted and written by the
+  //   caller after anything already queued, so they are visible before a crash or break
+  char text[ICE_LOG_MESSAGE_MAX];
+  u32 length = Ice::LogFormatMessage(text, _format, _arguments.data, _arguments.size);
 
-  Ice::MemoryFree(outMessage);
+  Ice::LoggerFlush();
+  LoggerLockOutput();
+  LoggerWriteOutput(_type, text, length, !logger.running.load() || logger.settings.writeToConsole);
+  if (logger.file != nullptr)
+  {
+    if (LoggerBinaryFile())
+    {
+      LoggerWriteBinaryRecord(_type, _category, _format, _arguments.data, _arguments.size);
+    }
+    fflush(logger.file);
+  }
+  LoggerUnlockOutput();
 }
@@ -2,6 +2,9 @@
 #ifndef ICE_TOOLS_LOGGER_H_
 #define ICE_TOOLS_LOGGER_H_
 
+#include <string.h>
+#include <type_traits>
+
 namespace Ice {
 
 enum LogTypes
@@ -13,44 +16,227 @@ enum LogTypes
   Log_Type_Fatal
 };
 
-void LoggerAssembleMessage(LogTypes _type, const char* _message, ...);
+// Subsystem a message comes from, each with its own runtime level
+enum LogCategories
+{
+  Log_Category_General,
+  Log_Category_Platform,
+  Log_Category_Memory,
+  Log_Category_Renderer,
+  Log_Category_Ecs,
+  Log_Category_Asset,
+  Log_Category_Game,
+
+  Log_Category_Count
+};
+
+enum LoggerOverflowPolicies
+{
+  Logger_Overflow_Drop,  // Discard messages while the queue is full and report how many were lost
+  Logger_Overflow_Block, // Wait for the logging thread to make room
+};
+
+enum LoggerFileFormats
+{
+  Logger_File_Text,   // Formatted on the logging thread
+  Logger_File_Binary, // Raw records, formatted offline by the log decoder tool
+};
+
+struct LoggerSettings
+{
+  // Log file written alongside the console, or nullptr for console only
+  const char* filePath = "ice.log";
+  // Binary files skip formatting entirely when the console is disabled
+  Ice::LoggerFileFormats fileFormat = Ice::Logger_File_Text;
+  // Bytes of queued messages before the overflow policy applies (rounded up to a power of two)
+  unsigned int queueSize = 256 * 1024;
+  Ice::LoggerOverflowPolicies overflowPolicy = Ice::Logger_Overflow_Block;
+  bool writeToConsole = true;
+};
+
+// Starts the logging thread
+// Until then (and after LoggerShutdown) messages are written synchronously by the caller
+bool LoggerInitialize(const Ice::LoggerSettings& _settings = {});
+// Writes all queued messages and stops the logging thread
+void LoggerShutdown();
+// Blocks until every message queued before the call has been written
+void LoggerFlush();
+
+// Messages of a lower type than _minimum in _category are discarded before being formatted
+void LoggerSetLevel(Ice::LogCategories _category, Ice::LogTypes _minimum);
+Ice::LogTypes LoggerGetLevel(Ice::LogCategories _category);
+
+//=========================
+// Deferred formatting
+//=========================
+// Messages are not formatted by the caller. The format string is kept by pointer (so it must be
+//   a string literal) and the arguments are copied raw into the queue, to be formatted by the
+//   logging thread or written as-is to a binary log file.
+
+// Bytes of raw arguments kept per message; arguments past this are dropped
+#define ICE_LOG_ARGUMENTS_MAX 1024
+
+// Each argument is one kind byte followed by 8 bytes of value
+// Strings instead follow with a 2 byte length (including the terminator) and their characters
+enum LogArgumentKinds
+{
+  Log_Argument_Signed,
+  Log_Argument_Unsigned,
+  Log_Argument_Float,
+  Log_Argument_Pointer,
+  Log_Argument_String,
+};
+
+struct LogArguments
+{
+  unsigned int size = 0;
+  bool full = false; // Once an argument is dropped so are the rest, keeping the others in order
+  unsigned char data[ICE_LOG_ARGUMENTS_MAX];
+
+  void Push(Ice::LogArgumentKinds _kind, const void* _value)
+  {
+    if (full || size + 9 > ICE_LOG_ARGUMENTS_MAX)
+    {
+      full = true;
+      return;
+    }
+
+    data[size] = (unsigned char)_kind;
+    memcpy(data + size + 1, _value, 8);
+    size += 9;
+  }
+
+  void PushString(const char* _string)
+  {
+    if (_string == nullptr)
+      _string = "(null)";
+
+    if (full || size + 4 > ICE_LOG_ARGUMENTS_MAX)
+    {
+      full = true;
+      return;
+    }
+
+    // Long strings are cut short to fit
+    size_t length = strlen(_string);
+    if (size + 3 + length + 1 > ICE_LOG_ARGUMENTS_MAX)
+    {
+      length = ICE_LOG_ARGUMENTS_MAX - size - 4;
+      full = true;
+    }
+
+    unsigned short stored = (unsigned short)(length + 1);
+    data[size] = (unsigned char)Ice::Log_Argument_String;
+    memcpy(data + size + 1, &stored, 2);
+    memcpy(data + size + 3, _string, length);
+    data[size + 3 + length] = '\0';
+    size += 3 + stored;
+  }
+};
+
+template<typename T>
+inline void LoggerPackArgument(Ice::LogArguments& _arguments, const T& _value)
+{
+  typedef std::decay_t<T> Type;
+
+  if constexpr (std::is_same_v<Type, const char*> || std::is_same_v<Type, char*>)
+  {
+    _arguments.PushString(_value);
+  }
+  else if constexpr (std::is_floating_point_v<Type>)
+  {
+    double value = (double)_value;
+    _arguments.Push(Ice::Log_Argument_Float, &value);
+  }
+  else if constexpr (std::is_pointer_v<Type> || std::is_null_pointer_v<Type>)
+  {
+    unsigned long long value = (unsigned long long)(size_t)_value;
+    _arguments.Push(Ice::Log_Argument_Pointer, &value);
+  }
+  else if constexpr (std::is_enum_v<Type>)
+  {
+    Ice::LoggerPackArgument(_arguments, (std::underlying_type_t<Type>)_value);
+  }
+  else if constexpr (std::is_integral_v<Type> && std::is_signed_v<Type>)
+  {
+    long long value = (long long)_value;
+    _arguments.Push(Ice::Log_Argument_Signed, &value);
+  }
+  else if constexpr (std::is_integral_v<Type>)
+  {
+    unsigned long long value = (unsigned long long)_value;
+    _arguments.Push(Ice::Log_Argument_Unsigned, &value);
+  }
+  else
+  {
+    static_assert(!sizeof(Type), "Log arguments must be integers, floats, enums, pointers, or strings");
+  }
+}
+
+// False if _type messages in _category are below its level (Fatal messages are always written)
+bool LoggerIsEnabled(Ice::LogTypes _type, Ice::LogCategories _category);
+
+// Queues one line; a newline is appended
+// Fatal messages are written immediately, after everything queued before them
+void LoggerSubmit(Ice::LogTypes _type,
+                  Ice::LogCategories _category,
+                  const char* _format,
+                  const Ice::LogArguments& _arguments);
+
+template<typename... Args>
+void LoggerWrite(Ice::LogTypes _type, Ice::LogCategories _category, const char* _format, const Args&... _args)
+{
+  if (!Ice::LoggerIsEnabled(_type, _category))
+    return;
+
+  Ice::LogArguments arguments;
+  (Ice::LoggerPackArgument(arguments, _args), ...);
+  Ice::LoggerSubmit(_type, _category, _format, arguments);
+}
 
 }  // namespace Ice
 
+// The message is joined with an empty literal so anything but a string literal fails to compile
+#define IceLog(type, category, message, ...) \
+  Ice::LoggerWrite(type, category, "" message, __VA_ARGS__)
+
+// The *In variants credit the message to a category, so its level in logLevels[] applies
+// The plain variants log as Ice::Log_Category_General
 #ifdef ICE_DEBUG
-#define IceLogInfo(message, ...)                                        \
-{                                                                       \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Info, message, __VA_ARGS__); \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Info, "\n");                 \
+#define IceLogInfoIn(category, message, ...)                                           \
+{                                                                                      \
+  IceLog(Ice::Log_Type_Info, category, message, __VA_ARGS__);                          \
 }
 
-#define IceLogDebug(message, ...)                                        \
-{                                                                        \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Debug, message, __VA_ARGS__); \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Debug, "\n");                 \
+#define IceLogDebugIn(category, message, ...)                                          \
+{                                                                                      \
+  IceLog(Ice::Log_Type_Debug, category, message, __VA_ARGS__);                         \
 }
 
-#define IceLogWarning(message, ...)                                        \
-{                                                                          \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Warning, message, __VA_ARGS__); \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Warning, "\n");                 \
+#define IceLogWarningIn(category, message, ...)                                        \
+{                                                                                      \
+  IceLog(Ice::Log_Type_Warning, category, message, __VA_ARGS__);                       \
 }
 #else
-#define IceLogInfo(message, ...)
-#define IceLogDebug(message, ...)
-#define IceLogWarning(message, ...)
+#define IceLogInfoIn(category, message, ...)
+#define IceLogDebugIn(category, message, ...)
+#define IceLogWarningIn(category, message, ...)
 #endif  // ICE_DEBUG
 
-#define IceLogError(message, ...)                                        \
-{                                                                        \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Error, message, __VA_ARGS__); \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Error, "\n");                 \
+#define IceLogErrorIn(category, message, ...)                                          \
+{                                                                                      \
+  IceLog(Ice::Log_Type_Error, category, message, __VA_ARGS__);                         \
 }
 
-#define IceLogFatal(message, ...)                                        \
-{                                                                        \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Fatal, message, __VA_ARGS__); \
-  Ice::LoggerAssembleMessage(Ice::Log_Type_Fatal, "\n");                 \
+#define IceLogFatalIn(category, message, ...)                                          \
+{                                                                                      \
+  IceLog(Ice::Log_Type_Fatal, category, message, __VA_ARGS__);                         \
 }
 
+#define IceLogInfo(message, ...) IceLogInfoIn(Ice::Log_Category_General, message, __VA_ARGS__)
+#define IceLogDebug(message, ...) IceLogDebugIn(Ice::Log_Category_General, message, __VA_ARGS__)
+#define IceLogWarning(message, ...) IceLogWarningIn(Ice::Log_Category_General, message, __VA_ARGS__)
+#define IceLogError(message, ...) IceLogErrorIn(Ice::Log_Category_General, message, __VA_ARGS__)
+#define IceLogFatal(message, ...) IceLogFatalIn(Ice::Log_Category_General, message, __VA_ARGS__)
+
 #endif  // ICE_TOOLS_LOGGER_H_
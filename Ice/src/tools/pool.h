@@ -4,6 +4,11 @@
 
 #include "defines.h"
 #include "core/platform/platform.h"
+#include "core/platform/block_allocator.h"
+
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace Ice {
 
@@ -14,6 +19,7 @@ class CompactPool
   T* data = nullptr;
   u32* indexMap = nullptr;
   Ice::FlagArray indexAvailability;
+  Ice::MemoryTags memoryTag = Ice::Memory_Tag_Container;
 
   u32 allocatedElementCount = 0;
   u32 usedElementCount = 0;
@@ -27,50 +33,117 @@ class CompactPool
     return usedElementCount - 1;
   }
 
+  // Moves _count elements into uninitialized memory, leaving the sources destroyed
+  static void RelocateElements(T* _source, T* _destination, u32 _count)
+  {
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+      if (_count > 0)
+        Ice::MemoryCopy(_source, _destination, _count * sizeof(T));
+    }
+    else
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        new (&_destination[i]) T(std::move(_source[i]));
+        _source[i].~T();
+      }
+    }
+  }
+
+  static void DestroyElements(T* _first, u32 _count)
+  {
+    if constexpr (!std::is_trivially_destructible_v<T>)
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        _first[i].~T();
+      }
+    }
+  }
+
+  // Elements past the used count are left unconstructed
   void ResizeData(u32 _newCount)
   {
-    T* old = data;
-    data = (T*)Ice::MemoryAllocZero(_newCount * sizeof(T));
+    u32 keptCount = min(usedElementCount, _newCount);
+    DestroyElements(data + keptCount, usedElementCount - keptCount);
+    usedElementCount = keptCount;
 
-    usedElementCount = min(usedElementCount, _newCount);
-    Ice::MemoryCopy(old, data, usedElementCount * sizeof(T));
-    Ice::MemoryFree(old);
+    // Large arrays usually have reserved address space to grow into
+    if (Ice::BlockResizeInPlace(data, allocatedElementCount * sizeof(T), _newCount * sizeof(T), memoryTag))
+    {
+      allocatedElementCount = _newCount;
+      return;
+    }
+
+    T* old = data;
+    data = (T*)Ice::BlockAllocate(_newCount * sizeof(T), memoryTag);
+    RelocateElements(old, data, keptCount);
+    Ice::BlockFree(old, allocatedElementCount * sizeof(T), memoryTag);
 
     allocatedElementCount = _newCount;
   }
 
   void ResizeMap(u32 _newCount)
   {
-    u32* oldMap = indexMap;
-    indexMap = (u32*)Ice::MemoryAllocate(_newCount * sizeof(u32));
+    u32* newMap = (u32*)Ice::BlockReallocate(indexMap,
+                                             indexCount * sizeof(u32),
+                                             _newCount * sizeof(u32),
+                                             memoryTag);
+    if (newMap == nullptr)
+    {
+      ICE_ABORT("Failed to resize index map to %u elements", _newCount);
+    }
+    indexMap = newMap;
     indexAvailability.Resize(_newCount, true);
-
-    Ice::MemoryCopy(oldMap, indexMap, indexCount * sizeof(u32));
     indexCount = _newCount;
   }
 
 public:
-  CompactPool(u32 _count = 1, b8 _canGrow = false)
+  CompactPool(u32 _count = 1, b8 _canGrow = false, Ice::MemoryTags _tag = Ice::Memory_Tag_Container)
   {
-    data = (T*)Ice::MemoryAllocZero(_count * sizeof(T));
-    indexMap = (u32*)Ice::MemoryAllocate(_count * sizeof(u32));
+    memoryTag = _tag;
+    indexAvailability.SetMemoryTag(_tag);
+    data = (T*)Ice::BlockAllocate(_count * sizeof(T), memoryTag);
+    indexMap = (u32*)Ice::BlockAllocate(_count * sizeof(u32), memoryTag);
     indexAvailability.Resize(_count, true);
     allocatedElementCount = _count;
     indexCount = _count;
     canGrow = _canGrow;
   }
 
-  CompactPool(T* _data, u32 _count, b8 _canGrow = false)
+  // Copies _count elements from _data into indices [0, _count)
+  CompactPool(const T* _data, u32 _count, b8 _canGrow = false)
   {
-    data = (T*)Ice::MemoryAllocZero(_count * sizeof(T));
-    Ice::MemoryCopy(_data, data, _count);
-    indexMap = (u32*)Ice::MemoryAllocate(_count * sizeof(u32));
-    indexAvailability.Resize(_count, true);
+    data = (T*)Ice::BlockAllocate(_count * sizeof(T), memoryTag);
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+      Ice::MemoryCopy((void*)_data, data, _count * sizeof(T));
+    }
+    else
+    {
+      for (u32 i = 0; i < _count; i++)
+      {
+        new (&data[i]) T(_data[i]);
+      }
+    }
+
+    indexMap = (u32*)Ice::BlockAllocate(_count * sizeof(u32), memoryTag);
+    for (u32 i = 0; i < _count; i++)
+    {
+      indexMap[i] = i;
+    }
+    indexAvailability.Resize(_count, false);
+
     allocatedElementCount = _count;
+    usedElementCount = _count;
     indexCount = _count;
     canGrow = _canGrow;
   }
 
+  CompactPool(const Ice::CompactPool<T>& _other) = delete;
+  Ice::CompactPool<T>& operator =(const Ice::CompactPool<T>& _other) = delete;
+
   ~CompactPool()
   {
     if (allocatedElementCount)
@@ -79,8 +152,9 @@ public:
 
   void Shutdown()
   {
-    Ice::MemoryFree(data);
-    Ice::MemoryFree(indexMap);
+    DestroyElements(data, usedElementCount);
+    Ice::BlockFree(data, allocatedElementCount * sizeof(T), memoryTag);
+    Ice::BlockFree(indexMap, indexCount * sizeof(u32), memoryTag);
     allocatedElementCount = 0;
     usedElementCount = 0;
     indexCount = 0;
@@ -110,7 +184,7 @@ public:
 
     indexAvailability.Set(index, 0);
     indexMap[index] = dataIndex;
-    data[dataIndex] = T();
+    new (&data[dataIndex]) T();
     usedElementCount++;
 
     if (_elementIndex != nullptr)
@@ -121,23 +195,27 @@ public:
 
   void ReturnElement(u32 _index)
   {
-    assert(_index < usedElementCount);
+    assert(_index < indexCount && !indexAvailability.Get(_index));
 
     u32 dataIndex = indexMap[_index];
     u32 dataBackIndex = usedElementCount - 1;
 
-    // Swap removed & back in data
-    data[dataIndex] = data[dataBackIndex];
-
-    // Find back index in map
-    u32 mapBackIndex = 0;
-    while (mapBackIndex < usedElementCount && indexMap[mapBackIndex] != dataBackIndex)
+    // Move the back element into the returned element's place
+    if (dataIndex != dataBackIndex)
     {
-      mapBackIndex++;
+      data[dataIndex] = std::move(data[dataBackIndex]);
+
+      // Find back index in map
+      u32 mapBackIndex = 0;
+      while (indexAvailability.Get(mapBackIndex) || indexMap[mapBackIndex] != dataBackIndex)
+      {
+        mapBackIndex++;
+      }
+      indexMap[mapBackIndex] = dataIndex;
     }
-    indexMap[_index] = indexMap[mapBackIndex];
+    DestroyElements(&data[dataBackIndex], 1);
 
-    indexAvailability.Set(mapBackIndex, 1);
+    indexAvailability.Set(_index, 1);
     usedElementCount--;
   }
 
@@ -0,0 +1,78 @@
+
+#ifndef ICE_TOOLS_RADIX_SORT_H_
+#define ICE_TOOLS_RADIX_SORT_H_
+
+#include "defines.h"
+
+namespace Ice {
+
+// Stable LSD radix sort of 64-bit keys, one byte per pass, moving a 32-bit value with each key
+// _tempKeys and _tempValues must hold _count elements; the result is left in _keys and _values
+// Passes over bytes every key shares are skipped, so keys with unused high bits cost less
+inline void RadixSort(u64* _keys, u32* _values, u32 _count, u64* _tempKeys, u32* _tempValues)
+{
+  if (_count < 2)
+    return;
+
+  // One histogram per byte, all filled by a single read of the keys
+  u32 histograms[8][256] = {};
+  for (u32 i = 0; i < _count; i++)
+  {
+    u64 key = _keys[i];
+    for (u32 byte = 0; byte < 8; byte++)
+    {
+      histograms[byte][(key >> (byte * 8)) & 0xff]++;
+    }
+  }
+
+  u64* sourceKeys = _keys;
+  u32* sourceValues = _values;
+  u64* destinationKeys = _tempKeys;
+  u32* destinationValues = _tempValues;
+
+  for (u32 byte = 0; byte < 8; byte++)
+  {
+    u32* histogram = histograms[byte];
+    const u32 shift = byte * 8;
+
+    if (histogram[(sourceKeys[0] >> shift) & 0xff] == _count)
+      continue;
+
+    // Histogram -> first destination index of each digit
+    u32 offset = 0;
+    for (u32 digit = 0; digit < 256; digit++)
+    {
+      u32 count = histogram[digit];
+      histogram[digit] = offset;
+      offset += count;
+    }
+
+    for (u32 i = 0; i < _count; i++)
+    {
+      u32 index = histogram[(sourceKeys[i] >> shift) & 0xff]++;
+      destinationKeys[index] = sourceKeys[i];
+      destinationValues[index] = sourceValues[i];
+    }
+
+    u64* swapKeys = sourceKeys;
+    sourceKeys = destinationKeys;
+    destinationKeys = swapKeys;
+
+    u32* swapValues = sourceValues;
+    sourceValues = destinationValues;
+    destinationValues = swapValues;
+  }
+
+  if (sourceKeys != _keys)
+  {
+    for (u32 i = 0; i < _count; i++)
+    {
+      _keys[i] = sourceKeys[i];
+      _values[i] = sourceValues[i];
+    }
+  }
+}
+
+} // namespace Ice
+
+#endif // !ICE_TOOLS_RADIX_SORT_H_